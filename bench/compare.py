@@ -0,0 +1,63 @@
+#!/usr/bin/env python3
+"""
+Compare two benchmark result files produced from different commits.
+
+Accepts either micro_bench output (--benchmark_format=json) or
+load_generator output, and prints the relative change of every metric.
+
+    python3 bench/compare.py baseline.json candidate.json
+"""
+
+import json
+import sys
+
+
+def flatten(path):
+    """Map metric name -> (value, higher_is_better) for one result file"""
+    with open(path) as f:
+        data = json.load(f)
+
+    metrics = {}
+    if "benchmarks" in data:
+        for bench in data["benchmarks"]:
+            if bench.get("error_occurred"):
+                continue
+            name = bench["name"]
+            metrics[name + " cpu_time"] = (bench["cpu_time"], False)
+            for counter in ("bytes_per_second", "items_per_second"):
+                if counter in bench:
+                    metrics[name + " " + counter] = (bench[counter], True)
+    elif data.get("benchmark") == "load_generator":
+        results = data["results"]
+        metrics["messages_per_sec"] = (results["messages_per_sec"], True)
+        metrics["mib_per_sec"] = (results["mib_per_sec"], True)
+        metrics["connections_per_sec"] = (results.get("connections_per_sec", 0), True)
+        for quantile, value in results["latency_us"].items():
+            metrics["latency_us " + quantile] = (value, False)
+    else:
+        raise ValueError(f"{path}: unrecognised result format")
+    return metrics
+
+
+def main():
+    if len(sys.argv) != 3:
+        print(__doc__.strip())
+        return 2
+
+    baseline = flatten(sys.argv[1])
+    candidate = flatten(sys.argv[2])
+    width = max((len(name) for name in baseline), default=0)
+
+    for name, (old, higher_is_better) in baseline.items():
+        if name not in candidate:
+            continue
+        new = candidate[name][0]
+        change = (new - old) / old * 100.0 if old else 0.0
+        better = change > 0 if higher_is_better else change < 0
+        verdict = "" if abs(change) < 2.0 else ("better" if better else "WORSE")
+        print(f"{name:<{width}}  {old:>14.4g}  {new:>14.4g}  {change:>+8.1f}%  {verdict}")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
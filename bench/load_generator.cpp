@@ -0,0 +1,466 @@
+// Closed-loop load generator for tcp_server. Each worker thread drives its
+// share of the connections from its own epoll set, keeping `pipeline`
+// messages in flight per connection, and records the round-trip latency of
+// every echoed message. Results are printed (or written) as JSON.
+//
+//   load_generator [--port N | --address ENDPOINT] [--connections N] [--threads N]
+//                  [--message-size BYTES] [--pipeline N]
+//                  [--duration SECONDS] [--warmup SECONDS] [--out FILE]
+//                  [--messages-per-connection N]
+//                  [--server PATH [--backend epoll|io_uring] [--loops N]]
+//
+// --messages-per-connection turns on churn mode: every connection is closed
+// and replaced after N echoed messages, which exercises the accept path.
+// With --server the generator starts that tcp_server binary itself on --port
+// and stops it afterwards, which makes backend comparisons a single command.
+// --address takes anything tcp_server accepts as its first argument
+// ("[::1]:8080", "unix:/tmp/echo.sock", "unix:@echo"), so the same run can
+// compare TCP loopback against IPv6 or a Unix-domain socket.
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "endpoint.hpp"
+#include "metrics.hpp"
+
+namespace {
+
+struct Options {
+    int port = 8080;
+    std::string address;            // Overrides port; see Endpoint::parse
+    Endpoint endpoint = Endpoint::ipv4("127.0.0.1", 8080);
+    int connections = 64;
+    int threads = 4;
+    size_t message_size = 64;
+    int pipeline = 1;
+    uint64_t messages_per_connection = 0;   // 0 keeps connections open
+    double duration_s = 10.0;
+    double warmup_s = 1.0;
+    std::string out;
+    std::string server;
+    std::string backend = "epoll";
+    int loops = 1;
+};
+
+using Clock = std::chrono::steady_clock;
+
+uint64_t nowNs() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        Clock::now().time_since_epoch()).count());
+}
+
+struct Connection {
+    int fd = -1;
+    size_t pending_write = 0;       // Queued request bytes not yet written
+    size_t received = 0;            // Bytes of the oldest response seen so far
+    std::vector<uint64_t> sent_at;  // Ring of send times, one per message in flight
+    size_t oldest = 0;
+    size_t in_flight = 0;
+    uint64_t completed = 0;
+    bool want_write = false;
+};
+
+struct WorkerResult {
+    Histogram latency_ns;
+    uint64_t messages = 0;
+    uint64_t connections = 0;   // Reconnects inside the measurement window
+    uint64_t errors = 0;
+};
+
+int connectTo(const Endpoint& endpoint) {
+    int fd = socket(endpoint.address()->sa_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return -1;
+    }
+    if (connect(fd, endpoint.address(), endpoint.length()) == -1) {
+        close(fd);
+        return -1;
+    }
+    if (endpoint.family() != AddressFamily::Unix) {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return fd;
+}
+
+class Worker {
+public:
+    Worker(const Options& options, int connections, WorkerResult& result)
+        : m_options(options), m_result(result) {
+        // Requests are all the same bytes, so one pipeline's worth can be
+        // written from any offset that lines up with the message period
+        m_payload.assign(options.message_size * static_cast<size_t>(options.pipeline), 'a');
+        m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (m_epollFd == -1) {
+            throw std::runtime_error("Failed to create epoll instance");
+        }
+        m_connections.resize(static_cast<size_t>(connections));
+        for (size_t i = 0; i < m_connections.size(); ++i) {
+            open(i);
+        }
+    }
+
+    ~Worker() {
+        for (auto& conn : m_connections) {
+            if (conn.fd != -1) close(conn.fd);
+        }
+        close(m_epollFd);
+    }
+
+    void run(uint64_t measure_from, uint64_t measure_until) {
+        m_measureFrom = measure_from;
+        m_measureUntil = measure_until;
+        for (size_t i = 0; i < m_connections.size(); ++i) {
+            start(i);
+        }
+
+        std::vector<epoll_event> events(256);
+        std::vector<char> scratch(64 * 1024);
+        while (nowNs() < m_measureUntil) {
+            int n = epoll_wait(m_epollFd, events.data(), static_cast<int>(events.size()), 10);
+            for (int e = 0; e < n; ++e) {
+                size_t index = events[e].data.u64;
+                if (m_connections[index].fd == -1) continue;
+                if (events[e].events & EPOLLOUT) {
+                    flush(index);
+                }
+                if (events[e].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                    receive(index, scratch);
+                }
+            }
+        }
+    }
+
+private:
+    void open(size_t index) {
+        Connection& conn = m_connections[index];
+        conn = Connection{};
+        conn.fd = connectTo(m_options.endpoint);
+        if (conn.fd == -1) {
+            throw std::runtime_error("Failed to connect to " + m_options.endpoint.toString());
+        }
+        fcntl(conn.fd, F_SETFL, fcntl(conn.fd, F_GETFL, 0) | O_NONBLOCK);
+        conn.sent_at.resize(static_cast<size_t>(m_options.pipeline));
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.u64 = index;
+        epoll_ctl(m_epollFd, EPOLL_CTL_ADD, conn.fd, &ev);
+    }
+
+    void start(size_t index) {
+        Connection& conn = m_connections[index];
+        for (int p = 0; p < m_options.pipeline && wantsMore(conn); ++p) {
+            queueMessage(conn);
+        }
+        flush(index);
+    }
+
+    bool wantsMore(const Connection& conn) const {
+        return m_options.messages_per_connection == 0 ||
+               conn.completed + conn.in_flight < m_options.messages_per_connection;
+    }
+
+    void reconnect(size_t index) {
+        close(m_connections[index].fd);  // Also drops it from the epoll set
+        try {
+            open(index);
+        } catch (const std::exception&) {
+            m_connections[index].fd = -1;
+            ++m_result.errors;
+            return;
+        }
+        uint64_t now = nowNs();
+        if (now >= m_measureFrom && now <= m_measureUntil) {
+            ++m_result.connections;
+        }
+        start(index);
+    }
+
+    void queueMessage(Connection& conn) {
+        conn.sent_at[(conn.oldest + conn.in_flight) % conn.sent_at.size()] = nowNs();
+        ++conn.in_flight;
+        conn.pending_write += m_options.message_size;
+    }
+
+    void flush(size_t index) {
+        Connection& conn = m_connections[index];
+        while (conn.pending_write > 0) {
+            size_t offset = (m_options.message_size - conn.pending_write % m_options.message_size) % m_options.message_size;
+            size_t len = std::min(conn.pending_write, m_payload.size() - offset);
+            ssize_t n = send(conn.fd, m_payload.data() + offset, len, MSG_NOSIGNAL);
+            if (n == -1) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    setWantWrite(index, true);
+                    return;
+                }
+                fail(index);
+                return;
+            }
+            conn.pending_write -= static_cast<size_t>(n);
+        }
+        setWantWrite(index, false);
+    }
+
+    void receive(size_t index, std::vector<char>& scratch) {
+        Connection& conn = m_connections[index];
+        while (true) {
+            ssize_t n = read(conn.fd, scratch.data(), scratch.size());
+            if (n == 0 || (n == -1 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+                fail(index);
+                return;
+            }
+            if (n == -1) {
+                break;
+            }
+            conn.received += static_cast<size_t>(n);
+            while (conn.received >= m_options.message_size && conn.in_flight > 0) {
+                conn.received -= m_options.message_size;
+                complete(conn);
+            }
+            if (conn.in_flight == 0 && !wantsMore(conn)) {
+                reconnect(index);
+                return;
+            }
+        }
+        flush(index);
+    }
+
+    void complete(Connection& conn) {
+        uint64_t sent = conn.sent_at[conn.oldest];
+        conn.oldest = (conn.oldest + 1) % conn.sent_at.size();
+        --conn.in_flight;
+        uint64_t now = nowNs();
+        if (sent >= m_measureFrom && now <= m_measureUntil) {
+            m_result.latency_ns.record(now - sent);
+            ++m_result.messages;
+        }
+        ++conn.completed;
+        if (wantsMore(conn)) {
+            queueMessage(conn);
+        }
+    }
+
+    void setWantWrite(size_t index, bool want) {
+        Connection& conn = m_connections[index];
+        if (conn.want_write == want) return;
+        conn.want_write = want;
+        epoll_event ev{};
+        ev.events = want ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+        ev.data.u64 = index;
+        epoll_ctl(m_epollFd, EPOLL_CTL_MOD, conn.fd, &ev);
+    }
+
+    void fail(size_t index) {
+        Connection& conn = m_connections[index];
+        epoll_ctl(m_epollFd, EPOLL_CTL_DEL, conn.fd, nullptr);
+        close(conn.fd);
+        conn.fd = -1;
+        conn.pending_write = 0;
+        ++m_result.errors;
+    }
+
+    const Options& m_options;
+    WorkerResult& m_result;
+    std::string m_payload;
+    std::vector<Connection> m_connections;
+    int m_epollFd = -1;
+    uint64_t m_measureFrom = 0;
+    uint64_t m_measureUntil = 0;
+};
+
+void usage(const char* argv0) {
+    std::cerr << "Usage: " << argv0 << " [--port N | --address ENDPOINT] [--connections N] [--threads N]"
+              << " [--message-size BYTES] [--pipeline N] [--duration SECONDS]"
+              << " [--warmup SECONDS] [--out FILE] [--messages-per-connection N]"
+              << " [--server PATH [--backend epoll|io_uring] [--loops N]]" << std::endl;
+}
+
+Options parseOptions(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h") {
+            usage(argv[0]);
+            std::exit(0);
+        }
+        if (i + 1 >= argc) {
+            throw std::invalid_argument("Missing value for " + arg);
+        }
+        std::string value = argv[++i];
+        if (arg == "--port") options.port = std::stoi(value);
+        else if (arg == "--address") options.address = value;
+        else if (arg == "--connections") options.connections = std::stoi(value);
+        else if (arg == "--threads") options.threads = std::stoi(value);
+        else if (arg == "--message-size") options.message_size = std::stoul(value);
+        else if (arg == "--pipeline") options.pipeline = std::stoi(value);
+        else if (arg == "--messages-per-connection") options.messages_per_connection = std::stoull(value);
+        else if (arg == "--duration") options.duration_s = std::stod(value);
+        else if (arg == "--warmup") options.warmup_s = std::stod(value);
+        else if (arg == "--out") options.out = value;
+        else if (arg == "--server") options.server = value;
+        else if (arg == "--backend") options.backend = value;
+        else if (arg == "--loops") options.loops = std::stoi(value);
+        else throw std::invalid_argument("Unknown option " + arg);
+    }
+    if (options.connections < 1 || options.threads < 1 || options.pipeline < 1 || options.message_size == 0) {
+        throw std::invalid_argument("connections, threads, pipeline and message-size must be positive");
+    }
+    if (options.threads > options.connections) {
+        options.threads = options.connections;
+    }
+    options.endpoint = options.address.empty() ? Endpoint::ipv4("127.0.0.1", options.port) : Endpoint::parse(options.address);
+    return options;
+}
+
+pid_t spawnServer(const Options& options) {
+    pid_t pid = fork();
+    if (pid == -1) {
+        throw std::runtime_error("fork failed: " + std::string(std::strerror(errno)));
+    }
+    if (pid == 0) {
+        int devnull = open("/dev/null", O_WRONLY);
+        dup2(devnull, STDOUT_FILENO);
+        dup2(devnull, STDERR_FILENO);
+        std::string listen = options.address.empty() ? std::to_string(options.port) : options.address;
+        std::string loops = std::to_string(options.loops);
+        execl(options.server.c_str(), options.server.c_str(), listen.c_str(), loops.c_str(),
+              options.backend.c_str(), static_cast<char*>(nullptr));
+        _exit(127);
+    }
+
+    // Wait for the listener to come up
+    for (int attempt = 0; attempt < 100; ++attempt) {
+        int fd = connectTo(options.endpoint);
+        if (fd != -1) {
+            close(fd);
+            return pid;
+        }
+        if (waitpid(pid, nullptr, WNOHANG) == pid) {
+            throw std::runtime_error("Server exited during startup");
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+    throw std::runtime_error("Server did not start listening on " + options.endpoint.toString());
+}
+
+std::string toJson(const Options& options, const WorkerResult& total, double elapsed_s) {
+    auto us = [](uint64_t ns) { return static_cast<double>(ns) / 1000.0; };
+    double mean_ns = total.messages ? static_cast<double>(total.latency_ns.sum()) / static_cast<double>(total.messages) : 0.0;
+    double bytes = static_cast<double>(total.messages) * static_cast<double>(options.message_size);
+
+    std::ostringstream json;
+    json << "{\n"
+         << "  \"benchmark\": \"load_generator\",\n"
+         << "  \"config\": {\n"
+         << "    \"port\": " << options.endpoint.port() << ",\n"
+         << "    \"address\": \"" << options.endpoint.toString() << "\",\n"
+         << "    \"server\": \"" << (options.server.empty() ? "external" : "spawned") << "\",\n"
+         << "    \"backend\": \"" << (options.server.empty() ? "unknown" : options.backend) << "\",\n"
+         << "    \"loops\": " << (options.server.empty() ? 0 : options.loops) << ",\n"
+         << "    \"connections\": " << options.connections << ",\n"
+         << "    \"threads\": " << options.threads << ",\n"
+         << "    \"message_size\": " << options.message_size << ",\n"
+         << "    \"pipeline\": " << options.pipeline << ",\n"
+         << "    \"messages_per_connection\": " << options.messages_per_connection << ",\n"
+         << "    \"duration_s\": " << options.duration_s << ",\n"
+         << "    \"warmup_s\": " << options.warmup_s << "\n"
+         << "  },\n"
+         << "  \"results\": {\n"
+         << "    \"messages\": " << total.messages << ",\n"
+         << "    \"errors\": " << total.errors << ",\n"
+         << "    \"elapsed_s\": " << elapsed_s << ",\n"
+         << "    \"messages_per_sec\": " << static_cast<double>(total.messages) / elapsed_s << ",\n"
+         << "    \"mib_per_sec\": " << bytes / elapsed_s / (1024.0 * 1024.0) << ",\n"
+         << "    \"connections_per_sec\": " << static_cast<double>(total.connections) / elapsed_s << ",\n"
+         << "    \"latency_us\": {\n"
+         << "      \"mean\": " << mean_ns / 1000.0 << ",\n"
+         << "      \"p50\": " << us(total.latency_ns.quantile(0.5)) << ",\n"
+         << "      \"p90\": " << us(total.latency_ns.quantile(0.9)) << ",\n"
+         << "      \"p99\": " << us(total.latency_ns.quantile(0.99)) << ",\n"
+         << "      \"p999\": " << us(total.latency_ns.quantile(0.999)) << ",\n"
+         << "      \"max\": " << us(total.latency_ns.max()) << "\n"
+         << "    }\n"
+         << "  }\n"
+         << "}\n";
+    return json.str();
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    pid_t server_pid = -1;
+    try {
+        Options options = parseOptions(argc, argv);
+        if (!options.server.empty()) {
+            server_pid = spawnServer(options);
+        }
+
+        // Connect everything before the clock starts
+        std::vector<std::unique_ptr<WorkerResult>> results;
+        std::vector<std::unique_ptr<Worker>> workers;
+        for (int t = 0; t < options.threads; ++t) {
+            int share = options.connections / options.threads + (t < options.connections % options.threads ? 1 : 0);
+            results.push_back(std::make_unique<WorkerResult>());
+            workers.push_back(std::make_unique<Worker>(options, share, *results.back()));
+        }
+
+        uint64_t start = nowNs();
+        uint64_t measure_from = start + static_cast<uint64_t>(options.warmup_s * 1e9);
+        uint64_t measure_until = measure_from + static_cast<uint64_t>(options.duration_s * 1e9);
+        std::vector<std::thread> threads;
+        for (auto& worker : workers) {
+            Worker* w = worker.get();
+            threads.emplace_back([w, measure_from, measure_until] { w->run(measure_from, measure_until); });
+        }
+        for (auto& t : threads) t.join();
+        workers.clear(); // Close connections before stopping the server
+
+        WorkerResult total;
+        for (auto& result : results) {
+            total.latency_ns.merge(result->latency_ns);
+            total.messages += result->messages;
+            total.connections += result->connections;
+            total.errors += result->errors;
+        }
+        std::string json = toJson(options, total, options.duration_s);
+
+        if (options.out.empty()) {
+            std::cout << json;
+        } else {
+            std::ofstream(options.out) << json;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        if (server_pid > 0) {
+            kill(server_pid, SIGKILL);
+            waitpid(server_pid, nullptr, 0);
+        }
+        return 1;
+    }
+
+    if (server_pid > 0) {
+        kill(server_pid, SIGTERM);
+        waitpid(server_pid, nullptr, 0);
+    }
+    return 0;
+}
@@ -0,0 +1,469 @@
+// Microbenchmarks for the per-event hot paths. Run with
+//   micro_bench --benchmark_format=json --benchmark_out=micro.json
+// to get results that bench/compare.py can diff between commits.
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <benchmark/benchmark.h>
+#include "reactor.hpp"
+#include "transform.hpp"
+#include "write_buffer.hpp"
+#include "slab.hpp"
+#include "token_bucket.hpp"
+#include "udp_server.hpp"
+#ifdef REACTOR_COROUTINES
+#include "coro.hpp"
+#endif
+
+// Dispatch cost per ready fd: `range(0)` level-triggered eventfds stay
+// readable forever, so every wait returns all of them. Each iteration runs
+// the loop for a fixed number of dispatches and then shuts it down.
+static void BM_ReactorDispatch(benchmark::State& state) {
+    const int fds = static_cast<int>(state.range(0));
+    const uint64_t dispatches_per_run = 64 * 1024;
+
+    ReactorOptions options;
+    options.max_batch = 1024;
+    Reactor reactor(options);
+    std::vector<int> eventfds;
+    uint64_t dispatched = 0;
+    uint64_t stop_at = 0;
+    for (int i = 0; i < fds; ++i) {
+        int fd = eventfd(1, EFD_NONBLOCK | EFD_CLOEXEC);
+        eventfds.push_back(fd);
+        reactor.registerHandler(fd, EPOLLIN, [&dispatched, &stop_at, &reactor](int, uint32_t) {
+            if (++dispatched == stop_at) {
+                uint64_t one = 1;
+                write(reactor.getShutdownFd(), &one, sizeof(one));
+            }
+        });
+    }
+
+    uint64_t total = 0;
+    for (auto _ : state) {
+        dispatched = 0;
+        stop_at = dispatches_per_run;
+        reactor.run();
+        total += dispatched;
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(total));
+
+    for (int fd : eventfds) {
+        reactor.unregisterHandler(fd);
+        close(fd);
+    }
+}
+BENCHMARK(BM_ReactorDispatch)->Arg(1)->Arg(64)->Arg(512);
+
+// Throughput of each uppercase kernel over one buffer of `range(1)` bytes.
+// `range(0)` -1 is the original stage: std::transform with std::toupper
+// through a back_inserter into the client's std::vector<char> queue.
+static void BM_Transform(benchmark::State& state) {
+    std::string input(static_cast<size_t>(state.range(1)), '\0');
+    for (size_t i = 0; i < input.size(); ++i) {
+        input[i] = static_cast<char>(' ' + i % 95);
+    }
+    if (state.range(0) == -1) {
+        state.SetLabel("std::transform+toupper");
+        std::vector<char> queue;
+        for (auto _ : state) {
+            queue.clear();  // Flushed, capacity kept, as between reads
+            std::transform(input.begin(), input.end(), std::back_inserter(queue), [](unsigned char c) {
+                return static_cast<char>(std::toupper(c));
+            });
+            benchmark::DoNotOptimize(queue.data());
+            benchmark::ClobberMemory();
+        }
+        state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(1));
+        return;
+    }
+
+    PayloadTransform kernels[] = {&uppercaseScalar, &uppercaseSse2, &uppercaseAvx2};
+    PayloadTransform kernel = kernels[state.range(0)];
+    if (kernel == &uppercaseAvx2 && !__builtin_cpu_supports("avx2")) {
+        state.SkipWithError("AVX2 not supported on this CPU");
+        return;
+    }
+    state.SetLabel(uppercaseKernelName(kernel));
+
+    std::string output(input.size(), '\0');
+    for (auto _ : state) {
+        kernel(input.data(), &output[0], input.size());
+        benchmark::DoNotOptimize(output.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(1));
+}
+BENCHMARK(BM_Transform)->ArgsProduct({{-1, 0, 1, 2}, {64, 4096, 65536}});
+
+// The server's read path without the syscalls: reserve tail space, fill it,
+// commit, then consume the backlog as a fully successful write would
+static void BM_WriteBufferPrepareCommit(benchmark::State& state) {
+    const size_t read_size = static_cast<size_t>(state.range(0));
+    WriteBuffer buffer;
+    for (auto _ : state) {
+        size_t queued = 0;
+        while (queued < 64 * 1024) {
+            size_t space = read_size;
+            char* out = buffer.prepare(space);
+            std::memset(out, 'x', space);
+            buffer.commit(space);
+            queued += space;
+        }
+        buffer.consume(buffer.size());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * 64 * 1024);
+}
+BENCHMARK(BM_WriteBufferPrepareCommit)->Arg(512)->Arg(4096);
+
+// Full output path under partial writes: queue a backlog spanning many
+// chunks and flush it into a socketpair whose 4KB send buffer takes a few KB
+// per call, while a reader thread drains the other end. `range(1)` 0 is the
+// old std::vector<char> queue, which memmoves the rest of the backlog with
+// erase() after every partial write; 1 is WriteBuffer, which advances a cursor.
+static void BM_WriteBufferWritev(benchmark::State& state) {
+    const size_t backlog = static_cast<size_t>(state.range(0));
+    const bool chunked = state.range(1) == 1;
+    state.SetLabel(chunked ? "WriteBuffer" : "vector+erase");
+    std::string payload(4096, 'y');
+
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == -1) {
+        state.SkipWithError("socketpair failed");
+        return;
+    }
+    int sndbuf = 4096;
+    setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    std::thread reader([fd = fds[1]] {
+        char sink[4096];
+        while (read(fd, sink, sizeof(sink)) > 0) {
+        }
+    });
+
+    // Blocks until the reader made room; the same wait for both queues
+    auto waitWritable = [fd = fds[0]] {
+        pollfd pfd{fd, POLLOUT, 0};
+        poll(&pfd, 1, -1);
+    };
+    WriteBuffer buffer;
+    std::vector<char> queue;
+    uint64_t partial = 0;
+    for (auto _ : state) {
+        for (size_t queued = 0; queued < backlog; queued += payload.size()) {
+            if (chunked) {
+                buffer.append(payload.data(), payload.size());
+            } else {
+                queue.insert(queue.end(), payload.begin(), payload.end());
+            }
+        }
+        if (chunked) {
+            while (!buffer.empty()) {
+                if (buffer.writeTo(fds[0]) == -1) {
+                    waitWritable();
+                } else {
+                    ++partial;
+                }
+            }
+        } else {
+            while (!queue.empty()) {
+                ssize_t n = write(fds[0], queue.data(), queue.size());
+                if (n == -1) {
+                    waitWritable();
+                    continue;
+                }
+                queue.erase(queue.begin(), queue.begin() + n);
+                ++partial;
+            }
+        }
+    }
+    close(fds[0]);  // EOF ends the reader
+    reader.join();
+    close(fds[1]);
+    state.counters["writes"] = benchmark::Counter(static_cast<double>(partial), benchmark::Counter::kAvgIterations);
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * backlog));
+}
+BENCHMARK(BM_WriteBufferWritev)->ArgsProduct({{64 * 1024, 1024 * 1024}, {0, 1}});
+
+// Connection table churn: 64 connections open, each event looks its fd up
+// four times, then all close. `range(0)` 0 keys a std::unordered_map by fd
+// (one node per connection), 1 is the server's Slab plus an fd-indexed
+// handle table.
+namespace {
+struct Connection {
+    explicit Connection(int fd) : fd(fd) {}
+    int fd;
+    WriteBuffer output;
+    uint64_t timers[3] = {};
+    bool reads_paused = false;
+};
+} // namespace
+
+static void BM_ConnectionTable(benchmark::State& state) {
+    constexpr int CONNECTIONS = 64;
+    std::unordered_map<int, Connection> map;
+    Slab<Connection> slab;
+    std::vector<SlabHandle> by_fd(CONNECTIONS + 16);
+    uint64_t seen = 0;
+    for (auto _ : state) {
+        for (int fd = 16; fd < 16 + CONNECTIONS; ++fd) {
+            if (state.range(0) == 0) {
+                map.emplace(fd, Connection(fd));
+            } else {
+                by_fd[fd] = slab.emplace(fd);
+            }
+        }
+        for (int event = 0; event < 4; ++event) {
+            for (int fd = 16; fd < 16 + CONNECTIONS; ++fd) {
+                Connection* connection = state.range(0) == 0 ? &map.find(fd)->second : slab.get(by_fd[fd]);
+                seen += static_cast<uint64_t>(connection->fd);
+            }
+        }
+        for (int fd = 16; fd < 16 + CONNECTIONS; ++fd) {
+            if (state.range(0) == 0) {
+                map.erase(fd);
+            } else {
+                slab.erase(by_fd[fd]);
+            }
+        }
+    }
+    benchmark::DoNotOptimize(seen);
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * CONNECTIONS);
+}
+BENCHMARK(BM_ConnectionTable)->Arg(0)->Arg(1);
+
+// Traffic shaping cost per read event: the allowance from a connection's and
+// its listener's buckets, then charging the 4KB read to both, with the loop
+// clock ticking every 64 events. `range(0)` 0 is the default unlimited
+// buckets, 1 two limited ones that never run dry.
+static void BM_TokenBucket(benchmark::State& state) {
+    RateLimit limit{state.range(0) == 0 ? 0 : 1ull << 40, 0};
+    TokenBucket connection(limit, 0);
+    TokenBucket listener(limit, 0);
+    uint64_t now = 0;
+    uint64_t allowed = 0;
+    for (auto _ : state) {
+        for (int event = 0; event < 64; ++event) {
+            allowed += std::min(connection.available(now), listener.available(now));
+            connection.consume(4096);
+            listener.consume(4096);
+        }
+        ++now;
+    }
+    benchmark::DoNotOptimize(allowed);
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * 64);
+}
+BENCHMARK(BM_TokenBucket)->Arg(0)->Arg(1);
+
+// One flight recorder event: a timestamp and a 16-byte store into the ring,
+// as Reactor::run records for every wait, wakeup and handler run
+static void BM_FlightRecorder(benchmark::State& state) {
+    FlightRecorder recorder(16384);
+    int fd = 0;
+    for (auto _ : state) {
+        recorder.record(TraceEvent::HandlerEnter, fd++ & 1023, EPOLLIN);
+    }
+    benchmark::DoNotOptimize(recorder.recorded());
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+    state.SetLabel(FlightRecorder::usesTsc() ? "rdtsc" : "CLOCK_MONOTONIC_RAW");
+}
+BENCHMARK(BM_FlightRecorder);
+
+// Echo round trips of `range(0)` bytes over a socketpair, both ends driven by
+// one Reactor. The callback and coroutine variants do the same syscalls, so
+// the difference is the cost of the programming model.
+namespace {
+
+constexpr uint64_t ECHO_ROUNDS = 1024;
+
+struct EchoState {
+    Reactor reactor;
+    std::string message;
+    std::vector<char> scratch = std::vector<char>(64 * 1024);
+    std::vector<char> reply = std::vector<char>(64 * 1024);   // Client side, coroutines only
+    size_t received = 0;
+    uint64_t rounds = 0;
+    uint64_t stop_at = 0;
+
+    void stop() {
+        uint64_t one = 1;
+        write(reactor.getShutdownFd(), &one, sizeof(one));
+    }
+};
+
+} // namespace
+
+static void BM_EchoCallback(benchmark::State& state) {
+    EchoState echo;
+    echo.message.assign(static_cast<size_t>(state.range(0)), 'e');
+    int sv[2];
+    socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, sv);
+
+    // Server end: send back whatever arrives
+    echo.reactor.registerHandler(sv[0], EPOLLIN | EPOLLET, [&echo](int fd, uint32_t) {
+        ssize_t n;
+        while ((n = read(fd, echo.scratch.data(), echo.scratch.size())) > 0) {
+            write(fd, echo.scratch.data(), static_cast<size_t>(n));
+        }
+    });
+    // Client end: count complete replies and send the next message
+    echo.reactor.registerHandler(sv[1], EPOLLIN | EPOLLET, [&echo](int fd, uint32_t) {
+        ssize_t n;
+        while ((n = read(fd, echo.scratch.data(), echo.scratch.size())) > 0) {
+            echo.received += static_cast<size_t>(n);
+        }
+        while (echo.received >= echo.message.size()) {
+            echo.received -= echo.message.size();
+            if (++echo.rounds == echo.stop_at) {
+                echo.stop();
+                return;
+            }
+            write(fd, echo.message.data(), echo.message.size());
+        }
+    });
+
+    for (auto _ : state) {
+        echo.stop_at = echo.rounds + ECHO_ROUNDS;
+        write(sv[1], echo.message.data(), echo.message.size());
+        echo.reactor.run();
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(echo.rounds));
+
+    echo.reactor.unregisterHandler(sv[0]);
+    echo.reactor.unregisterHandler(sv[1]);
+    close(sv[0]);
+    close(sv[1]);
+}
+BENCHMARK(BM_EchoCallback)->Arg(64)->Arg(4096);
+
+// Datagram echo over loopback with `range(0)` datagrams per recvmmsg/
+// sendmmsg on the server (1 = no batching). A client socket on the same
+// Reactor keeps a window of 64-byte datagrams in flight, so one thread (one
+// core) runs both ends; packets_per_second counts server replies.
+static void BM_UdpEcho(benchmark::State& state) {
+    constexpr size_t WINDOW = 128;
+    constexpr size_t PAYLOAD = 64;
+    constexpr uint64_t PACKETS_PER_RUN = 64 * 1024;
+
+    Reactor reactor;
+    UDPServerOptions options;
+    options.batch_size = static_cast<size_t>(state.range(0));
+    options.gro = false;    // Distinct datagrams, so batching is what is measured
+    UDPServer server(reactor, 0, options);
+
+    Socket client(SocketType::Datagram);
+    client.setNonBlocking();
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(server.getPort()));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    connect(client.getFd(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+
+    // The client batches too, so its own syscalls do not dominate
+    std::vector<char> payload(WINDOW * PAYLOAD, 'u');
+    std::vector<iovec> iovs(WINDOW);
+    std::vector<mmsghdr> msgs(WINDOW);
+    for (size_t i = 0; i < WINDOW; ++i) {
+        iovs[i] = {payload.data() + i * PAYLOAD, PAYLOAD};
+        msgs[i] = mmsghdr{};
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    uint64_t received = 0;
+    uint64_t stop_at = 0;
+    reactor.registerHandler(client.getFd(), EPOLLIN | EPOLLET, [&](int fd, uint32_t) {
+        int n;
+        while ((n = recvmmsg(fd, msgs.data(), WINDOW, 0, nullptr)) > 0) {
+            received += static_cast<uint64_t>(n);
+            if (received >= stop_at) {
+                uint64_t one = 1;
+                write(reactor.getShutdownFd(), &one, sizeof(one));
+                return;
+            }
+            sendmmsg(fd, msgs.data(), static_cast<unsigned int>(n), 0);
+        }
+    });
+
+    uint64_t total = 0;
+    for (auto _ : state) {
+        received = 0;
+        stop_at = PACKETS_PER_RUN;
+        sendmmsg(client.getFd(), msgs.data(), WINDOW, 0);
+        reactor.run();
+        // Let the tail of the window land before the next run starts counting
+        while (recvmmsg(client.getFd(), msgs.data(), WINDOW, MSG_DONTWAIT, nullptr) > 0) {
+        }
+        total += received;
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(total));
+    state.counters["packets_per_second"] = benchmark::Counter(static_cast<double>(total), benchmark::Counter::kIsRate);
+
+    reactor.unregisterHandler(client.getFd());
+}
+BENCHMARK(BM_UdpEcho)->Arg(1)->Arg(32)->UseRealTime();
+
+#ifdef REACTOR_COROUTINES
+static Task<void> echoServer(AsyncSocket& socket, EchoState& echo) {
+    while (true) {
+        ssize_t n = co_await socket.async_read(echo.scratch.data(), echo.scratch.size());
+        if (n <= 0) {
+            break;
+        }
+        co_await socket.async_write(echo.scratch.data(), static_cast<size_t>(n));
+    }
+    echo.stop();
+}
+
+static Task<void> echoClient(AsyncSocket& socket, EchoState& echo) {
+    std::vector<char>& reply = echo.reply;
+    for (uint64_t i = 0; i < ECHO_ROUNDS; ++i) {
+        co_await socket.async_write(echo.message.data(), echo.message.size());
+        size_t received = 0;
+        while (received < echo.message.size()) {
+            ssize_t n = co_await socket.async_read(reply.data(), reply.size());
+            if (n <= 0) {
+                co_return;
+            }
+            received += static_cast<size_t>(n);
+        }
+        ++echo.rounds;
+    }
+    echo.stop();
+}
+
+static void BM_EchoCoroutine(benchmark::State& state) {
+    EchoState echo;
+    echo.message.assign(static_cast<size_t>(state.range(0)), 'e');
+    int sv[2];
+    socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, sv);
+    AsyncSocket server(echo.reactor, Socket(sv[0]));
+    auto client = std::make_unique<AsyncSocket>(echo.reactor, Socket(sv[1]));
+    spawn(echoServer(server, echo));
+
+    for (auto _ : state) {
+        // A fresh coroutine per batch; its frame comes from the FramePool
+        spawn(echoClient(*client, echo));
+        echo.reactor.run();
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(echo.rounds));
+
+    // EOF lets the server coroutine finish instead of leaking its frame
+    client.reset();
+    echo.reactor.run();
+}
+BENCHMARK(BM_EchoCoroutine)->Arg(64)->Arg(4096);
+#endif
+
+BENCHMARK_MAIN();
@@ -0,0 +1,49 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include "delegate.hpp"
+#include "reactor.hpp"
+#include "socket.hpp"
+
+// Minimal HTTP/1.0 endpoint for operational data, driven by an existing
+// Reactor so it needs no thread of its own. `GET /metrics` is answered with
+// whatever the renderer appends; every connection is closed after one reply.
+// Must be created, used and destroyed on the reactor's thread.
+class AdminListener {
+public:
+    using Renderer = Delegate<void(std::string& body)>;
+
+    AdminListener(Reactor& reactor, int port, Renderer render);
+
+    AdminListener(const AdminListener&) = delete;
+
+    AdminListener& operator=(const AdminListener&) = delete;
+
+    ~AdminListener();
+
+    int getPort() const { return m_socket.getPort(); }
+
+private:
+    struct Connection {
+        explicit Connection(int fd) : socket(fd) {}
+
+        Socket socket;
+        std::string request;
+        std::string response;
+        size_t sent = 0;
+    };
+
+    static constexpr size_t MAX_REQUEST_SIZE = 8192;
+
+    void handleAccept();
+    void handleConnection(int fd, uint32_t events);
+    void respond(Connection& conn);
+    bool flush(Connection& conn);
+    void closeConnection(int fd);
+
+    Reactor& m_reactor;
+    Socket m_socket;
+    Renderer m_render;
+    std::unordered_map<int, std::unique_ptr<Connection>> m_connections;
+};
@@ -0,0 +1,99 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+
+// Message framing for the byte stream. Framers are stateless and const, so
+// one instance serves every connection on every loop and worker thread.
+
+enum class Framing : uint8_t {
+    None,           // Raw bytes, transformed as they arrive
+    Line,           // '\n'-terminated, an optional '\r' before it is stripped
+    LengthPrefix    // 4-byte big-endian payload length, then the payload
+};
+
+enum class FrameStatus : uint8_t { Complete, Incomplete, Invalid };
+
+class Framer {
+public:
+    static constexpr size_t MAX_HEADER = 8;
+
+    virtual ~Framer() = default;
+
+    // Looks for one frame at the start of input. On Complete, frame views the
+    // payload inside input (nothing is copied) and consumed covers the frame
+    // with its delimiters. Invalid means the stream can not be resynchronised.
+    virtual FrameStatus decode(std::string_view input, std::string_view& frame, size_t& consumed) const = 0;
+
+    // Writes the bytes that precede a reply payload of `length` bytes into
+    // out (at most MAX_HEADER) and returns how many
+    virtual size_t encodeHeader(size_t length, char* out) const = 0;
+
+    // Bytes that follow every reply payload
+    virtual std::string_view trailer() const = 0;
+};
+
+class LineFramer final : public Framer {
+public:
+    // Lines longer than max_line (without the terminator) are Invalid
+    explicit LineFramer(size_t max_line);
+
+    FrameStatus decode(std::string_view input, std::string_view& frame, size_t& consumed) const override;
+    size_t encodeHeader(size_t length, char* out) const override;
+    std::string_view trailer() const override { return "\n"; }
+
+private:
+    size_t m_maxLine;
+};
+
+class LengthPrefixFramer final : public Framer {
+public:
+    static constexpr size_t HEADER_SIZE = 4;
+
+    // Frames announcing more than max_frame payload bytes are Invalid
+    explicit LengthPrefixFramer(size_t max_frame);
+
+    FrameStatus decode(std::string_view input, std::string_view& frame, size_t& consumed) const override;
+    size_t encodeHeader(size_t length, char* out) const override;
+    std::string_view trailer() const override { return {}; }
+
+private:
+    size_t m_maxFrame;
+};
+
+// nullptr for Framing::None
+std::unique_ptr<Framer> makeFramer(Framing framing, size_t max_frame);
+
+// Receive-side byte queue for framed connections. Reads land at the tail,
+// decoded frames are views into it and consuming only advances the head.
+// The unparsed remainder is moved to the front only when the tail runs out
+// of room. release() frees the storage of an empty buffer, so connections
+// between messages hold nothing.
+class ReadBuffer {
+public:
+    static constexpr size_t MIN_CAPACITY = 16 * 1024;
+
+    // At least len writable bytes at the tail
+    char* prepare(size_t len);
+
+    void commit(size_t len) { m_end += len; }
+
+    void consume(size_t len);
+
+    void release();
+
+    std::string_view view() const { return {m_data.get() + m_begin, m_end - m_begin}; }
+
+    size_t size() const { return m_end - m_begin; }
+
+    bool empty() const { return m_begin == m_end; }
+
+    size_t capacity() const { return m_capacity; }
+
+private:
+    std::unique_ptr<char[]> m_data;
+    size_t m_capacity = 0;
+    size_t m_begin = 0;
+    size_t m_end = 0;
+};
@@ -0,0 +1,270 @@
+#pragma once
+#if __cplusplus < 202002L
+#error "coro.hpp needs C++20: configure with -DENABLE_COROUTINES=ON and link coro_lib"
+#endif
+#include <cerrno>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <optional>
+#include <utility>
+#include <sys/types.h>
+#include "reactor.hpp"
+#include "socket.hpp"
+
+// C++20 coroutine layer over Reactor. A coroutine that awaits a socket
+// operation is resumed straight from the Reactor's dispatch of that fd, on
+// the loop thread, with no intermediate queue. Everything here belongs to a
+// single loop thread, like the Reactor itself.
+
+// Per-thread free lists of coroutine frames in 64-byte size classes up to
+// 1KB (larger frames use the global allocator). After warm-up, starting a
+// coroutine pops a frame and finishing one pushes it back.
+class FramePool {
+public:
+    static constexpr size_t CLASS_SIZE = 64;
+    static constexpr size_t CLASSES = 16;
+    static constexpr size_t MAX_CACHED = 1024;  // Per size class and thread
+
+    static void* allocate(size_t size);
+    static void deallocate(void* frame, size_t size) noexcept;
+
+    // Calling thread's frames sitting in the free lists
+    static size_t cached();
+
+    // Frames the calling thread had to take from the global allocator
+    static uint64_t heapAllocations();
+};
+
+namespace detail {
+
+struct PooledPromise {
+    static void* operator new(size_t size) { return FramePool::allocate(size); }
+    static void operator delete(void* frame, size_t size) noexcept { FramePool::deallocate(frame, size); }
+};
+
+// Hands control to whoever awaited the finished task (symmetric transfer,
+// so long await chains do not grow the stack)
+struct FinalAwaiter {
+    bool await_ready() noexcept { return false; }
+
+    template <typename Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+        std::coroutine_handle<> next = handle.promise().continuation;
+        return next ? next : std::noop_coroutine();
+    }
+
+    void await_resume() noexcept {}
+};
+
+template <typename T>
+struct TaskPromiseBase : PooledPromise {
+    std::coroutine_handle<> continuation;
+    std::exception_ptr error;
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() noexcept { error = std::current_exception(); }
+};
+
+} // namespace detail
+
+// Lazily started coroutine returning T. It runs when first awaited and
+// resumes its awaiter when it finishes; exceptions propagate to the awaiter.
+template <typename T = void>
+class Task {
+public:
+    struct promise_type : detail::TaskPromiseBase<T> {
+        std::optional<T> value;
+
+        Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+
+        template <typename U>
+        void return_value(U&& v) { value.emplace(std::forward<U>(v)); }
+
+        T result() {
+            if (this->error) std::rethrow_exception(this->error);
+            return std::move(*value);
+        }
+    };
+
+    Task(Task&& other) noexcept : m_handle(std::exchange(other.m_handle, {})) {}
+
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            if (m_handle) m_handle.destroy();
+            m_handle = std::exchange(other.m_handle, {});
+        }
+        return *this;
+    }
+
+    Task(const Task&) = delete;
+
+    Task& operator=(const Task&) = delete;
+
+    ~Task() {
+        if (m_handle) m_handle.destroy();
+    }
+
+    auto operator co_await() && noexcept {
+        struct Awaiter {
+            std::coroutine_handle<promise_type> handle;
+
+            bool await_ready() noexcept { return false; }
+
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+                handle.promise().continuation = awaiting;
+                return handle;
+            }
+
+            T await_resume() { return handle.promise().result(); }
+        };
+        return Awaiter{m_handle};
+    }
+
+private:
+    explicit Task(std::coroutine_handle<promise_type> handle) : m_handle(handle) {}
+
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+template <>
+class Task<void> {
+public:
+    struct promise_type : detail::TaskPromiseBase<void> {
+        Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+
+        void return_void() noexcept {}
+
+        void result() {
+            if (error) std::rethrow_exception(error);
+        }
+    };
+
+    Task(Task&& other) noexcept : m_handle(std::exchange(other.m_handle, {})) {}
+
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            if (m_handle) m_handle.destroy();
+            m_handle = std::exchange(other.m_handle, {});
+        }
+        return *this;
+    }
+
+    Task(const Task&) = delete;
+
+    Task& operator=(const Task&) = delete;
+
+    ~Task() {
+        if (m_handle) m_handle.destroy();
+    }
+
+    auto operator co_await() && noexcept {
+        struct Awaiter {
+            std::coroutine_handle<promise_type> handle;
+
+            bool await_ready() noexcept { return false; }
+
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+                handle.promise().continuation = awaiting;
+                return handle;
+            }
+
+            void await_resume() { handle.promise().result(); }
+        };
+        return Awaiter{m_handle};
+    }
+
+private:
+    explicit Task(std::coroutine_handle<promise_type> handle) : m_handle(handle) {}
+
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+// Starts task immediately and lets it run to completion on its own; the
+// frame frees itself at the end. An escaping exception is logged, not
+// rethrown. Typical use: one spawned coroutine per accepted connection.
+void spawn(Task<void> task);
+
+class AsyncSocket;
+
+// Result of AsyncSocket::async_read/async_write/async_accept. The operation
+// is tried when awaited; only if it would block does the coroutine suspend,
+// and the retry then happens inside the Reactor dispatch that resumes it.
+// co_await yields the syscall's result: -1 with errno set on failure.
+class IoAwaiter {
+public:
+    bool await_ready() { return attempt(); }
+
+    void await_suspend(std::coroutine_handle<> handle);
+
+    ssize_t await_resume() const {
+        if (m_result == -1) errno = m_error;    // The loop may have clobbered it since
+        return m_result;
+    }
+
+private:
+    friend class AsyncSocket;
+
+    enum class Op : uint8_t { Read, Write, Accept };
+
+    IoAwaiter(AsyncSocket& socket, Op op, char* data, size_t len)
+        : m_socket(&socket), m_data(data), m_len(len), m_op(op) {}
+
+    // Runs the syscall; false means it would block
+    bool attempt();
+
+    AsyncSocket* m_socket;
+    char* m_data;
+    size_t m_len;
+    size_t m_done = 0;          // Bytes written so far (async_write sends everything)
+    ssize_t m_result = 0;
+    int m_error = 0;
+    Op m_op;
+    std::coroutine_handle<> m_handle;
+};
+
+// Non-blocking socket registered once with a Reactor for both directions,
+// edge-triggered, so awaiting never costs an epoll_ctl. One coroutine may
+// wait to read (or accept) and one to write at the same time. Must be
+// created and destroyed on the reactor's thread and outlive its waiters.
+class AsyncSocket {
+public:
+    AsyncSocket(Reactor& reactor, Socket socket);
+
+    AsyncSocket(const AsyncSocket&) = delete;
+
+    AsyncSocket& operator=(const AsyncSocket&) = delete;
+
+    ~AsyncSocket();
+
+    // Some bytes (at most len), 0 at end of stream
+    IoAwaiter async_read(void* data, size_t len) {
+        return IoAwaiter(*this, IoAwaiter::Op::Read, static_cast<char*>(data), len);
+    }
+
+    // All len bytes, unless the connection fails first
+    IoAwaiter async_write(const void* data, size_t len) {
+        return IoAwaiter(*this, IoAwaiter::Op::Write, static_cast<char*>(const_cast<void*>(data)), len);
+    }
+
+    // A connection on this listening socket, non-blocking and close-on-exec
+    IoAwaiter async_accept() {
+        return IoAwaiter(*this, IoAwaiter::Op::Accept, nullptr, 0);
+    }
+
+    int getFd() const { return m_socket.getFd(); }
+    Socket& socket() { return m_socket; }
+
+private:
+    friend class IoAwaiter;
+
+    void onEvents(uint32_t events);
+
+    Reactor& m_reactor;
+    Socket m_socket;
+    IoAwaiter* m_reader = nullptr;
+    IoAwaiter* m_writer = nullptr;
+    bool* m_alive = nullptr;    // Set while dispatching; a resumed waiter may destroy us
+};
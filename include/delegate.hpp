@@ -0,0 +1,98 @@
+#pragma once
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Move-only callable wrapper with inline storage and no heap fallback. Callables
+// larger than Capacity are rejected at compile time, so storing a handler or a
+// timer callback can never allocate. The default capacity fits lambdas that
+// capture a handful of pointers and ints (a whole Delegate is one cache line).
+template <typename Signature, size_t Capacity = 48>
+class Delegate;
+
+template <typename R, typename... Args, size_t Capacity>
+class Delegate<R(Args...), Capacity> {
+    using Invoke = R (*)(void*, Args&&...);
+    // Relocates src into dst (move-construct, then destroy src); a null dst
+    // just destroys src
+    using Manage = void (*)(void* dst, void* src);
+
+    alignas(std::max_align_t) unsigned char m_storage[Capacity];
+    Invoke m_invoke = nullptr;
+    Manage m_manage = nullptr;
+
+public:
+    Delegate() noexcept = default;
+
+    Delegate(std::nullptr_t) noexcept {}
+
+    template <typename F, typename Fn = std::decay_t<F>,
+              typename = std::enable_if_t<!std::is_same<Fn, Delegate>::value>>
+    Delegate(F&& f) {
+        static_assert(sizeof(Fn) <= Capacity, "Callable too large for Delegate inline storage");
+        static_assert(alignof(Fn) <= alignof(std::max_align_t), "Callable over-aligned for Delegate");
+        static_assert(std::is_nothrow_move_constructible<Fn>::value, "Callable must be nothrow movable");
+        ::new (static_cast<void*>(m_storage)) Fn(std::forward<F>(f));
+        m_invoke = [](void* self, Args&&... args) -> R {
+            return (*static_cast<Fn*>(self))(std::forward<Args>(args)...);
+        };
+        m_manage = [](void* dst, void* src) {
+            if (dst) {
+                ::new (dst) Fn(std::move(*static_cast<Fn*>(src)));
+            }
+            static_cast<Fn*>(src)->~Fn();
+        };
+    }
+
+    Delegate(Delegate&& other) noexcept {
+        moveFrom(other);
+    }
+
+    Delegate& operator=(Delegate&& other) noexcept {
+        if (this != &other) {
+            reset();
+            moveFrom(other);
+        }
+        return *this;
+    }
+
+    Delegate& operator=(std::nullptr_t) noexcept {
+        reset();
+        return *this;
+    }
+
+    Delegate(const Delegate&) = delete;
+
+    Delegate& operator=(const Delegate&) = delete;
+
+    ~Delegate() {
+        reset();
+    }
+
+    R operator()(Args... args) const {
+        // Storage is logically owned state of the callable, not of the wrapper
+        return m_invoke(const_cast<unsigned char*>(m_storage), std::forward<Args>(args)...);
+    }
+
+    explicit operator bool() const noexcept { return m_invoke != nullptr; }
+
+    void reset() noexcept {
+        if (m_manage) {
+            m_manage(nullptr, m_storage);
+        }
+        m_invoke = nullptr;
+        m_manage = nullptr;
+    }
+
+private:
+    void moveFrom(Delegate& other) noexcept {
+        if (other.m_invoke) {
+            other.m_manage(m_storage, other.m_storage);
+            m_invoke = other.m_invoke;
+            m_manage = other.m_manage;
+            other.m_invoke = nullptr;
+            other.m_manage = nullptr;
+        }
+    }
+};
@@ -0,0 +1,56 @@
+#pragma once
+#include <string>
+#include <sys/socket.h>
+
+enum class AddressFamily {
+    IPv4,
+    IPv6,
+    Unix
+};
+
+// Where a socket binds or connects: an IPv4 or IPv6 address with a port, or
+// a Unix-domain stream socket name. Addresses are numeric; nothing here
+// touches DNS.
+class Endpoint {
+public:
+    // 0.0.0.0:port, what TCPServer(port) has always listened on
+    static Endpoint any(int port);
+
+    static Endpoint ipv4(const std::string& address, int port);
+
+    // With dual_stack (IPV6_V6ONLY off) a socket bound to "::" also accepts
+    // IPv4 clients, which then show up as v4-mapped addresses
+    static Endpoint ipv6(const std::string& address, int port, bool dual_stack = true);
+
+    // A filesystem path, or a Linux abstract name (no file, gone with the
+    // last socket) when it starts with '@'
+    static Endpoint unixPath(const std::string& path);
+
+    // "8080" (any IPv4 address), "127.0.0.1:8080", "[::1]:8080",
+    // "[::]:8080", "unix:/run/echo.sock" or "unix:@echo"; throws
+    // std::invalid_argument on anything else
+    static Endpoint parse(const std::string& text);
+
+    // Address the socket fd is bound to
+    static Endpoint local(int fd);
+
+    AddressFamily family() const;
+    int port() const;                   // 0 for Unix endpoints
+    Endpoint withPort(int port) const;  // Same address, another port (inet only)
+    bool dualStack() const { return m_dualStack; }
+    bool isAbstract() const;
+    std::string path() const;           // Unix filesystem path, empty otherwise
+
+    // Round-trips through parse()
+    std::string toString() const;
+
+    const sockaddr* address() const { return reinterpret_cast<const sockaddr*>(&m_addr); }
+    socklen_t length() const { return m_length; }
+
+private:
+    Endpoint() = default;
+
+    sockaddr_storage m_addr{};
+    socklen_t m_length = 0;
+    bool m_dualStack = false;
+};
@@ -0,0 +1,86 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <sys/types.h>
+#include "metrics.hpp"
+
+// Open descriptors and metadata of the most recently served files under one
+// directory, so a hot file costs no open/fstat per request. Entries are
+// rechecked with a stat at most every revalidate_ms and reopened if the file
+// was replaced or modified. An evicted or replaced file stays open until the
+// last response using it finishes. Single-threaded, like the loop that owns
+// it.
+//
+// Files are expected to be replaced (rename over), not rewritten in place: a
+// file truncated while mapped raises SIGBUS in whoever reads the mapping.
+class FileCache {
+public:
+    class File {
+    public:
+        File(int fd, const struct stat& st, uint64_t now_ms);
+
+        File(const File&) = delete;
+
+        File& operator=(const File&) = delete;
+
+        ~File();
+
+        int fd() const { return m_fd; }
+        size_t size() const { return m_size; }
+
+        // The whole file mapped read-only, on first use, for writers that
+        // need the bytes in memory (userspace TLS); nullptr if mmap fails
+        const char* data();
+
+    private:
+        friend class FileCache;
+
+        int m_fd;
+        size_t m_size;
+        dev_t m_dev;
+        ino_t m_ino;
+        timespec m_mtime;
+        uint64_t m_checkedMs;   // Loop time of the last stat that matched
+        void* m_map = nullptr;
+    };
+
+    using FilePtr = std::shared_ptr<File>;
+
+    // Opens root as a directory; throws std::runtime_error. The counters,
+    // when given, count lookups served from the cache and files opened.
+    FileCache(const std::string& root, size_t max_files, uint64_t revalidate_ms,
+              Counter* hits = nullptr, Counter* misses = nullptr);
+
+    FileCache(const FileCache&) = delete;
+
+    FileCache& operator=(const FileCache&) = delete;
+
+    ~FileCache();
+
+    // A regular file at path relative to root ("a/b.bin", a leading '/' is
+    // ignored). Returns nullptr with errno set when it does not exist, is
+    // not a regular file, or the path has a ".." component or would resolve
+    // outside root (EINVAL/EXDEV).
+    FilePtr open(std::string_view path, uint64_t now_ms);
+
+    size_t size() const { return m_lru.size(); }
+
+private:
+    using Entry = std::pair<std::string, FilePtr>;
+
+    bool unchanged(const std::string& path, File& file, uint64_t now_ms) const;
+
+    int m_root;
+    size_t m_maxFiles;
+    uint64_t m_revalidateMs;
+    Counter* m_hits;
+    Counter* m_misses;
+    std::list<Entry> m_lru;     // Most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> m_index;
+};
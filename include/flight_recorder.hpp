@@ -0,0 +1,95 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <ctime>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+enum class TraceEvent : uint16_t {
+    Wait,           // Loop about to block in the poller
+    Wakeup,         // ... and back, arg = events returned
+    HandlerEnter,   // arg = event mask
+    HandlerExit,
+    ReadPause,      // Flow control stopped reading fd
+    ReadResume,
+    Accept,
+    Close,
+};
+
+// Always-on event trace for one loop: a fixed ring of 16-byte records that
+// overwrites its oldest entries, so it always holds the last `capacity`
+// events before a dump. Recording is a timestamp and four stores into a
+// slot found by masking a counter. Timestamps come from the TSC where it
+// is invariant (one rdtsc) and CLOCK_MONOTONIC_RAW otherwise; export converts
+// either to microseconds. Single writer, the loop thread; snapshot() from
+// that same thread.
+class FlightRecorder {
+public:
+    struct Record {
+        uint64_t ticks;
+        int32_t fd;         // -1 when the event has none
+        TraceEvent type;
+        uint16_t arg;       // Event mask or count, saturated
+    };
+
+    // capacity is rounded up to a power of two; throws std::invalid_argument for 0
+    explicit FlightRecorder(size_t capacity);
+
+    FlightRecorder(const FlightRecorder&) = delete;
+
+    FlightRecorder& operator=(const FlightRecorder&) = delete;
+
+    void record(TraceEvent type, int fd = -1, uint32_t arg = 0) {
+        Record& slot = m_records[m_next++ & m_mask];
+        slot.ticks = now();
+        slot.fd = fd;
+        slot.type = type;
+        slot.arg = static_cast<uint16_t>(arg > UINT16_MAX ? UINT16_MAX : arg);
+    }
+
+    // Appends the retained records to out, oldest first
+    void snapshot(std::vector<Record>& out) const;
+
+    size_t capacity() const { return m_mask + 1; }
+
+    // Events recorded since construction, including overwritten ones
+    uint64_t recorded() const { return m_next; }
+
+    // The clock record() reads: TSC cycles or CLOCK_MONOTONIC_RAW nanoseconds
+    static uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+        if (s_tsc) {
+            return __rdtsc();
+        }
+#endif
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+    }
+
+    // Whether now() reads the TSC
+    static bool usesTsc() { return s_tsc; }
+
+private:
+    static const bool s_tsc;    // Invariant TSC present, decided once at startup
+
+    std::unique_ptr<Record[]> m_records;
+    size_t m_mask;
+    uint64_t m_next = 0;
+};
+
+// One loop's records for appendChromeTrace(), oldest first
+struct TraceSnapshot {
+    std::string thread_name;
+    std::vector<FlightRecorder::Record> records;
+};
+
+// Chrome trace event format JSON (chrome://tracing, ui.perfetto.dev), one
+// thread per snapshot: handler runs and poller waits become complete ("X")
+// slices, the rest instant events. A slice whose start was already
+// overwritten, or that was still open at the snapshot, is left out.
+void appendChromeTrace(std::string& out, const std::vector<TraceSnapshot>& loops);
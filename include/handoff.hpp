@@ -0,0 +1,74 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include "delegate.hpp"
+#include "reactor.hpp"
+#include "socket.hpp"
+
+// Hot restart. A running server passes its listening sockets (and, if asked,
+// its idle connections) to a successor process over a Unix socket with
+// SCM_RIGHTS. The channel is SOCK_SEQPACKET, so every event loop of the old
+// server can send its own messages without them interleaving.
+//
+// Protocol, old server to new: one Listeners message carrying every
+// listening socket, whose value is the number of loops that follow. Each of
+// those loops then sends any number of Clients messages and one LoopDone.
+
+enum class HandoffMessage : uint32_t {
+    Listeners = 1,
+    Clients = 2,
+    LoopDone = 3
+};
+
+// At most this many fds ride in one message (the kernel allows 253)
+constexpr size_t HANDOFF_MAX_FDS = 64;
+
+// Sends one message with count fds (at most HANDOFF_MAX_FDS); blocks while
+// the channel is full. Returns false with errno set on failure.
+bool sendHandoffMessage(int channel, HandoffMessage kind, uint32_t value, const int* fds, size_t count);
+
+struct InheritedSockets {
+    std::vector<Socket> listeners;
+    std::vector<Socket> clients;
+};
+
+// Connects to the server listening on path and collects everything it hands
+// over. Returns false when no server is listening there (a cold start);
+// throws std::runtime_error if the handoff itself fails or times out.
+bool inheritSockets(const std::string& path, InheritedSockets& out, int timeout_ms = 5000);
+
+// Listens on a Unix socket path from an existing Reactor and hands the first
+// successor that connects to the callback, then stops listening. Only a peer
+// running as peer_uid (SO_PEERCRED) counts as a successor; anyone else is
+// disconnected before a single fd is sent. The path is replaced if it
+// exists, and removed on destruction unless a successor has taken it over.
+// Must be created, used and destroyed on the reactor's thread.
+class HandoffListener {
+public:
+    using Callback = Delegate<void(Socket& channel)>;
+
+    // peer_uid (uid_t)-1 means the effective uid of this process
+    HandoffListener(Reactor& reactor, const std::string& path, Callback on_successor,
+                    uid_t peer_uid = static_cast<uid_t>(-1));
+
+    HandoffListener(const HandoffListener&) = delete;
+
+    HandoffListener& operator=(const HandoffListener&) = delete;
+
+    ~HandoffListener();
+
+    bool handedOff() const { return m_handedOff; }
+
+private:
+    void handleAccept();
+
+    Reactor& m_reactor;
+    std::string m_path;
+    Socket m_socket;
+    Callback m_onSuccessor;
+    uid_t m_peerUid;
+    bool m_handedOff = false;
+};
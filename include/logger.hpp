@@ -0,0 +1,196 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Asynchronous logger for the event loops. A log call copies its format
+// pointer and arguments into a fixed-size record on a per-thread
+// single-producer ring; a background thread formats and writes them. The
+// calling thread never formats, locks or blocks: when its ring is full the
+// record is dropped and counted instead.
+//
+// Formats use "{}" placeholders and must be string literals (only the pointer
+// is stored). String arguments are copied into the record, truncated to fit.
+
+enum class LogLevel : uint8_t { Trace, Debug, Info, Warn, Error, Off };
+
+// Levels below this are compiled out entirely (0 = Trace ... 5 = Off)
+#ifndef REACTOR_MIN_LOG_LEVEL
+#define REACTOR_MIN_LOG_LEVEL 1
+#endif
+
+// Wraps an errno value so strerror() runs on the logging thread
+struct LogErrno {
+    int code;
+};
+
+struct LogRecord {
+    static constexpr int MAX_ARGS = 6;
+    static constexpr size_t TEXT_SIZE = 96;
+
+    enum class ArgType : uint8_t { Int, UInt, Double, Text, Errno };
+
+    struct Arg {
+        ArgType type;
+        union {
+            int64_t i;
+            uint64_t u;
+            double d;
+            struct { uint16_t offset; uint16_t length; } text;
+            int err;
+        };
+    };
+
+    uint64_t timestamp_ns;
+    const char* format;
+    LogLevel level;
+    uint8_t arg_count;
+    uint16_t text_used;
+    Arg args[MAX_ARGS];
+    char text[TEXT_SIZE];   // Backing store for copied string arguments
+};
+
+class Logger {
+public:
+    static Logger& instance();
+
+    static bool enabled(LogLevel level) {
+        return static_cast<int>(level) >= s_level.load(std::memory_order_relaxed);
+    }
+
+    static void setLevel(LogLevel level) {
+        s_level.store(static_cast<int>(level), std::memory_order_relaxed);
+    }
+
+    template <typename... Args>
+    void log(LogLevel level, const char* format, const Args&... args) {
+        static_assert(sizeof...(Args) <= LogRecord::MAX_ARGS, "Too many log arguments");
+        Ring& ring = threadRing();
+        LogRecord* record = ring.claim();
+        if (record == nullptr) {
+            ring.dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        record->timestamp_ns = nowNs();
+        record->format = format;
+        record->level = level;
+        record->arg_count = 0;
+        record->text_used = 0;
+        int expand[] = {0, (encode(*record, args), 0)...};
+        (void)expand;
+        ring.publish();
+    }
+
+    // Blocks until every record logged before the call has been written
+    void flush();
+
+    ~Logger();
+
+private:
+    // Single-producer single-consumer ring owned by one logging thread
+    struct Ring {
+        static constexpr uint32_t CAPACITY = 1024;  // Power of two
+
+        LogRecord* claim() {
+            uint32_t tail = m_tail.load(std::memory_order_relaxed);
+            if (tail - m_head.load(std::memory_order_acquire) == CAPACITY) {
+                return nullptr;
+            }
+            return &m_records[tail & (CAPACITY - 1)];
+        }
+
+        void publish() {
+            m_tail.store(m_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        std::unique_ptr<LogRecord[]> m_records{new LogRecord[CAPACITY]};
+        alignas(64) std::atomic<uint32_t> m_head{0};   // Consumer position
+        alignas(64) std::atomic<uint32_t> m_tail{0};   // Producer position
+        std::atomic<uint64_t> dropped{0};
+        std::atomic<bool> retired{false};  // Owning thread has exited
+    };
+
+    Logger();
+
+    Ring& threadRing();
+    static uint64_t nowNs();
+    void drainLoop();
+    void drain(Ring& ring, std::string& out, std::string& err);
+    static void format(const LogRecord& record, std::string& line);
+
+    static void encode(LogRecord& record, LogErrno value) {
+        LogRecord::Arg& arg = record.args[record.arg_count++];
+        arg.type = LogRecord::ArgType::Errno;
+        arg.err = value.code;
+    }
+
+    static void encode(LogRecord& record, double value) {
+        LogRecord::Arg& arg = record.args[record.arg_count++];
+        arg.type = LogRecord::ArgType::Double;
+        arg.d = value;
+    }
+
+    static void encode(LogRecord& record, const char* value) {
+        encodeText(record, value, value ? std::strlen(value) : 0);
+    }
+
+    static void encode(LogRecord& record, const std::string& value) {
+        encodeText(record, value.data(), value.size());
+    }
+
+    template <typename T, typename std::enable_if<std::is_integral<T>::value, int>::type = 0>
+    static void encode(LogRecord& record, T value) {
+        LogRecord::Arg& arg = record.args[record.arg_count++];
+        if (std::is_signed<T>::value) {
+            arg.type = LogRecord::ArgType::Int;
+            arg.i = static_cast<int64_t>(value);
+        } else {
+            arg.type = LogRecord::ArgType::UInt;
+            arg.u = static_cast<uint64_t>(value);
+        }
+    }
+
+    static void encodeText(LogRecord& record, const char* data, size_t length) {
+        LogRecord::Arg& arg = record.args[record.arg_count++];
+        arg.type = LogRecord::ArgType::Text;
+        size_t room = LogRecord::TEXT_SIZE - record.text_used;
+        size_t n = length < room ? length : room;
+        std::memcpy(record.text + record.text_used, data, n);
+        arg.text.offset = record.text_used;
+        arg.text.length = static_cast<uint16_t>(n);
+        record.text_used = static_cast<uint16_t>(record.text_used + n);
+    }
+
+    static std::atomic<int> s_level;
+
+    std::mutex m_mutex;                  // Guards everything below; never taken by log()
+    std::condition_variable m_wakeup;
+    std::condition_variable m_flushed;
+    std::vector<std::shared_ptr<Ring>> m_rings;
+    uint64_t m_flushRequested = 0;
+    uint64_t m_flushCompleted = 0;
+    bool m_stopping = false;
+    std::thread m_thread;
+};
+
+#define REACTOR_LOG(level, ...)                                                   \
+    do {                                                                          \
+        if constexpr (static_cast<int>(level) >= REACTOR_MIN_LOG_LEVEL) {         \
+            if (Logger::enabled(level)) {                                         \
+                Logger::instance().log(level, __VA_ARGS__);                       \
+            }                                                                     \
+        }                                                                         \
+    } while (0)
+
+#define LOG_TRACE(...) REACTOR_LOG(LogLevel::Trace, __VA_ARGS__)
+#define LOG_DEBUG(...) REACTOR_LOG(LogLevel::Debug, __VA_ARGS__)
+#define LOG_INFO(...)  REACTOR_LOG(LogLevel::Info, __VA_ARGS__)
+#define LOG_WARN(...)  REACTOR_LOG(LogLevel::Warn, __VA_ARGS__)
+#define LOG_ERROR(...) REACTOR_LOG(LogLevel::Error, __VA_ARGS__)
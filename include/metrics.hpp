@@ -0,0 +1,128 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Lock-free instrumentation for the event loops. Every metric has a single
+// writer (the loop thread that owns it), so updates are a relaxed load plus a
+// relaxed store with no read-modify-write; any thread may read concurrently,
+// e.g. to render a scrape. Counters sit on their own cache line so loops and
+// the scraper never false-share.
+
+class Counter {
+    alignas(64) std::atomic<uint64_t> m_value{0};
+public:
+    void add(uint64_t n = 1) {
+        m_value.store(m_value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+    uint64_t value() const { return m_value.load(std::memory_order_relaxed); }
+};
+
+class Gauge {
+    alignas(64) std::atomic<int64_t> m_value{0};
+public:
+    void add(int64_t n) {
+        m_value.store(m_value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+    int64_t value() const { return m_value.load(std::memory_order_relaxed); }
+};
+
+// HDR-style log-linear histogram: values below 8 are exact, above that each
+// power of two is split into 8 sub-buckets (<= 12.5% relative error) across
+// the whole uint64_t range. Recording is a couple of shifts and three stores.
+class Histogram {
+public:
+    static constexpr int SUB_BITS = 3;
+    static constexpr uint64_t SUB_BUCKETS = 1ull << SUB_BITS;
+    static constexpr size_t BUCKETS = (64 - SUB_BITS + 1) * SUB_BUCKETS;
+
+    void record(uint64_t value) {
+        bump(m_buckets[bucketIndex(value)], 1);
+        bump(m_count, 1);
+        bump(m_sum, value);
+        if (value > m_max.load(std::memory_order_relaxed)) {
+            m_max.store(value, std::memory_order_relaxed);
+        }
+    }
+
+    uint64_t count() const { return m_count.load(std::memory_order_relaxed); }
+    uint64_t sum() const { return m_sum.load(std::memory_order_relaxed); }
+    uint64_t max() const { return m_max.load(std::memory_order_relaxed); }
+
+    // Upper bound of the bucket holding the q-th quantile (0 when empty)
+    uint64_t quantile(double q) const;
+
+    // Folds other's samples into this one; counts as a write to this histogram
+    void merge(const Histogram& other);
+
+    static size_t bucketIndex(uint64_t value) {
+        if (value < SUB_BUCKETS) {
+            return static_cast<size_t>(value);
+        }
+        int shift = 63 - __builtin_clzll(value) - SUB_BITS;
+        return static_cast<size_t>(shift + 1) * SUB_BUCKETS + ((value >> shift) & (SUB_BUCKETS - 1));
+    }
+
+    static uint64_t bucketUpperBound(size_t index);
+
+private:
+    static void bump(std::atomic<uint64_t>& cell, uint64_t n) {
+        cell.store(cell.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    alignas(64) std::atomic<uint64_t> m_count{0};
+    std::atomic<uint64_t> m_sum{0};
+    std::atomic<uint64_t> m_max{0};
+    std::atomic<uint64_t> m_buckets[BUCKETS] = {};
+};
+
+// Recorded by Reactor::run() when attached with Reactor::setMetrics()
+struct ReactorMetrics {
+    Histogram poll_wait_ns;         // Time blocked (or spinning) in the poller
+    Histogram events_per_wakeup;
+    Histogram handler_ns;           // Run time of each handler invocation
+};
+
+// Everything one server event loop records
+struct LoopMetrics {
+    ReactorMetrics reactor;
+    Counter bytes_in;
+    Counter bytes_out;
+    Counter accepts;
+    Counter closes;
+    Counter rejected;               // Shed by the max_connections cap
+    Counter read_pauses;            // Flow control stopped reading a client
+    Counter read_resumes;           // ... and started again
+    Counter zerocopy_sends;         // Flushes sent with MSG_ZEROCOPY
+    Counter zerocopy_copied;        // ... that the kernel copied after all
+    Counter frames;                 // Complete frames answered on the loop (framing on)
+    Counter worker_requests;        // Requests handed to the worker pool
+    Counter budget_pauses;          // Reads parked by the global buffer budget
+    Counter handed_off;             // Connections passed to a successor process
+    Counter tls_handshakes;         // TLS handshakes completed
+    Counter tls_failures;           // ... and failed
+    Counter ktls_send;              // Handshakes after which the kernel encrypts replies
+    Counter ktls_recv;              // ... and decrypts requests
+    Counter file_responses;         // Files sent in full (static_root)
+    Counter file_bytes;             // File bytes sent without the write buffer
+    Counter file_cache_hits;        // File lookups answered from the open-file cache
+    Counter file_cache_misses;      // ... and files opened
+    Counter read_yields;            // Reads cut short by read_budget_bytes
+    Counter read_throttles;         // Clients that ran out of read tokens
+    Counter write_throttles;        // ... and of write tokens
+    Counter accept_throttles;       // Listeners that ran out of connection tokens
+    Counter datagrams_in;           // UDP datagrams received (each GRO segment counts)
+    Counter datagrams_out;          // ... and answered
+    Counter datagrams_dropped;      // Oversized on receive, or refused by the socket on send
+    Counter datagram_batches;       // recvmmsg calls that returned datagrams
+    Counter datagram_yields;        // UDP wakeups cut short by batches_per_wakeup
+    Gauge buffered_bytes;           // Output queued across all clients
+    Gauge buffer_chunks;            // Write-buffer chunks held by clients
+    Gauge pooled_chunks;            // ... and cached in the loop's pool
+};
+
+// Appends every loop's metrics in Prometheus text exposition format, each
+// series labelled with its loop index
+void appendPrometheus(std::string& out, const std::vector<const LoopMetrics*>& loops);
@@ -0,0 +1,83 @@
+#pragma once
+#include <atomic>
+#include <utility>
+
+// Unbounded multi-producer single-consumer queue (Vyukov's node-based
+// design). push() is one atomic exchange plus a store and never blocks or
+// spins; pop() belongs to a single consumer thread. A producer preempted
+// between its exchange and its link makes pop() report empty until it
+// resumes, so callers must signal the consumer only after push() returns.
+template <typename T>
+class MpscQueue {
+public:
+    MpscQueue() : m_head(&m_stub), m_tail(&m_stub) {}
+
+    MpscQueue(const MpscQueue&) = delete;
+
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    ~MpscQueue() {
+        T value;
+        while (pop(value)) {
+        }
+    }
+
+    // Safe from any thread
+    void push(T value) {
+        pushNode(new Node(std::move(value)));
+    }
+
+    // Consumer thread only. Returns false when empty (or a push is mid-way).
+    bool pop(T& out) {
+        Node* tail = m_tail;
+        Node* next = tail->next.load(std::memory_order_acquire);
+        if (tail == &m_stub) {
+            if (next == nullptr) {
+                return false;
+            }
+            m_tail = next;
+            tail = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+        if (next != nullptr) {
+            m_tail = next;
+            return take(tail, out);
+        }
+        if (tail != m_head.load(std::memory_order_acquire)) {
+            return false;   // A producer swapped the head but has not linked yet
+        }
+        // tail is the last node; put the stub behind it so it can be unlinked
+        pushNode(&m_stub);
+        next = tail->next.load(std::memory_order_acquire);
+        if (next != nullptr) {
+            m_tail = next;
+            return take(tail, out);
+        }
+        return false;
+    }
+
+private:
+    struct Node {
+        Node() = default;
+        explicit Node(T v) : value(std::move(v)) {}
+
+        std::atomic<Node*> next{nullptr};
+        T value;
+    };
+
+    void pushNode(Node* node) {
+        node->next.store(nullptr, std::memory_order_relaxed);
+        Node* prev = m_head.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    static bool take(Node* node, T& out) {
+        out = std::move(node->value);
+        delete node;
+        return true;
+    }
+
+    alignas(64) std::atomic<Node*> m_head;  // Last pushed node, shared by producers
+    alignas(64) Node* m_tail;               // Next node to pop, consumer only
+    Node m_stub;
+};
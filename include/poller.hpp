@@ -0,0 +1,35 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <sys/epoll.h>
+
+enum class ReactorBackend {
+    Epoll,
+    IoUring,   // Multishot poll over io_uring, falls back to Epoll if unsupported
+};
+
+// Readiness notification backend used by Reactor. Mirrors epoll_ctl semantics:
+// calls return 0 on success or -1 with errno set. Every registration carries an
+// opaque tag that wait() hands back in epoll_event::data.ptr, whatever the
+// mechanism, so dispatch needs no fd lookup.
+class Poller {
+public:
+    virtual ~Poller() = default;
+
+    virtual int add(int fd, uint32_t events, void* tag) = 0;
+
+    virtual int modify(int fd, uint32_t events, void* tag) = 0;
+
+    virtual int remove(int fd) = 0;
+
+    // Blocks up to timeout_ms (-1 = forever) and returns the number of events
+    // stored in out, or -1 with errno set
+    virtual int wait(struct epoll_event* out, int max_events, int timeout_ms) = 0;
+
+    virtual ReactorBackend backend() const = 0;
+};
+
+std::unique_ptr<Poller> makeEpollPoller();
+
+// Returns nullptr when the running kernel lacks the io_uring features we need
+std::unique_ptr<Poller> makeIoUringPoller();
@@ -1,22 +1,128 @@
 #pragma once
 #include <cstdint>
-#include <functional>
-#include <unordered_map>
+#include <cstddef>
+#include <memory>
+#include <vector>
 #include <atomic>
+#include "delegate.hpp"
+#include "mpsc_queue.hpp"
+#include "poller.hpp"
+#include "timer_wheel.hpp"
+#include "metrics.hpp"
+#include "flight_recorder.hpp"
+
+struct ReactorOptions {
+    // Requested readiness backend; IoUring silently degrades to Epoll when the
+    // kernel does not support it (check Reactor::backend() for the outcome)
+    ReactorBackend backend = ReactorBackend::Epoll;
+
+    // Events fetched per wait. The batch doubles whenever a wait fills it and
+    // halves after a run of mostly empty waits; min == max fixes the size.
+    int min_batch = 16;
+    int max_batch = 1024;
+
+    // Low-latency mode: poll with a zero timeout for up to spin_us
+    // microseconds before falling back to a blocking wait (0 = never spin)
+    uint32_t spin_us = 0;
+
+    // Pin the thread that calls run() to this CPU (-1 = leave unpinned)
+    int cpu_affinity = -1;
+};
 
 class Reactor {
-    using EventHandler = std::function<void(int, uint32_t)>;
-    int m_epollFd;
+public:
+    using EventHandler = Delegate<void(int, uint32_t)>;
+    using Task = Delegate<void(), 64>;
+
+private:
+    // One slot per fd, stored in fixed-size pages so a slot never moves and its
+    // address can ride along in epoll_event::data.ptr
+    struct HandlerSlot {
+        EventHandler handler;
+        int fd = -1;
+        bool active = false;
+        uint32_t deferred = 0;  // Events owed through the ready queue
+        bool queued = false;    // Has an entry in m_ready, so at most one per pass
+    };
+    static constexpr size_t SLOTS_PER_PAGE = 1024;
+    static constexpr size_t MAX_POSTED_PER_WAKEUP = 256;  // Then ready fds get a turn
+
+    ReactorOptions m_options;
+    std::unique_ptr<Poller> m_poller;
     int m_shutdownFd;
-    std::unordered_map<int, EventHandler> m_handlers;
+    int m_wakeFd;                   // Signalled by post(), handled through m_wakeSlot
+    HandlerSlot m_wakeSlot;
+    MpscQueue<Task> m_posted;
+    std::atomic<bool> m_wakePending{false};  // Collapses wakeups while one is outstanding
+    std::vector<std::unique_ptr<HandlerSlot[]>> m_slotPages;
+    HandlerSlot* m_dispatching = nullptr;
+    std::vector<HandlerSlot*> m_ready;      // Deferred handlers for the next pass
+    std::vector<HandlerSlot*> m_readyRunning;
+    TimerWheel m_timers;
+    uint64_t m_nowMs;   // Loop time, refreshed around every wait
+    int m_batchSize;
+    int m_underfilledWaits = 0;
+    ReactorMetrics* m_metrics = nullptr;
+    FlightRecorder* m_recorder = nullptr;
 
 public:
+    using TimerId = TimerWheel::TimerId;
+    using TimerCallback = TimerWheel::Callback;
+
     Reactor();
+    explicit Reactor(const ReactorOptions& options);
     ~Reactor();
 
     void registerHandler(int fd, uint32_t events, EventHandler handler);
     void unregisterHandler(int fd);
     void modifyHandler(int fd, uint32_t events);
     void run();
+
+    // Calls fd's handler again with events once every handler ready in this
+    // iteration has run, without going through the poller: for a handler
+    // that stopped early (a read budget, say) while its edge-triggered fd
+    // still has work. Deferring an fd that is already queued merges the
+    // events; a poller event for it first delivers them early. Unregistering
+    // drops the entry. The next wait does not block while anything is queued.
+    void defer(int fd, uint32_t events);
+    size_t readyCount() const { return m_ready.size(); }
+
+    // One-shot timers relative to the loop clock; they drive the wait timeout
+    TimerId addTimer(uint64_t delay_ms, TimerCallback callback);
+    bool cancelTimer(TimerId id);
+    bool resetTimer(TimerId id, uint64_t delay_ms);
+    uint64_t now() const { return m_nowMs; }
+    size_t timerCount() const { return m_timers.size(); }
+
+    // Runs task on the loop thread during a later iteration of run(). The one
+    // thread-safe entry point: any thread may post, tasks from one thread run
+    // in the order they were posted. Tasks still queued when the Reactor is
+    // destroyed are dropped without running.
+    void post(Task task);
+    int batchSize() const { return m_batchSize; }
+
+    // Records wait time, events per wakeup and handler run time into metrics
+    // (nullptr, the default, skips the clock reads entirely). Not thread-safe:
+    // call before run() or from the loop thread.
+    void setMetrics(ReactorMetrics* metrics) { m_metrics = metrics; }
+
+    // Records every wait, wakeup and handler run (with its fd and events)
+    // into recorder; nullptr, the default, records nothing. Same threading
+    // rules as setMetrics().
+    void setRecorder(FlightRecorder* recorder) { m_recorder = recorder; }
+    FlightRecorder* recorder() const { return m_recorder; }
+
     int getShutdownFd() const { return m_shutdownFd; }
-};
\ No newline at end of file
+    ReactorBackend backend() const { return m_poller->backend(); }
+
+private:
+    HandlerSlot* findSlot(int fd);
+    HandlerSlot* createSlot(int fd);
+    int waitForEvents(struct epoll_event* events, int timeout);
+    void adaptBatchSize(int nfds);
+    void pinThread();
+    void wake();
+    void runPosted();
+    void runReady();
+    void dispatch(HandlerSlot* slot, uint32_t events);
+};
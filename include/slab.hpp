@@ -0,0 +1,141 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Names one element of a Slab. The generation tells the element a handle was
+// made for from a later one that reused its slot, so a handle kept past
+// erase() (in a timer, a posted task, a worker's reply) resolves to nothing
+// instead of to a stranger.
+struct SlabHandle {
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    uint32_t index = NONE;
+    uint32_t generation = 0;
+
+    bool valid() const { return index != NONE; }
+
+    friend bool operator==(SlabHandle a, SlabHandle b) {
+        return a.index == b.index && a.generation == b.generation;
+    }
+    friend bool operator!=(SlabHandle a, SlabHandle b) { return !(a == b); }
+};
+
+// Object pool with stable addresses: elements live in fixed-size pages that
+// are never moved or freed before the Slab, and erased slots go on a LIFO
+// free list, so churn reuses the most recently touched memory and, once the
+// pages exist, costs no allocation. Lookups are an index and a generation
+// compare. Single-threaded.
+template <typename T, size_t PageSize = 256>
+class Slab {
+public:
+    using Handle = SlabHandle;
+
+    Slab() = default;
+
+    Slab(const Slab&) = delete;
+
+    Slab& operator=(const Slab&) = delete;
+
+    ~Slab() {
+        clear();
+    }
+
+    // Constructs an element in a free slot (a new page when there is none)
+    template <typename... Args>
+    Handle emplace(Args&&... args) {
+        const bool reuse = m_freeHead != Handle::NONE;
+        const uint32_t index = reuse ? m_freeHead : m_slots;
+        if (index / PageSize >= m_pages.size()) {
+            m_pages.emplace_back(new Slot[PageSize]);
+        }
+        Slot& slot = at(index);
+        // Constructed before any bookkeeping, so a throwing constructor
+        // leaves the Slab as it was
+        ::new (static_cast<void*>(slot.storage)) T(std::forward<Args>(args)...);
+        if (reuse) {
+            m_freeHead = slot.nextFree;
+        } else {
+            ++m_slots;
+        }
+        slot.live = true;
+        ++m_size;
+        return Handle{index, slot.generation};
+    }
+
+    // nullptr once the element was erased, even if the slot is in use again
+    T* get(Handle handle) {
+        if (handle.index >= m_slots) {
+            return nullptr;
+        }
+        Slot& slot = at(handle.index);
+        return slot.live && slot.generation == handle.generation ? slot.object() : nullptr;
+    }
+
+    const T* get(Handle handle) const {
+        return const_cast<Slab*>(this)->get(handle);
+    }
+
+    // Destroys the element; stale handles are ignored
+    bool erase(Handle handle) {
+        T* object = get(handle);
+        if (object == nullptr) {
+            return false;
+        }
+        Slot& slot = at(handle.index);
+        object->~T();
+        slot.live = false;
+        ++slot.generation;
+        slot.nextFree = m_freeHead;
+        m_freeHead = handle.index;
+        --m_size;
+        return true;
+    }
+
+    void clear() {
+        for (uint32_t i = 0; i < m_slots; ++i) {
+            erase(Handle{i, at(i).generation});
+        }
+    }
+
+    // Calls fn(handle, element) for every element, in slot order. fn must
+    // not erase or emplace; collect handles first for that.
+    template <typename Fn>
+    void forEach(Fn&& fn) {
+        for (uint32_t i = 0; i < m_slots; ++i) {
+            Slot& slot = at(i);
+            if (slot.live) {
+                fn(Handle{i, slot.generation}, *slot.object());
+            }
+        }
+    }
+
+    size_t size() const { return m_size; }
+
+    bool empty() const { return m_size == 0; }
+
+    // Slots ever handed out, live or on the free list
+    size_t capacity() const { return m_slots; }
+
+private:
+    struct Slot {
+        alignas(T) unsigned char storage[sizeof(T)];
+        uint32_t generation = 0;
+        uint32_t nextFree = Handle::NONE;
+        bool live = false;
+
+        T* object() { return std::launder(reinterpret_cast<T*>(storage)); }
+    };
+
+    Slot& at(uint32_t index) {
+        return m_pages[index / PageSize][index % PageSize];
+    }
+
+    std::vector<std::unique_ptr<Slot[]>> m_pages;
+    uint32_t m_slots = 0;       // Slots below this have been used at least once
+    uint32_t m_freeHead = Handle::NONE;
+    size_t m_size = 0;
+};
@@ -1,10 +1,37 @@
 #pragma once
+#include "endpoint.hpp"
+
+// Options for a listening socket. Linux copies them onto every connection
+// accepted from it, so the accept path itself makes no setsockopt calls.
+struct SocketOptions {
+    bool tcp_nodelay = false;   // Disable Nagle's algorithm
+    int defer_accept_s = 0;     // TCP_DEFER_ACCEPT: wake accept only once data arrives (0 = off)
+    int send_buffer = 0;        // SO_SNDBUF in bytes, 0 keeps the kernel default
+    int recv_buffer = 0;        // SO_RCVBUF in bytes, 0 keeps the kernel default
+    int busy_poll_us = 0;       // SO_BUSY_POLL budget, needs CAP_NET_ADMIN above net.core.busy_read
+    bool zerocopy = false;      // SO_ZEROCOPY, lets sends use MSG_ZEROCOPY
+
+    // Small request/response traffic: never hold back a partial segment
+    static SocketOptions lowLatency();
+
+    // Streaming traffic: large kernel buffers so fewer wakeups move more data
+    static SocketOptions highThroughput();
+};
+
+enum class SocketType {
+    Stream,     // TCP
+    Datagram    // UDP
+};
 
 class Socket {
     int m_fd;
 public:
     Socket();
 
+    explicit Socket(SocketType type);
+
+    explicit Socket(AddressFamily family, SocketType type = SocketType::Stream);
+
     explicit Socket(int fd);
 
     Socket(const Socket&) = delete;
@@ -21,11 +48,47 @@ public:
 
     void setReuseAddr();
 
-    void bind(int port);  // Binding logic to be implemented
+    void setReusePort();
+
+    void setBusyPoll(int usec);
+
+    void setNoDelay();
+
+    void setDeferAccept(int seconds);
+
+    void setSendBuffer(int bytes);
+
+    void setRecvBuffer(int bytes);
+
+    void setZeroCopy();
+
+    // Applies every non-default field except busy_poll_us, which callers set
+    // separately because it commonly fails without privileges. TCP-only
+    // fields and zerocopy are skipped on Unix-domain sockets.
+    void apply(const SocketOptions& options);
+
+    void bind(int port);  // Any IPv4 address
+
+    // IPv6 endpoints also set IPV6_V6ONLY to match Endpoint::dualStack()
+    void bind(const Endpoint& endpoint);
+
+    // Blocking connect, or started in the background on a non-blocking socket
+    void connect(const Endpoint& endpoint);
+
+    Endpoint localEndpoint() const { return Endpoint::local(m_fd); }
+
+    AddressFamily family() const;
 
     void listen();  // Listening logic to be implemented
 
-    int getPort() const;
+    int getPort() const;  // 0 for Unix-domain sockets
 
     int getFd() const { return m_fd; }
+
+    // Gives up ownership: returns the fd and leaves this Socket empty
+    int release() {
+        int fd = m_fd;
+        m_fd = -1;
+        return fd;
+    }
 };
\ No newline at end of file
@@ -1,34 +1,382 @@
 #pragma once
-#include <unordered_map>
+#include <functional>
 #include <memory>
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <thread>
 #include <vector>
 #include <iostream>
 #include "socket.hpp"
 #include "reactor.hpp"
+#include "write_buffer.hpp"
+#include "transform.hpp"
+#include "metrics.hpp"
+#include "admin_listener.hpp"
+#include "worker_pool.hpp"
+#include "codec.hpp"
+#include "udp_server.hpp"
+#include "handoff.hpp"
+#include "tls.hpp"
+#include "file_cache.hpp"
+#include "slab.hpp"
+#include "token_bucket.hpp"
 
 
 
+// Names a connection in its loop's slab; stays safe to look up after the
+// connection closed and its fd and slot were reused
+using ClientHandle = SlabHandle;
+
 struct ClientState {
-    std::unique_ptr<Socket> socket;
-    std::vector<char> write_buffer;
+    ClientState(int fd, WriteBuffer::Pool* pool) : socket(fd), write_buffer(pool) {}
+
+    Socket socket;
+    WriteBuffer write_buffer;
+    ReadBuffer read_buffer;     // Partial frame carried between reads (ServerConfig::framing)
+    uint64_t last_read_ms = 0;  // Loop time of the last framed read
+    bool read_buffer_tracked = false;   // On the loop's read_buffers list
+    Reactor::TimerId idle_timer = TimerWheel::INVALID_TIMER;
+    Reactor::TimerId read_timer = TimerWheel::INVALID_TIMER;
+    Reactor::TimerId write_stall_timer = TimerWheel::INVALID_TIMER;
+    bool reads_paused = false;  // Flow control dropped EPOLLIN for this client
+    bool budget_parked = false; // ... because of max_buffered_bytes, waiting on the loop's parked list
+    uint32_t interest = EPOLLIN | EPOLLET;  // As last registered with the Reactor
+    ClientHandle handle;        // Its own slot, for tasks that outlive the current event
+
+    // Worker offload (ServerConfig::worker_threads): bytes received while a
+    // request is with a worker wait here, so one connection's replies stay in
+    // order. With framing, only complete frames are handed over.
+    bool request_in_flight = false;
+    std::string inbox;
+
+    std::unique_ptr<TlsSession> tls;    // nullptr for cleartext connections
+
+    // A file reply streamed with sendfile (ServerConfig::static_root). Bytes
+    // queued before it go out first; reads wait until it is done.
+    struct FileResponse {
+        FileCache::FilePtr file;
+        size_t offset = 0;
+        std::string_view trailer;       // The framer's, queued once the file is out
+    };
+    std::unique_ptr<FileResponse> file_response;
+
+    // Traffic shaping (ServerConfig::client_read_bytes/client_write_bytes).
+    // A throttle timer is pending only while the client waits for tokens.
+    TokenBucket read_tokens;
+    TokenBucket write_tokens;
+    Reactor::TimerId read_throttle_timer = TimerWheel::INVALID_TIMER;
+    Reactor::TimerId write_throttle_timer = TimerWheel::INVALID_TIMER;
+};
+
+// A closed connection whose zero-copy sends the kernel has not confirmed yet.
+// Its socket stays open, shut down in both directions, because only its error
+// queue says when the pinned chunks are free to go back to the loop's pool.
+struct ZeroCopyLinger {
+    ZeroCopyLinger(Socket&& socket, WriteBuffer&& chunks) : socket(std::move(socket)), chunks(std::move(chunks)) {}
+    ~ZeroCopyLinger() { chunks.abandonZeroCopy(); }    // Still pinned when the server goes away
+
+    Socket socket;
+    WriteBuffer chunks;
+};
+
+// Turns one batch of received bytes (or one frame's payload, with framing)
+// into the reply, in place
+using RequestHandler = std::function<void(std::string& payload)>;
+
+struct ServerConfig {
+    // Number of event-loop threads. Each loop owns its own Reactor, client map
+    // and SO_REUSEPORT listening socket; 1 keeps the classic single-loop server.
+    size_t num_loops = 1;
+
+    // Applied to every loop's Reactor (readiness backend, batching, spinning)
+    ReactorOptions reactor;
+
+    // CPUs to pin loop threads to, loop i uses loop_cpus[i % size]; empty
+    // leaves ReactorOptions::cpu_affinity as configured
+    std::vector<int> loop_cpus;
+
+    // Applied to every received byte range; nullptr selects the fastest
+    // uppercase kernel for the running CPU
+    PayloadTransform transform = nullptr;
+
+    // Set on every listener and inherited by accepted connections (see
+    // SocketOptions::lowLatency / highThroughput for presets)
+    SocketOptions socket_options;
+
+    // Connections a loop accepts per listener wakeup before it yields to its
+    // existing clients; the rest are picked up on the next loop iteration
+    size_t accept_budget = 64;
+
+    // Bytes a loop reads from one client per wakeup. A client that still has
+    // data goes on the Reactor's ready queue and is read again after the
+    // other ready clients, so a bulk sender cannot hold up the rest of the
+    // loop (0 = read until EAGAIN).
+    size_t read_budget_bytes = 16 * 1024;
+
+    // Token-bucket traffic shaping, off by default. Every connection gets its
+    // own client_* buckets for the bytes it sends and is sent; every loop's
+    // listener (with any sockets it inherited) gets listener_* buckets that
+    // its connections share, plus one for the connections it accepts, so
+    // with several loops the server as a whole allows num_loops times the
+    // listener rates. A client out of read tokens has EPOLLIN dropped, one
+    // out of write tokens stops sending (the output watermark then stops its
+    // reads as well), and a listener out of connection tokens leaves new
+    // connections in the kernel's accept queue; a timer set for the moment
+    // the bucket refills resumes them.
+    RateLimit client_read_bytes;
+    RateLimit client_write_bytes;
+    RateLimit listener_read_bytes;
+    RateLimit listener_write_bytes;
+    RateLimit listener_accepts;
+
+    // Open client connections across all loops; once reached, new
+    // connections are accepted and closed immediately (0 = unlimited)
+    size_t max_connections = 0;
+
+    // Flushes of at least this many buffered bytes use MSG_ZEROCOPY; smaller
+    // ones keep the copying writev (0 = never). Enabling it sets SO_ZEROCOPY
+    // on the listeners. Zero-copy pays off for large sends on real NICs;
+    // over loopback the kernel copies anyway.
+    size_t zerocopy_threshold = 0;
+
+    // Output bytes queued across every connection of every loop. Once
+    // reached, loops stop reading from clients until the total drains below
+    // three quarters of it, on top of each connection's own 64KB/32KB
+    // watermarks (0 = unlimited).
+    size_t max_buffered_bytes = 0;
+
+    // Free 16KB write-buffer chunks each loop keeps for reuse; chunks released
+    // beyond this go back to the allocator
+    size_t pooled_chunks = 256;
+
+    // Message boundaries in the stream. With Line or LengthPrefix, every
+    // complete frame of a read batch is decoded in place, in one pass, and its
+    // reply framed the same way; the whole batch goes out in one write.
+    Framing framing = Framing::None;
+
+    // Larger frames (or longer lines) close the connection
+    size_t max_frame_size = 64 * 1024;
+
+    // Runs request_handler on this many worker threads instead of on the
+    // loops, so a slow request never delays other connections (0 = inline).
+    // A connection has at most one request with the workers; whatever
+    // arrives meanwhile becomes its next request.
+    size_t worker_threads = 0;
+
+    // Called concurrently from worker threads for different connections;
+    // empty applies the payload transform
+    RequestHandler request_handler;
+
+    // Also answer UDP datagrams on this port, from every loop's Reactor
+    // (-1 = off, 0 = kernel-chosen). With several loops each gets its own
+    // SO_REUSEPORT socket. The payload transform applies here as well.
+    int udp_port = -1;
+    UDPServerOptions udp;
+
+    // Hot restart through this Unix socket path (empty = off). A new server
+    // first asks the one listening here for its listening sockets, so the
+    // port never stops accepting, then listens here for its own successor.
+    // The old server stops accepting, passes its idle connections along too
+    // if handoff_clients is set, and serves the rest until they close or
+    // drain_timeout_ms passes; then start() returns. UDP sockets and the
+    // admin port are not handed over. Only a successor running as
+    // handoff_uid is served ((uid_t)-1 = this server's effective uid).
+    std::string handoff_path;
+    bool handoff_clients = false;
+    uint64_t drain_timeout_ms = 30000;
+    uid_t handoff_uid = static_cast<uid_t>(-1);
+
+    // Serve files from this directory (empty = off): a frame "GET <path>" is
+    // answered with a frame holding that file, sent from the page cache with
+    // sendfile instead of through the write buffer, or an "ERR <reason>"
+    // frame. Needs Framing::LengthPrefix and no worker_threads. Each loop
+    // keeps up to file_cache_entries files open and re-stats a cached one at
+    // most every file_revalidate_ms.
+    std::string static_root;
+    size_t file_cache_entries = 1024;
+    uint64_t file_revalidate_ms = 1000;
+
+    // Terminate TLS on every connection when tls.cert_file is set. The
+    // handshake runs on the loops; afterwards the kernel encrypts where it
+    // can (kTLS), otherwise OpenSSL does. TLS connections are never handed
+    // off and never use zero-copy sends. Needs a build with ENABLE_TLS.
+    TlsOptions tls;
+
+    // Connection timeouts in milliseconds, 0 disables each of them
+    uint64_t idle_timeout_ms = 0;        // No bytes moved in either direction
+    uint64_t read_timeout_ms = 0;        // Nothing received from the client
+    uint64_t write_stall_timeout_ms = 0; // Output queued but the client is not draining it
+
+    // Flight recorder: every loop keeps its last trace_events events (poller
+    // waits and wakeups, handler runs with fd and event mask, read pauses
+    // and resumes, accepts and closes) in a fixed ring, 16 bytes each
+    // (0 = off). Writing to getTraceFd() dumps all of them as Chrome trace
+    // JSON to trace_path, /tmp/tcp_server_trace_<pid>.json when empty.
+    size_t trace_events = 16384;
+    std::string trace_path;
+
+    // Serve Prometheus metrics at GET /metrics on this port from the primary
+    // loop (-1 = off, 0 = kernel-chosen). Enabling it also turns on the
+    // per-wakeup and per-handler timing in every loop's Reactor.
+    int admin_port = -1;
 };
 
 class TCPServer {
-    Socket m_listen_socket;
-    Reactor m_reactor;
-    std::unordered_map<int, ClientState> m_clients;
+    // Everything a single event-loop thread touches. Loops never share state,
+    // the kernel spreads incoming connections across their listeners.
+    struct EventLoop {
+        EventLoop(const ReactorOptions& options, size_t pooled_chunks)
+            : reactor(options), chunk_pool(pooled_chunks, &metrics.buffer_chunks, &metrics.pooled_chunks) {}
+
+        LoopMetrics metrics;            // First in, last out: the pool reports into it
+        std::unique_ptr<FlightRecorder> recorder;   // nullptr without trace_events
+        Socket listen_socket{-1};      // Created per the endpoint's family
+        std::vector<Socket> extra_listeners;    // Inherited beyond one per loop
+        Reactor reactor;
+        std::unique_ptr<UDPServer> udp; // Destroyed before the Reactor it is registered with
+        std::unique_ptr<FileCache> files;   // nullptr without static_root
+        WriteBuffer::Pool chunk_pool;   // Outlives every client's WriteBuffer
+        Slab<ClientState> clients;      // Connection churn reuses slots, no allocation
+        Slab<ZeroCopyLinger> lingering; // Closed clients the kernel may still send from
+        std::vector<ClientHandle> client_fds;   // Indexed by fd, like the Reactor's handler table
+        std::vector<ClientHandle> budget_parked; // Clients waiting for the buffer budget
+        std::vector<ClientHandle> read_buffers; // Framed clients holding receive memory
+        Reactor::TimerId read_buffer_timer = TimerWheel::INVALID_TIMER;
+        Reactor::TimerId budget_timer = TimerWheel::INVALID_TIMER;
+        TokenBucket read_tokens;        // ServerConfig::listener_* limits
+        TokenBucket write_tokens;
+        TokenBucket accept_tokens;
+        std::vector<int> accept_throttled;  // Listeners waiting for accept_timer
+        Reactor::TimerId accept_timer = TimerWheel::INVALID_TIMER;
+        bool draining = false;          // Handed off; stops once its clients are gone
+        bool drained = false;           // ... and they are
+        bool exited = false;            // run() returned, its ring is frozen (m_traceMutex)
+
+        void trace(TraceEvent type, int fd) {
+            if (recorder) recorder->record(type, fd);
+        }
+    };
+
+    ServerConfig m_config;
+    Endpoint m_endpoint;                        // As bound, so port 0 is resolved
+    bool m_ownsPath = false;                    // Unix socket file to remove on destruction
+    std::vector<std::unique_ptr<EventLoop>> m_loops;
+    std::unique_ptr<AdminListener> m_admin;     // Declared after m_loops, destroyed before them
+    std::unique_ptr<WorkerPool> m_workers;      // Likewise, so no job outlives the loop it posts to
+    std::unique_ptr<HandoffListener> m_handoff; // Likewise; nullptr without handoff_path
+    PayloadTransform m_transform;
+    std::unique_ptr<Framer> m_framer;           // nullptr without framing
+    std::unique_ptr<TlsContext> m_tls;          // nullptr without ServerConfig::tls
+    struct TraceDump;
+    int m_traceFd = -1;                         // eventfd that requests a trace dump
+    std::mutex m_traceMutex;                    // Guards the two below and EventLoop::exited
+    std::shared_ptr<TraceDump> m_traceDump;     // Rings still being copied; nullptr otherwise
+    std::thread m_traceWriter;                  // Formats and writes the last dump, off the loops
+    std::atomic<bool> m_traceWriting{false};   // From the request until the file is written
+    std::atomic<size_t> m_connectionCount{0};  // Shared by every loop for max_connections
+    std::atomic<int64_t> m_bufferedBytes{0};   // Shared by every loop for max_buffered_bytes
+    std::atomic<bool> m_handedOff{false};      // A successor took the listeners; loops drain
+    std::atomic<size_t> m_loopsDraining{0};    // Loops still serving after a handoff
+    static constexpr size_t READ_CHUNK_SIZE = 4096;
     static constexpr size_t MAX_WRITE_BUFFER_SIZE = 64 * 1024; // 64KB threshold
     static constexpr size_t RESUME_WRITE_BUFFER_SIZE = 32 * 1024; // Resume at 32KB
+    static constexpr uint64_t BUDGET_RECHECK_MS = 1; // Parked loops poll the budget this often
+    static constexpr uint64_t READ_BUFFER_IDLE_MS = 1000; // Framed clients keep receive memory this long between reads
+    static constexpr size_t FILE_SEND_BUDGET = 4 * 1024 * 1024; // File bytes per wakeup before yielding
+    static constexpr size_t TLS_FILE_CHUNK = 64 * 1024; // Mapped bytes per SSL_write
 public:
-    TCPServer(int port);
+    // Any IPv4 address on port (0 = kernel-chosen)
+    TCPServer(int port, const ServerConfig& config = ServerConfig{});
+
+    // IPv4, IPv6 or Unix-domain listener. Unix loops share one socket, since
+    // SO_REUSEPORT is inet-only. A stale socket file at a Unix path is
+    // replaced, a live one is not.
+    TCPServer(const Endpoint& endpoint, const ServerConfig& config = ServerConfig{});
 
+    TCPServer(const TCPServer&) = delete;
+
+    TCPServer& operator=(const TCPServer&) = delete;
+
+    // Removes the Unix socket file unless a successor has taken it over
+    ~TCPServer();
+
+    // Runs the primary loop on the calling thread and every other loop on its
+    // own thread. Returns once the shutdown fd is signalled and all loops exit.
     void start();
 
-    int getPort() const;
-    int getShutdownFd() const { return m_reactor.getShutdownFd(); }
+    int getPort() const;  // 0 for Unix-domain listeners
+    const Endpoint& getEndpoint() const { return m_endpoint; }
+    size_t getLoopCount() const { return m_loops.size(); }
+    PayloadTransform getTransform() const { return m_transform; }
+    ReactorBackend getBackend() const { return m_loops.front()->reactor.backend(); }
+    int getShutdownFd() const { return m_loops.front()->reactor.getShutdownFd(); }
+    size_t getConnectionCount() const { return m_connectionCount.load(std::memory_order_relaxed); }
+    int64_t getBufferedBytes() const { return m_bufferedBytes.load(std::memory_order_relaxed); }
+    int getAdminPort() const { return m_admin ? m_admin->getPort() : -1; }
+    bool handedOff() const { return m_handedOff.load(std::memory_order_relaxed); }
+    // Writing any value here (async-signal-safe, like the shutdown fd) makes
+    // the server dump its flight recorders; -1 without trace_events
+    int getTraceFd() const { return m_traceFd; }
+    const std::string& getTracePath() const { return m_config.trace_path; }
+    int getUdpPort() const { return m_loops.front()->udp ? m_loops.front()->udp->getPort() : -1; }
+    const LoopMetrics& getMetrics(size_t loop) const { return m_loops.at(loop)->metrics; }
+
+    // Prometheus text exposition of every loop's metrics
+    void renderMetrics(std::string& out) const;
 private:
-    void handleNewConnection(int fd);
-    void handleClientData(int fd);
-    void handleClientWrite(int fd);
-    void cleanupClient(int fd);
-};
\ No newline at end of file
+    Socket openListener(bool reuse_port, bool& busy_poll);
+    void registerListener(EventLoop& loop, int fd);
+    void handleNewConnection(EventLoop& loop, int fd);
+    bool admitConnection(EventLoop& loop, int client_fd);
+    void addClient(EventLoop& loop, int client_fd);
+    ClientState* findClient(EventLoop& loop, int fd);
+    void continueHandshake(EventLoop& loop, int fd, ClientState& state, uint32_t events);
+    ssize_t readClient(ClientState& state, int fd, char* data, size_t len);
+    ssize_t writeClient(ClientState& state, int fd, bool zerocopy, size_t limit);
+    void handleClientData(EventLoop& loop, int fd);
+    void handleClientWrite(EventLoop& loop, int fd);
+    void readFrames(EventLoop& loop, int fd, ClientState& state, size_t budget);
+    bool processFrames(EventLoop& loop, int fd, ClientState& state);
+    void keepReadBuffer(EventLoop& loop, ClientState& state);
+    void releaseIdleReadBuffers(EventLoop& loop);
+    bool queueFile(EventLoop& loop, ClientState& state, std::string_view path);
+    bool sendFile(EventLoop& loop, int fd, ClientState& state);
+    void readRequests(EventLoop& loop, int fd, ClientState& state, size_t budget);
+    size_t completeRequestBytes(std::string_view data) const;
+    bool dispatchRequest(EventLoop& loop, int fd, ClientState& state);
+    void handleRequest(std::string& request) const;
+    void completeRequest(EventLoop& loop, ClientHandle handle, std::string& reply, bool failed);
+    void cleanupClient(EventLoop& loop, int fd);
+    bool reapZeroCopy(EventLoop& loop, int fd, ClientState& state);
+    void lingerZeroCopy(EventLoop& loop, ClientState& state);
+    void reapLingering(EventLoop& loop, SlabHandle handle);
+    void armTimeout(EventLoop& loop, ClientHandle handle, Reactor::TimerId& timer, uint64_t timeout_ms,
+                    const char* reason);
+    void trackWriteProgress(EventLoop& loop, ClientState& state, bool progressed);
+    void handleTimeout(EventLoop& loop, ClientHandle handle, const char* reason);
+    void setReadsPaused(EventLoop& loop, ClientState& state, bool paused);
+    void resumeReads(EventLoop& loop, int fd, ClientState& state, uint32_t also);
+    bool setInterest(EventLoop& loop, int fd, ClientState& state, uint32_t events);
+    void yieldReads(EventLoop& loop, int fd, ClientState& state);
+    size_t readBudget() const;
+    size_t readAllowance(EventLoop& loop, ClientState& state);
+    size_t writeAllowance(EventLoop& loop, ClientState& state);
+    void chargeReads(EventLoop& loop, ClientState& state, size_t bytes);
+    void chargeWrites(EventLoop& loop, ClientState& state, size_t bytes);
+    void throttleReads(EventLoop& loop, int fd, ClientState& state);
+    void throttleWrites(EventLoop& loop, int fd, ClientState& state);
+    void throttleAccepts(EventLoop& loop, int fd);
+    void accountBuffered(EventLoop& loop, int64_t delta);
+    bool overBudget() const;
+    void parkForBudget(EventLoop& loop, int fd, ClientState& state);
+    void releaseParked(EventLoop& loop);
+    void signalLoops(size_t first);
+    void handOff(Socket& channel);
+    void handOffLoop(EventLoop& loop, int channel);
+    void stopLoop(EventLoop& loop);
+    void dumpTrace();
+    void snapshotTrace(const std::shared_ptr<TraceDump>& dump, size_t index);
+    void loopExited(size_t index);
+    static void writeTrace(const std::string& path, const std::vector<TraceSnapshot>& loops);
+};
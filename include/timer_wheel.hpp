@@ -0,0 +1,85 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include "delegate.hpp"
+
+// Hierarchical timing wheel with 1ms ticks: 4 levels of 64 slots cover
+// ~4.6 hours, anything further out parks on an overflow list that is
+// re-examined when the top level wraps. Add, cancel and reset are O(1).
+// Timer nodes live in fixed-size blocks linked into intrusive lists and are
+// recycled through a free list, so arming and resetting never allocate once
+// the pool has grown to the working set.
+class TimerWheel {
+public:
+    using TimerId = uint64_t;   // {generation, index}; 0 is never a valid id
+    using Callback = Delegate<void()>;
+
+    static constexpr TimerId INVALID_TIMER = 0;
+
+    explicit TimerWheel(uint64_t now_ms);
+
+    TimerWheel(const TimerWheel&) = delete;
+
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    TimerId add(uint64_t expires_at_ms, Callback callback);
+
+    // Both return false for stale or unknown ids, so callers can cancel freely
+    bool cancel(TimerId id);
+
+    bool reset(TimerId id, uint64_t expires_at_ms);
+
+    // Fires every timer that expired at or before now_ms
+    void advance(uint64_t now_ms);
+
+    // Milliseconds until the next timer may fire, -1 when nothing is armed
+    int nextTimeout(uint64_t now_ms) const;
+
+    // Pre-grows the node pool so the first `count` timers do not allocate
+    void reserve(size_t count);
+
+    size_t size() const { return m_armed; }
+
+private:
+    static constexpr int LEVELS = 4;
+    static constexpr int SLOT_BITS = 6;
+    static constexpr uint32_t SLOTS = 1u << SLOT_BITS;
+    static constexpr uint32_t SLOT_MASK = SLOTS - 1;
+    static constexpr uint32_t OVERFLOW_LIST = LEVELS * SLOTS;
+    static constexpr uint32_t BLOCK_SIZE = 1024;
+    static constexpr uint32_t NIL = UINT32_MAX;
+
+    enum class State : uint8_t { Free, Armed, Firing };
+
+    struct Node {
+        uint64_t expires = 0;
+        uint32_t prev = NIL;
+        uint32_t next = NIL;
+        uint32_t list = NIL;        // Slot list the node is linked into
+        uint32_t generation = 1;
+        State state = State::Free;
+        Callback callback;
+    };
+
+    Node& node(uint32_t index) { return m_blocks[index / BLOCK_SIZE][index % BLOCK_SIZE]; }
+    const Node& node(uint32_t index) const { return m_blocks[index / BLOCK_SIZE][index % BLOCK_SIZE]; }
+
+    Node* lookup(TimerId id);
+    uint32_t allocateNode();
+    void freeNode(uint32_t index);
+    void link(uint32_t index);
+    void unlink(uint32_t index);
+    uint64_t nextEventTick() const;
+    void cascade(uint32_t list);
+    void fire(uint32_t list);
+
+    std::vector<std::unique_ptr<Node[]>> m_blocks;  // Never moved, nodes stay put
+    std::vector<uint32_t> m_heads;                  // LEVELS * SLOTS + overflow
+    uint64_t m_occupied[LEVELS] = {};               // Non-empty slot bitmap per level
+    uint32_t m_freeHead = NIL;
+    uint32_t m_capacity = 0;
+    uint64_t m_current;                             // Last processed tick
+    size_t m_armed = 0;
+};
@@ -0,0 +1,92 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <sys/types.h>
+
+// TLS termination for TCPServer. OpenSSL runs the handshake on the
+// non-blocking socket; once keys are agreed it hands record encryption to
+// kernel TLS (TCP_ULP "tls") where the kernel offers it, so steady-state
+// reads and writes on that socket are the plain syscalls a cleartext
+// connection makes. Without kTLS, records are encrypted in userspace.
+//
+// Built for real with -DENABLE_TLS=ON (needs OpenSSL 3); otherwise
+// TlsContext throws and no session can exist.
+
+struct ssl_ctx_st;
+struct ssl_st;
+
+struct TlsOptions {
+    // PEM certificate chain and private key; an empty cert_file keeps the
+    // server cleartext
+    std::string cert_file;
+    std::string key_file;
+
+    // Hand record encryption to the kernel when it supports the cipher
+    bool ktls = true;
+};
+
+enum class TlsStatus {
+    Done,       // Handshake finished, application data can flow
+    WantRead,   // Call again once the socket is readable
+    WantWrite,  // ... or writable
+    Failed      // Peer misbehaved or went away; close the connection
+};
+
+class TlsContext {
+public:
+    // Loads the certificate and key; throws std::runtime_error
+    explicit TlsContext(const TlsOptions& options);
+
+    TlsContext(const TlsContext&) = delete;
+
+    TlsContext& operator=(const TlsContext&) = delete;
+
+    ~TlsContext();
+
+    // Whether this build has TLS support at all
+    static bool available();
+
+private:
+    friend class TlsSession;
+
+    ssl_ctx_st* m_ctx = nullptr;
+};
+
+// Server side of one connection. Does not own the fd. read() and write()
+// follow the read(2)/write(2) contract: bytes moved, 0 at end of stream, or
+// -1 with errno EAGAIN when the socket would block (EIO on a TLS error).
+class TlsSession {
+public:
+    TlsSession(TlsContext& context, int fd);
+
+    TlsSession(const TlsSession&) = delete;
+
+    TlsSession& operator=(const TlsSession&) = delete;
+
+    ~TlsSession();
+
+    TlsStatus handshake();
+
+    bool established() const { return m_established; }
+
+    // Once established: whether the kernel encrypts outgoing or decrypts
+    // incoming records, so the fd can be written or read directly
+    bool kernelSend() const { return m_kernelSend; }
+    bool kernelRecv() const { return m_kernelRecv; }
+
+    ssize_t read(char* data, size_t len);
+    ssize_t write(const char* data, size_t len);
+
+    // Plaintext OpenSSL has already decrypted but read() has not returned
+    // yet; epoll cannot report it
+    size_t pending() const;
+
+    // Best-effort close_notify; never blocks
+    void shutdown();
+
+private:
+    ssl_st* m_ssl = nullptr;
+    bool m_established = false;
+    bool m_kernelSend = false;
+    bool m_kernelRecv = false;
+};
@@ -0,0 +1,77 @@
+#pragma once
+#include <cstdint>
+
+// A sustained rate in tokens per second (bytes, or connections) and how many
+// tokens may be banked while idle and spent at once
+struct RateLimit {
+    uint64_t rate = 0;      // 0 = unlimited
+    uint64_t burst = 0;     // 0 = one second's worth
+};
+
+// Token bucket on the loop's millisecond clock. Levels are kept in
+// thousandths of a token, so a millisecond of refill at `rate` per second is
+// exactly `rate` thousandths: no division and no drift. consume() may
+// overdraw, since a read takes whatever the socket had; the debt is paid
+// back before anything is available again, so the long-run rate holds.
+// Unlimited buckets cost one compare. Single-threaded.
+class TokenBucket {
+public:
+    TokenBucket() = default;    // Unlimited
+
+    // Starts full
+    TokenBucket(const RateLimit& limit, uint64_t now_ms)
+        : m_rate(limit.rate),
+          m_capacity(static_cast<int64_t>(limit.burst != 0 ? limit.burst : limit.rate) * SCALE),
+          m_level(m_capacity),
+          m_lastMs(now_ms) {}
+
+    bool limited() const { return m_rate != 0; }
+
+    // Whole tokens available at now_ms: 0 while in debt, UINT64_MAX when
+    // unlimited
+    uint64_t available(uint64_t now_ms) {
+        if (m_rate == 0) {
+            return UINT64_MAX;
+        }
+        refill(now_ms);
+        return m_level > 0 ? static_cast<uint64_t>(m_level / SCALE) : 0;
+    }
+
+    void consume(uint64_t tokens) {
+        if (m_rate != 0) {
+            m_level -= static_cast<int64_t>(tokens) * SCALE;
+        }
+    }
+
+    // Milliseconds until a token is available, as of the last available()
+    uint64_t delayMs() const {
+        if (m_rate == 0 || m_level >= SCALE) {
+            return 0;
+        }
+        const uint64_t missing = static_cast<uint64_t>(SCALE - m_level);
+        return (missing + m_rate - 1) / m_rate;
+    }
+
+private:
+    static constexpr int64_t SCALE = 1000;
+
+    void refill(uint64_t now_ms) {
+        if (now_ms <= m_lastMs) {
+            return;
+        }
+        const uint64_t elapsed = now_ms - m_lastMs;
+        m_lastMs = now_ms;
+        const uint64_t room = static_cast<uint64_t>(m_capacity - m_level);
+        // Compared before multiplying, so a long idle spell cannot overflow
+        if (elapsed > room / m_rate) {
+            m_level = m_capacity;
+        } else {
+            m_level += static_cast<int64_t>(elapsed * m_rate);
+        }
+    }
+
+    uint64_t m_rate = 0;        // Tokens per second = thousandths per millisecond
+    int64_t m_capacity = 0;     // In thousandths
+    int64_t m_level = 0;        // In thousandths, negative while in debt
+    uint64_t m_lastMs = 0;
+};
@@ -0,0 +1,19 @@
+#pragma once
+#include <cstddef>
+
+// Payload transform stage applied to every received byte range before it is
+// queued for writing. Kernels write len bytes to out; out may equal in, so
+// the server transforms in place inside pre-reserved write buffer space.
+using PayloadTransform = void (*)(const char* in, char* out, size_t len);
+
+// ASCII uppercase kernels, identical to std::toupper in the "C" locale
+void uppercaseScalar(const char* in, char* out, size_t len);
+
+void uppercaseSse2(const char* in, char* out, size_t len);
+
+void uppercaseAvx2(const char* in, char* out, size_t len);
+
+// Fastest uppercase kernel the running CPU supports, resolved once
+PayloadTransform selectUppercaseKernel();
+
+const char* uppercaseKernelName(PayloadTransform kernel);
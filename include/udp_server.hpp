@@ -0,0 +1,97 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "reactor.hpp"
+#include "socket.hpp"
+#include "transform.hpp"
+#include "metrics.hpp"
+
+struct UDPServerOptions {
+    // Datagrams moved per recvmmsg/sendmmsg call; that many receive slots
+    // are allocated up front and reused for every batch
+    size_t batch_size = 32;
+
+    // Batches per readiness event before the loop's other handlers get a
+    // turn; the rest is read from the Reactor's ready queue, so a datagram
+    // flood cannot starve TCP clients on the same loop (0 = until drained)
+    size_t batches_per_wakeup = 8;
+
+    // Receive slot size without GRO; larger datagrams are truncated by the
+    // kernel and dropped
+    size_t max_datagram = 2048;
+
+    // Where the kernel has them: UDP_GRO hands a run of same-sized datagrams
+    // from one sender over as a single buffer, and UDP_SEGMENT sends its
+    // reply back as one buffer that the kernel splits again. GRO is only
+    // enabled together with GSO, and raises every slot to 64KB.
+    bool gro = true;
+    bool gso = true;
+
+    // SO_REUSEPORT, so one socket per loop can share the port
+    bool reuse_port = false;
+
+    // Only send_buffer/recv_buffer and busy_poll_us apply to datagrams
+    SocketOptions socket_options;
+
+    // Applied to every datagram in place; nullptr selects the fastest
+    // uppercase kernel for the running CPU
+    PayloadTransform transform = nullptr;
+};
+
+// Datagram echo server driven by an existing Reactor: every datagram is
+// transformed and sent back to its sender. Each readiness event reads the
+// socket in batches of recvmmsg, answers the whole batch with one sendmmsg
+// straight from the receive slots, and never allocates. Must be created,
+// used and destroyed on the reactor's thread.
+class UDPServer {
+public:
+    // metrics (may be nullptr) receives the datagram counters
+    UDPServer(Reactor& reactor, int port, const UDPServerOptions& options = UDPServerOptions{},
+              LoopMetrics* metrics = nullptr);
+
+    UDPServer(const UDPServer&) = delete;
+
+    UDPServer& operator=(const UDPServer&) = delete;
+
+    ~UDPServer();
+
+    int getPort() const { return m_socket.getPort(); }
+    int getFd() const { return m_socket.getFd(); }
+
+    // Whether the kernel accepted UDP_GRO / UDP_SEGMENT for this socket
+    bool groEnabled() const { return m_gro; }
+    bool gsoEnabled() const { return m_gso; }
+
+private:
+    // Preallocated per-datagram state. Replies reuse the receive slot's
+    // address and payload, so only their own headers and cmsg are separate.
+    struct Slot {
+        sockaddr_storage peer;
+        iovec rx_iov;
+        iovec tx_iov;
+        alignas(cmsghdr) char rx_control[CMSG_SPACE(sizeof(int))];
+        alignas(cmsghdr) char tx_control[CMSG_SPACE(sizeof(uint16_t))];
+    };
+
+    void enableOffloads(bool gro);
+    void handleReadable();
+    void sendBatch(size_t count);
+
+    Reactor& m_reactor;
+    Socket m_socket;
+    PayloadTransform m_transform;
+    LoopMetrics* m_metrics;
+    size_t m_slotSize;
+    size_t m_batchesPerWakeup;
+    bool m_gro = false;
+    bool m_gso = false;
+    std::unique_ptr<char[]> m_arena;   // batch_size * m_slotSize payload bytes
+    std::vector<Slot> m_slots;
+    std::vector<mmsghdr> m_rx;
+    std::vector<mmsghdr> m_tx;
+    std::vector<uint32_t> m_txDatagrams;  // Datagrams each queued reply carries (several with GSO)
+};
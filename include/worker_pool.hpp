@@ -0,0 +1,44 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "delegate.hpp"
+
+// Fixed set of threads for work too slow to run on an event loop. Jobs run
+// in submission order on whichever worker is free; a job hands its result
+// back to the owning loop with Reactor::post(). Idle workers sleep on a
+// condition variable, so the queue is a plain mutex-guarded deque: a job is a
+// whole request, far coarser than the per-event paths kept lock-free.
+class WorkerPool {
+public:
+    using Job = Delegate<void(), 64>;
+
+    explicit WorkerPool(size_t threads);
+
+    WorkerPool(const WorkerPool&) = delete;
+
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    // Waits for running jobs to finish; jobs still queued are dropped
+    ~WorkerPool();
+
+    // Safe from any thread
+    void submit(Job job);
+
+    size_t size() const { return m_threads.size(); }
+
+    // Jobs queued but not yet picked up by a worker
+    size_t pending() const;
+
+private:
+    void workerLoop(size_t index);
+
+    mutable std::mutex m_mutex;     // Guards m_jobs and m_stopping
+    std::condition_variable m_ready;
+    std::deque<Job> m_jobs;
+    bool m_stopping = false;
+    std::vector<std::thread> m_threads;
+};
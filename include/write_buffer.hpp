@@ -0,0 +1,151 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <sys/types.h>
+#include "metrics.hpp"
+
+// Output queue made of fixed-size chunks. Appends fill the tail chunk,
+// partial writes only advance the head cursor, so flushing never memmoves
+// the remaining backlog the way std::vector::erase does. Chunks exist only
+// while bytes are queued: an empty buffer holds no payload memory at all.
+class WriteBuffer {
+public:
+    static constexpr size_t CHUNK_SIZE = 16 * 1024;
+    static constexpr int MAX_IOVECS = 64; // Chunks handed to a single writev
+
+    class Pool;
+
+    // Chunks come from and go back to `pool` when given, otherwise straight
+    // from the allocator. The pool must outlive the buffer.
+    explicit WriteBuffer(Pool* pool = nullptr) : m_pool(pool) {}
+
+    WriteBuffer(const WriteBuffer&) = delete;
+
+    WriteBuffer& operator=(const WriteBuffer&) = delete;
+
+    WriteBuffer(WriteBuffer&&) noexcept = default;
+
+    WriteBuffer& operator=(WriteBuffer&&) noexcept = default;
+
+    void append(const char* data, size_t len);
+
+    // Contiguous writable space at the tail, len is clamped to what the tail
+    // chunk can take (a fresh chunk is started when it is full). Producers
+    // fill it in place and then commit() the bytes they actually wrote.
+    char* prepare(size_t& len);
+
+    void commit(size_t len);
+
+    // Drops len bytes from the front of the buffer
+    void consume(size_t len);
+
+    // Queued bytes of the first chunk, for writers that take one contiguous
+    // range at a time (userspace TLS); empty when nothing is queued
+    std::string_view front() const;
+
+    // One writev() over the queued chunks, at most limit bytes; written
+    // bytes are consumed. Returns what writev returned, errno is left
+    // untouched on failure.
+    ssize_t writeTo(int fd, size_t limit = SIZE_MAX);
+
+    // Like writeTo() but with sendmsg(MSG_ZEROCOPY); fd needs SO_ZEROCOPY.
+    // The kernel reads the sent bytes straight from the chunks, so chunks it
+    // has not yet confirmed are parked instead of being reused or freed.
+    // Falls back to a copying writev when the kernel is out of notification
+    // memory (ENOBUFS).
+    ssize_t writeZeroCopy(int fd, size_t limit = SIZE_MAX);
+
+    // Drains fd's error queue and releases every chunk the kernel is done
+    // with. Returns the number of completion notifications read, or -1 if the
+    // queue held a real socket error. `copied` counts zero-copy sends the
+    // kernel ended up copying anyway (always the case over loopback).
+    int reapZeroCopy(int fd, size_t& copied);
+
+    // Chunks still waiting for a zero-copy completion
+    size_t zeroCopyPending() const;
+
+    // Drops every queued byte and gives up on the pending completions: the
+    // chunks they pin are leaked, never freed or pooled, since the kernel may
+    // still read them. Only for a socket that is closing before it has
+    // confirmed its sends.
+    void abandonZeroCopy();
+
+    void clear();
+
+    size_t size() const { return m_size; }
+
+    bool empty() const { return m_size == 0; }
+
+    size_t chunkCount() const { return m_chunks.size(); }
+
+private:
+    struct Chunk {
+        size_t begin = 0;   // First unsent byte
+        size_t end = 0;     // One past the last queued byte
+        uint32_t zc_seq = 0;        // Last zero-copy send that read from this chunk
+        bool zc_pinned = false;     // Set once any zero-copy send used it
+        char data[CHUNK_SIZE];
+    };
+
+    // Hands a chunk back to the pool it came from (or frees it)
+    struct ChunkDeleter {
+        Pool* pool = nullptr;
+        void operator()(Chunk* chunk) const;
+    };
+    using ChunkPtr = std::unique_ptr<Chunk, ChunkDeleter>;
+
+    ChunkPtr allocateChunk();
+    void releaseChunk(ChunkPtr chunk);
+    bool isPinned(const Chunk& chunk) const;
+    void completeZeroCopy(uint32_t first, uint32_t last);
+
+    // Vectors rather than deques: an empty std::deque still allocates its
+    // map and first node, which adds up over 100k idle connections
+    Pool* m_pool = nullptr;
+    std::vector<ChunkPtr> m_chunks;
+    size_t m_size = 0;
+
+    // Zero-copy bookkeeping. Sends are numbered per socket from 0 by the
+    // kernel; every send before m_zcDone is confirmed, confirmations that
+    // arrive out of order wait in m_zcEarly until the gap closes.
+    std::vector<ChunkPtr> m_zcRetired;  // Fully sent, not yet confirmed, oldest first
+    std::vector<std::pair<uint32_t, uint32_t>> m_zcEarly;
+    uint32_t m_zcNext = 0;
+    uint32_t m_zcDone = 0;
+};
+
+// Free list of chunks shared by every WriteBuffer on one event loop, so
+// memory follows the bytes actually queued instead of each connection's
+// high-water mark. Up to max_cached released chunks are kept for reuse, the
+// rest go back to the allocator. Single-threaded like the loop that owns it.
+class WriteBuffer::Pool {
+public:
+    // The gauges, when given, track chunks held by buffers and chunks cached
+    explicit Pool(size_t max_cached = 256, Gauge* in_use = nullptr, Gauge* cached = nullptr);
+
+    Pool(const Pool&) = delete;
+
+    Pool& operator=(const Pool&) = delete;
+
+    ~Pool();
+
+    size_t inUse() const { return m_inUse; }
+
+    size_t cached() const { return m_free.size(); }
+
+private:
+    friend class WriteBuffer;
+
+    Chunk* acquire();
+    void release(Chunk* chunk);
+
+    std::vector<Chunk*> m_free;
+    size_t m_maxCached;
+    size_t m_inUse = 0;
+    Gauge* m_inUseGauge;
+    Gauge* m_cachedGauge;
+};
@@ -0,0 +1,133 @@
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+#include "admin_listener.hpp"
+#include "logger.hpp"
+
+AdminListener::AdminListener(Reactor& reactor, int port, Renderer render)
+    : m_reactor(reactor), m_render(std::move(render)) {
+    m_socket.setReuseAddr();
+    m_socket.setNonBlocking();
+    m_socket.bind(port);
+    m_socket.listen();
+    m_reactor.registerHandler(m_socket.getFd(), EPOLLIN | EPOLLET, [this](int, uint32_t) {
+        handleAccept();
+    });
+}
+
+AdminListener::~AdminListener() {
+    for (auto& entry : m_connections) {
+        m_reactor.unregisterHandler(entry.first);
+    }
+    m_reactor.unregisterHandler(m_socket.getFd());
+}
+
+void AdminListener::handleAccept() {
+    while (true) {
+        int fd = accept4(m_socket.getFd(), nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                LOG_WARN("Admin listener failed to accept: {}", LogErrno{errno});
+            }
+            return;
+        }
+        m_connections[fd] = std::make_unique<Connection>(fd);
+        m_reactor.registerHandler(fd, EPOLLIN | EPOLLET, [this](int cfd, uint32_t events) {
+            handleConnection(cfd, events);
+        });
+    }
+}
+
+void AdminListener::handleConnection(int fd, uint32_t events) {
+    auto it = m_connections.find(fd);
+    if (it == m_connections.end()) return;
+    Connection& conn = *it->second;
+
+    if (events & (EPOLLHUP | EPOLLERR)) {
+        closeConnection(fd);
+        return;
+    }
+
+    if (!conn.response.empty()) {
+        // Reply already built; only here because the socket was full
+        if (flush(conn)) {
+            closeConnection(fd);
+        }
+        return;
+    }
+
+    char buffer[1024];
+    bool eof = false;
+    while (true) {
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n > 0) {
+            conn.request.append(buffer, static_cast<size_t>(n));
+            if (conn.request.size() > MAX_REQUEST_SIZE) {
+                closeConnection(fd);
+                return;
+            }
+            continue;
+        }
+        if (n == 0) {
+            eof = true;
+        } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            closeConnection(fd);
+            return;
+        }
+        break;
+    }
+
+    bool complete = conn.request.find("\r\n\r\n") != std::string::npos ||
+                    conn.request.find("\n\n") != std::string::npos;
+    if (!complete) {
+        if (eof) {
+            closeConnection(fd);
+        }
+        return; // Headers still arriving
+    }
+    respond(conn);
+    if (flush(conn)) {
+        closeConnection(fd);
+    } else {
+        m_reactor.modifyHandler(fd, EPOLLOUT | EPOLLET);
+    }
+}
+
+void AdminListener::respond(Connection& conn) {
+    std::string body;
+    const char* status = "200 OK";
+    if (conn.request.compare(0, 13, "GET /metrics ") == 0) {
+        m_render(body);
+    } else {
+        status = "404 Not Found";
+        body = "Not found\n";
+    }
+    conn.response = "HTTP/1.0 ";
+    conn.response += status;
+    conn.response += "\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: ";
+    conn.response += std::to_string(body.size());
+    conn.response += "\r\nConnection: close\r\n\r\n";
+    conn.response += body;
+}
+
+bool AdminListener::flush(Connection& conn) {
+    while (conn.sent < conn.response.size()) {
+        ssize_t n = send(conn.socket.getFd(), conn.response.data() + conn.sent,
+                         conn.response.size() - conn.sent, MSG_NOSIGNAL);
+        if (n == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return false;
+            }
+            LOG_DEBUG("Admin connection write failed: {}", LogErrno{errno});
+            return true; // Give up; the caller closes the connection
+        }
+        conn.sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+void AdminListener::closeConnection(int fd) {
+    m_reactor.unregisterHandler(fd);
+    m_connections.erase(fd);
+}
@@ -0,0 +1,104 @@
+#include <algorithm>
+#include <cstring>
+#include "codec.hpp"
+
+LineFramer::LineFramer(size_t max_line) : m_maxLine(max_line) {}
+
+FrameStatus LineFramer::decode(std::string_view input, std::string_view& frame, size_t& consumed) const {
+    // Only the bytes a legal line could span need scanning
+    size_t scan = std::min(input.size(), m_maxLine + 2);
+    const void* newline = std::memchr(input.data(), '\n', scan);
+    if (newline == nullptr) {
+        return input.size() > m_maxLine + 1 ? FrameStatus::Invalid : FrameStatus::Incomplete;
+    }
+    size_t length = static_cast<size_t>(static_cast<const char*>(newline) - input.data());
+    consumed = length + 1;
+    if (length > 0 && input[length - 1] == '\r') {
+        --length;
+    }
+    if (length > m_maxLine) {
+        return FrameStatus::Invalid;
+    }
+    frame = input.substr(0, length);
+    return FrameStatus::Complete;
+}
+
+size_t LineFramer::encodeHeader(size_t, char*) const {
+    return 0;
+}
+
+LengthPrefixFramer::LengthPrefixFramer(size_t max_frame) : m_maxFrame(max_frame) {}
+
+FrameStatus LengthPrefixFramer::decode(std::string_view input, std::string_view& frame, size_t& consumed) const {
+    if (input.size() < HEADER_SIZE) {
+        return FrameStatus::Incomplete;
+    }
+    const auto* header = reinterpret_cast<const unsigned char*>(input.data());
+    size_t length = (static_cast<size_t>(header[0]) << 24) | (static_cast<size_t>(header[1]) << 16) |
+                    (static_cast<size_t>(header[2]) << 8) | static_cast<size_t>(header[3]);
+    if (length > m_maxFrame) {
+        return FrameStatus::Invalid;
+    }
+    if (input.size() - HEADER_SIZE < length) {
+        return FrameStatus::Incomplete;
+    }
+    frame = input.substr(HEADER_SIZE, length);
+    consumed = HEADER_SIZE + length;
+    return FrameStatus::Complete;
+}
+
+size_t LengthPrefixFramer::encodeHeader(size_t length, char* out) const {
+    out[0] = static_cast<char>((length >> 24) & 0xff);
+    out[1] = static_cast<char>((length >> 16) & 0xff);
+    out[2] = static_cast<char>((length >> 8) & 0xff);
+    out[3] = static_cast<char>(length & 0xff);
+    return HEADER_SIZE;
+}
+
+std::unique_ptr<Framer> makeFramer(Framing framing, size_t max_frame) {
+    switch (framing) {
+    case Framing::Line:
+        return std::make_unique<LineFramer>(max_frame);
+    case Framing::LengthPrefix:
+        return std::make_unique<LengthPrefixFramer>(max_frame);
+    case Framing::None:
+        break;
+    }
+    return nullptr;
+}
+
+char* ReadBuffer::prepare(size_t len) {
+    if (m_capacity - m_end >= len) {
+        return m_data.get() + m_end;
+    }
+    size_t used = size();
+    if (used + len <= m_capacity) {
+        // Enough room overall: slide the unparsed tail (a partial frame) down
+        std::memmove(m_data.get(), m_data.get() + m_begin, used);
+    } else {
+        size_t capacity = std::max({m_capacity * 2, used + len, MIN_CAPACITY});
+        std::unique_ptr<char[]> grown(new char[capacity]);
+        if (used > 0) {
+            std::memcpy(grown.get(), m_data.get() + m_begin, used);
+        }
+        m_data = std::move(grown);
+        m_capacity = capacity;
+    }
+    m_begin = 0;
+    m_end = used;
+    return m_data.get() + m_end;
+}
+
+void ReadBuffer::consume(size_t len) {
+    m_begin += std::min(len, size());
+    if (m_begin == m_end) {
+        m_begin = m_end = 0;
+    }
+}
+
+void ReadBuffer::release() {
+    if (empty()) {
+        m_data.reset();
+        m_capacity = 0;
+    }
+}
@@ -0,0 +1,190 @@
+#include <exception>
+#include <new>
+#include <cerrno>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include "coro.hpp"
+#include "logger.hpp"
+
+namespace {
+
+struct FreeFrame {
+    FreeFrame* next;
+};
+
+struct FrameCache {
+    FreeFrame* heads[FramePool::CLASSES] = {};
+    size_t counts[FramePool::CLASSES] = {};
+    uint64_t heap_allocations = 0;
+
+    ~FrameCache() {
+        for (FreeFrame* head : heads) {
+            while (head != nullptr) {
+                FreeFrame* next = head->next;
+                ::operator delete(head);
+                head = next;
+            }
+        }
+    }
+};
+
+thread_local FrameCache t_frames;
+
+// Size class for size bytes, CLASSES when it is too large to pool
+size_t frameClass(size_t size) {
+    return (size + FramePool::CLASS_SIZE - 1) / FramePool::CLASS_SIZE - 1;
+}
+
+// Top-level owner of a spawned Task: starts eagerly, destroys itself at the end
+struct Detached {
+    struct promise_type : detail::PooledPromise {
+        Detached get_return_object() noexcept { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+
+        void unhandled_exception() noexcept {
+            try {
+                throw;
+            } catch (const std::exception& e) {
+                LOG_ERROR("Spawned coroutine threw: {}", e.what());
+            } catch (...) {
+                LOG_ERROR("Spawned coroutine threw an unknown exception");
+            }
+        }
+    };
+};
+
+Detached runDetached(Task<void> task) {
+    co_await std::move(task);
+}
+
+} // namespace
+
+void* FramePool::allocate(size_t size) {
+    size_t index = frameClass(size);
+    if (index >= CLASSES) {
+        return ::operator new(size);
+    }
+    FreeFrame*& head = t_frames.heads[index];
+    if (head != nullptr) {
+        FreeFrame* frame = head;
+        head = frame->next;
+        --t_frames.counts[index];
+        return frame;
+    }
+    ++t_frames.heap_allocations;
+    // Round up so any frame of this class can reuse the block later
+    return ::operator new((index + 1) * CLASS_SIZE);
+}
+
+void FramePool::deallocate(void* frame, size_t size) noexcept {
+    size_t index = frameClass(size);
+    if (index >= CLASSES || t_frames.counts[index] >= MAX_CACHED) {
+        ::operator delete(frame);
+        return;
+    }
+    auto* node = static_cast<FreeFrame*>(frame);
+    node->next = t_frames.heads[index];
+    t_frames.heads[index] = node;
+    ++t_frames.counts[index];
+}
+
+size_t FramePool::cached() {
+    size_t total = 0;
+    for (size_t count : t_frames.counts) {
+        total += count;
+    }
+    return total;
+}
+
+uint64_t FramePool::heapAllocations() {
+    return t_frames.heap_allocations;
+}
+
+void spawn(Task<void> task) {
+    runDetached(std::move(task));
+}
+
+bool IoAwaiter::attempt() {
+    int fd = m_socket->getFd();
+    while (true) {
+        ssize_t n = 0;  // Set by every case; GCC cannot tell at -O2
+        switch (m_op) {
+        case Op::Read:
+            n = recv(fd, m_data, m_len, 0);
+            break;
+        case Op::Write:
+            n = send(fd, m_data + m_done, m_len - m_done, MSG_NOSIGNAL);
+            break;
+        case Op::Accept:
+            n = accept4(fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            break;
+        }
+        if (n == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return false;
+            }
+            if (errno == EINTR || (m_op == Op::Accept && errno == ECONNABORTED)) {
+                continue;
+            }
+            m_result = -1;
+            m_error = errno;
+            return true;
+        }
+        if (m_op == Op::Write) {
+            m_done += static_cast<size_t>(n);
+            if (m_done < m_len) {
+                continue;
+            }
+            n = static_cast<ssize_t>(m_done);
+        }
+        m_result = n;
+        return true;
+    }
+}
+
+void IoAwaiter::await_suspend(std::coroutine_handle<> handle) {
+    m_handle = handle;
+    (m_op == Op::Write ? m_socket->m_writer : m_socket->m_reader) = this;
+}
+
+AsyncSocket::AsyncSocket(Reactor& reactor, Socket socket)
+    : m_reactor(reactor), m_socket(std::move(socket)) {
+    m_socket.setNonBlocking();
+    // Both directions, once: awaiting afterwards never touches the poller
+    m_reactor.registerHandler(m_socket.getFd(), EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET,
+                              [this](int, uint32_t events) { onEvents(events); });
+}
+
+AsyncSocket::~AsyncSocket() {
+    if (m_alive != nullptr) {
+        *m_alive = false;
+    }
+    if (m_socket.getFd() != -1) {
+        m_reactor.unregisterHandler(m_socket.getFd());
+    }
+}
+
+void AsyncSocket::onEvents(uint32_t events) {
+    // A resumed coroutine may finish and destroy this socket before we return
+    bool alive = true;
+    m_alive = &alive;
+
+    const uint32_t failure = EPOLLHUP | EPOLLERR;
+    if (m_reader != nullptr && (events & (EPOLLIN | EPOLLRDHUP | failure)) && m_reader->attempt()) {
+        IoAwaiter* reader = std::exchange(m_reader, nullptr);
+        reader->m_handle.resume();
+        if (!alive) {
+            return;
+        }
+    }
+    if (m_writer != nullptr && (events & (EPOLLOUT | failure)) && m_writer->attempt()) {
+        IoAwaiter* writer = std::exchange(m_writer, nullptr);
+        writer->m_handle.resume();
+        if (!alive) {
+            return;
+        }
+    }
+    m_alive = nullptr;
+}
@@ -0,0 +1,181 @@
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/un.h>
+#include "endpoint.hpp"
+
+namespace {
+
+void checkPort(int port) {
+    if (port < 0 || port > 65535) {
+        throw std::invalid_argument("Port out of range: " + std::to_string(port));
+    }
+}
+
+int parsePort(const std::string& text, const std::string& whole) {
+    size_t used = 0;
+    int port = -1;
+    try {
+        port = std::stoi(text, &used);
+    } catch (const std::exception&) {
+        used = 0;
+    }
+    if (text.empty() || used != text.size() || port < 0 || port > 65535) {
+        throw std::invalid_argument("Bad port in endpoint '" + whole + "'");
+    }
+    return port;
+}
+
+} // namespace
+
+Endpoint Endpoint::any(int port) {
+    return ipv4("0.0.0.0", port);
+}
+
+Endpoint Endpoint::ipv4(const std::string& address, int port) {
+    checkPort(port);
+    Endpoint endpoint;
+    auto* addr = reinterpret_cast<sockaddr_in*>(&endpoint.m_addr);
+    addr->sin_family = AF_INET;
+    addr->sin_port = htons(static_cast<uint16_t>(port));
+    if (inet_pton(AF_INET, address.c_str(), &addr->sin_addr) != 1) {
+        throw std::invalid_argument("Not a numeric IPv4 address: '" + address + "'");
+    }
+    endpoint.m_length = sizeof(sockaddr_in);
+    return endpoint;
+}
+
+Endpoint Endpoint::ipv6(const std::string& address, int port, bool dual_stack) {
+    checkPort(port);
+    Endpoint endpoint;
+    auto* addr = reinterpret_cast<sockaddr_in6*>(&endpoint.m_addr);
+    addr->sin6_family = AF_INET6;
+    addr->sin6_port = htons(static_cast<uint16_t>(port));
+    if (inet_pton(AF_INET6, address.c_str(), &addr->sin6_addr) != 1) {
+        throw std::invalid_argument("Not a numeric IPv6 address: '" + address + "'");
+    }
+    endpoint.m_length = sizeof(sockaddr_in6);
+    endpoint.m_dualStack = dual_stack;
+    return endpoint;
+}
+
+Endpoint Endpoint::unixPath(const std::string& path) {
+    Endpoint endpoint;
+    auto* addr = reinterpret_cast<sockaddr_un*>(&endpoint.m_addr);
+    addr->sun_family = AF_UNIX;
+    // Abstract names are not NUL-terminated; a path needs room for its NUL
+    const bool abstract = !path.empty() && path[0] == '@';
+    const size_t minimum = abstract ? 2 : 1;
+    const size_t limit = sizeof(addr->sun_path) - (abstract ? 0 : 1);
+    if (path.size() < minimum || path.size() > limit) {
+        throw std::invalid_argument("Unix socket name must be " + std::to_string(minimum) + " to " + std::to_string(limit) +
+                                    " characters: '" + path + "'");
+    }
+    std::memcpy(addr->sun_path, path.data(), path.size());
+    if (abstract) {
+        addr->sun_path[0] = '\0';
+    }
+    endpoint.m_length = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + path.size() + (abstract ? 0 : 1));
+    return endpoint;
+}
+
+Endpoint Endpoint::parse(const std::string& text) {
+    if (text.compare(0, 5, "unix:") == 0) {
+        return unixPath(text.substr(5));
+    }
+    if (!text.empty() && text[0] == '[') {
+        size_t close = text.find("]:");
+        if (close == std::string::npos) {
+            throw std::invalid_argument("Expected [address]:port in endpoint '" + text + "'");
+        }
+        return ipv6(text.substr(1, close - 1), parsePort(text.substr(close + 2), text));
+    }
+    size_t colon = text.rfind(':');
+    if (colon == std::string::npos) {
+        return any(parsePort(text, text));
+    }
+    return ipv4(text.substr(0, colon), parsePort(text.substr(colon + 1), text));
+}
+
+Endpoint Endpoint::local(int fd) {
+    Endpoint endpoint;
+    endpoint.m_length = sizeof(endpoint.m_addr);
+    if (getsockname(fd, reinterpret_cast<sockaddr*>(&endpoint.m_addr), &endpoint.m_length) == -1) {
+        throw std::system_error(errno, std::generic_category(), std::string("getsockname failed: ") + std::strerror(errno));
+    }
+    if (endpoint.m_addr.ss_family == AF_INET6) {
+        int v6only = 0;
+        socklen_t len = sizeof(v6only);
+        getsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &v6only, &len);
+        endpoint.m_dualStack = v6only == 0;
+    }
+    return endpoint;
+}
+
+AddressFamily Endpoint::family() const {
+    switch (m_addr.ss_family) {
+    case AF_INET6:
+        return AddressFamily::IPv6;
+    case AF_UNIX:
+        return AddressFamily::Unix;
+    default:
+        return AddressFamily::IPv4;
+    }
+}
+
+int Endpoint::port() const {
+    switch (m_addr.ss_family) {
+    case AF_INET:
+        return ntohs(reinterpret_cast<const sockaddr_in*>(&m_addr)->sin_port);
+    case AF_INET6:
+        return ntohs(reinterpret_cast<const sockaddr_in6*>(&m_addr)->sin6_port);
+    default:
+        return 0;
+    }
+}
+
+Endpoint Endpoint::withPort(int port) const {
+    checkPort(port);
+    Endpoint endpoint = *this;
+    if (m_addr.ss_family == AF_INET) {
+        reinterpret_cast<sockaddr_in*>(&endpoint.m_addr)->sin_port = htons(static_cast<uint16_t>(port));
+    } else if (m_addr.ss_family == AF_INET6) {
+        reinterpret_cast<sockaddr_in6*>(&endpoint.m_addr)->sin6_port = htons(static_cast<uint16_t>(port));
+    }
+    return endpoint;
+}
+
+bool Endpoint::isAbstract() const {
+    const auto* addr = reinterpret_cast<const sockaddr_un*>(&m_addr);
+    return m_addr.ss_family == AF_UNIX && m_length > offsetof(sockaddr_un, sun_path) && addr->sun_path[0] == '\0';
+}
+
+std::string Endpoint::path() const {
+    if (m_addr.ss_family != AF_UNIX || isAbstract() || m_length <= offsetof(sockaddr_un, sun_path)) {
+        return {};
+    }
+    const auto* addr = reinterpret_cast<const sockaddr_un*>(&m_addr);
+    return std::string(addr->sun_path, strnlen(addr->sun_path, m_length - offsetof(sockaddr_un, sun_path)));
+}
+
+std::string Endpoint::toString() const {
+    char address[INET6_ADDRSTRLEN] = {};
+    switch (m_addr.ss_family) {
+    case AF_INET:
+        inet_ntop(AF_INET, &reinterpret_cast<const sockaddr_in*>(&m_addr)->sin_addr, address, sizeof(address));
+        return std::string(address) + ":" + std::to_string(port());
+    case AF_INET6:
+        inet_ntop(AF_INET6, &reinterpret_cast<const sockaddr_in6*>(&m_addr)->sin6_addr, address, sizeof(address));
+        return "[" + std::string(address) + "]:" + std::to_string(port());
+    default:
+        if (isAbstract()) {
+            const auto* addr = reinterpret_cast<const sockaddr_un*>(&m_addr);
+            return "unix:@" + std::string(addr->sun_path + 1, m_length - offsetof(sockaddr_un, sun_path) - 1);
+        }
+        return "unix:" + path();
+    }
+}
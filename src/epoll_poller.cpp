@@ -0,0 +1,52 @@
+#include <stdexcept>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include "poller.hpp"
+
+namespace {
+
+class EpollPoller : public Poller {
+    int m_epollFd;
+public:
+    EpollPoller() : m_epollFd(epoll_create1(EPOLL_CLOEXEC)) {
+        if (m_epollFd == -1) {
+            throw std::runtime_error("Failed to create epoll instance");
+        }
+    }
+
+    ~EpollPoller() override {
+        close(m_epollFd);
+    }
+
+    int add(int fd, uint32_t events, void* tag) override {
+        return control(EPOLL_CTL_ADD, fd, events, tag);
+    }
+
+    int modify(int fd, uint32_t events, void* tag) override {
+        return control(EPOLL_CTL_MOD, fd, events, tag);
+    }
+
+    int remove(int fd) override {
+        return epoll_ctl(m_epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    }
+
+    int wait(struct epoll_event* out, int max_events, int timeout_ms) override {
+        return epoll_wait(m_epollFd, out, max_events, timeout_ms);
+    }
+
+    ReactorBackend backend() const override { return ReactorBackend::Epoll; }
+
+private:
+    int control(int op, int fd, uint32_t events, void* tag) {
+        struct epoll_event ev;
+        ev.events = events;
+        ev.data.ptr = tag;
+        return epoll_ctl(m_epollFd, op, fd, &ev);
+    }
+};
+
+} // namespace
+
+std::unique_ptr<Poller> makeEpollPoller() {
+    return std::make_unique<EpollPoller>();
+}
@@ -0,0 +1,193 @@
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/openat2.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include "file_cache.hpp"
+
+namespace {
+
+// Relative, and no component may climb out of the root
+bool validPath(std::string_view path) {
+    if (path.empty()) {
+        return false;
+    }
+    size_t start = 0;
+    while (start <= path.size()) {
+        size_t end = path.find('/', start);
+        if (end == std::string_view::npos) {
+            end = path.size();
+        }
+        if (path.substr(start, end - start) == "..") {
+            return false;
+        }
+        start = end + 1;
+    }
+    return true;
+}
+
+// Without openat2: one component at a time, each opened with O_NOFOLLOW
+// from the directory before it, so no symlink is followed at all (stricter
+// than RESOLVE_BENEATH, which allows those that stay inside the root)
+int openComponents(int root, const std::string& path) {
+    int dir = root;
+    size_t start = 0;
+    while (true) {
+        size_t end = path.find('/', start);
+        const bool last = end == std::string::npos;
+        std::string name = path.substr(start, last ? std::string::npos : end - start);
+        int fd;
+        if (last) {
+            fd = openat(dir, name.empty() ? "." : name.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW | O_NONBLOCK);
+        } else if (name.empty() || name == ".") {
+            start = end + 1;
+            continue;
+        } else {
+            fd = openat(dir, name.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC | O_NOFOLLOW);
+        }
+        int error = errno;
+        if (dir != root) {
+            close(dir);
+        }
+        if (fd == -1 || last) {
+            errno = error;
+            return fd;
+        }
+        dir = fd;
+        start = end + 1;
+    }
+}
+
+int openBeneath(int root, const std::string& path) {
+    // openat2 also refuses symlinks that lead out of the root; kernels
+    // before 5.6 walk the path themselves
+    open_how how{};
+    // O_NONBLOCK so a FIFO cannot hold the loop in open() waiting for a
+    // writer; FileCache::open clears it once the file is known to be regular
+    how.flags = O_RDONLY | O_CLOEXEC | O_NONBLOCK;
+    how.resolve = RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS;
+    int fd = static_cast<int>(syscall(SYS_openat2, root, path.c_str(), &how, sizeof(how)));
+    if (fd == -1 && errno == ENOSYS) {
+        fd = openComponents(root, path);
+    }
+    return fd;
+}
+
+bool sameFile(const struct stat& st, dev_t dev, ino_t ino, size_t size, const timespec& mtime) {
+    return st.st_dev == dev && st.st_ino == ino && static_cast<size_t>(st.st_size) == size &&
+           st.st_mtim.tv_sec == mtime.tv_sec && st.st_mtim.tv_nsec == mtime.tv_nsec;
+}
+
+} // namespace
+
+FileCache::File::File(int fd, const struct stat& st, uint64_t now_ms)
+    : m_fd(fd),
+      m_size(static_cast<size_t>(st.st_size)),
+      m_dev(st.st_dev),
+      m_ino(st.st_ino),
+      m_mtime(st.st_mtim),
+      m_checkedMs(now_ms) {}
+
+FileCache::File::~File() {
+    if (m_map != nullptr) {
+        munmap(m_map, m_size);
+    }
+    close(m_fd);
+}
+
+const char* FileCache::File::data() {
+    if (m_size == 0) {
+        return "";
+    }
+    if (m_map == nullptr) {
+        void* map = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, m_fd, 0);
+        if (map == MAP_FAILED) {
+            return nullptr;
+        }
+        m_map = map;
+    }
+    return static_cast<const char*>(m_map);
+}
+
+FileCache::FileCache(const std::string& root, size_t max_files, uint64_t revalidate_ms, Counter* hits, Counter* misses)
+    : m_root(::open(root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)),
+      m_maxFiles(max_files),
+      m_revalidateMs(revalidate_ms),
+      m_hits(hits),
+      m_misses(misses) {
+    if (m_root == -1) {
+        throw std::runtime_error("Failed to open static root " + root + ": " + std::strerror(errno));
+    }
+}
+
+FileCache::~FileCache() {
+    close(m_root);
+}
+
+FileCache::FilePtr FileCache::open(std::string_view path, uint64_t now_ms) {
+    while (!path.empty() && path.front() == '/') {
+        path.remove_prefix(1);
+    }
+    if (!validPath(path)) {
+        errno = EINVAL;
+        return nullptr;
+    }
+    std::string key(path);
+
+    auto found = m_index.find(key);
+    if (found != m_index.end()) {
+        FilePtr file = found->second->second;
+        if (now_ms - file->m_checkedMs < m_revalidateMs || unchanged(key, *file, now_ms)) {
+            m_lru.splice(m_lru.begin(), m_lru, found->second);
+            if (m_hits) m_hits->add();
+            return file;
+        }
+        // Replaced or modified; responses still sending keep the old one open
+        m_lru.erase(found->second);
+        m_index.erase(found);
+    }
+
+    if (m_misses) m_misses->add();
+    int fd = openBeneath(m_root, key);
+    if (fd == -1) {
+        return nullptr;
+    }
+    struct stat st{};
+    if (fstat(fd, &st) == -1) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return nullptr;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        close(fd);
+        errno = S_ISDIR(st.st_mode) ? EISDIR : EINVAL;
+        return nullptr;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+    auto file = std::make_shared<File>(fd, st, now_ms);
+    if (m_maxFiles == 0) {
+        return file;
+    }
+    m_lru.emplace_front(key, file);
+    m_index[std::move(key)] = m_lru.begin();
+    if (m_lru.size() > m_maxFiles) {
+        m_index.erase(m_lru.back().first);
+        m_lru.pop_back();
+    }
+    return file;
+}
+
+bool FileCache::unchanged(const std::string& path, File& file, uint64_t now_ms) const {
+    struct stat st{};
+    if (fstatat(m_root, path.c_str(), &st, 0) == -1 ||
+        !sameFile(st, file.m_dev, file.m_ino, file.m_size, file.m_mtime)) {
+        return false;
+    }
+    file.m_checkedMs = now_ms;
+    return true;
+}
@@ -0,0 +1,188 @@
+#include <cstdio>
+#include <stdexcept>
+#include <unistd.h>
+#include <sys/epoll.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+#include "flight_recorder.hpp"
+
+namespace {
+
+// Without an invariant TSC the counter rate follows frequency changes and
+// sleep states, so timestamps fall back to the (slower to read) raw clock
+bool invariantTsc() {
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned eax = 0, ebx = 0, ecx = 0, edx = 0;
+    if (__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx)) {
+        return (edx & (1u << 8)) != 0;
+    }
+#endif
+    return false;
+}
+
+uint64_t rawNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+struct ClockPair {
+    uint64_t ticks;
+    uint64_t ns;
+};
+
+ClockPair samplePair() {
+    uint64_t before = FlightRecorder::now();
+    uint64_t ns = rawNs();
+    uint64_t after = FlightRecorder::now();
+    return {before + (after - before) / 2, ns};
+}
+
+// Taken when the first recorder is created. Each export measures the TSC rate
+// from here to its own sample, which gets more precise the longer the process
+// has been up.
+const ClockPair& origin() {
+    static const ClockPair pair = samplePair();
+    return pair;
+}
+
+class TickConverter {
+public:
+    TickConverter() {
+        if (!FlightRecorder::usesTsc()) {
+            return;     // Ticks are already nanoseconds
+        }
+        m_origin = origin();
+        ClockPair current = samplePair();
+        if (current.ticks > m_origin.ticks && current.ns > m_origin.ns) {
+            m_nsPerTick = static_cast<double>(current.ns - m_origin.ns) /
+                          static_cast<double>(current.ticks - m_origin.ticks);
+        }
+    }
+
+    double micros(uint64_t ticks) const {
+        double offset = static_cast<double>(static_cast<int64_t>(ticks - m_origin.ticks));
+        return (static_cast<double>(m_origin.ns) + offset * m_nsPerTick) / 1000.0;
+    }
+
+private:
+    ClockPair m_origin{0, 0};
+    double m_nsPerTick = 1.0;
+};
+
+void appendMask(std::string& out, uint32_t events) {
+    static const struct {
+        uint32_t bit;
+        const char* name;
+    } names[] = {{EPOLLIN, "IN"}, {EPOLLPRI, "PRI"}, {EPOLLOUT, "OUT"},
+                 {EPOLLERR, "ERR"}, {EPOLLHUP, "HUP"}, {EPOLLRDHUP, "RDHUP"}};
+    bool first = true;
+    for (const auto& name : names) {
+        if (events & name.bit) {
+            if (!first) out += '|';
+            out += name.name;
+            first = false;
+        }
+    }
+}
+
+const char* instantName(TraceEvent type) {
+    switch (type) {
+    case TraceEvent::ReadPause: return "read pause";
+    case TraceEvent::ReadResume: return "read resume";
+    case TraceEvent::Accept: return "accept";
+    case TraceEvent::Close: return "close";
+    default: return "event";
+    }
+}
+
+} // namespace
+
+const bool FlightRecorder::s_tsc = invariantTsc();
+
+FlightRecorder::FlightRecorder(size_t capacity) {
+    if (capacity == 0) {
+        throw std::invalid_argument("FlightRecorder capacity must be at least 1");
+    }
+    size_t rounded = 1;
+    while (rounded < capacity) {
+        rounded <<= 1;
+    }
+    m_records.reset(new Record[rounded]());
+    m_mask = rounded - 1;
+    origin();
+}
+
+void FlightRecorder::snapshot(std::vector<Record>& out) const {
+    const uint64_t kept = m_next < capacity() ? m_next : capacity();
+    out.reserve(out.size() + kept);
+    for (uint64_t i = m_next - kept; i < m_next; ++i) {
+        out.push_back(m_records[i & m_mask]);
+    }
+}
+
+void appendChromeTrace(std::string& out, const std::vector<TraceSnapshot>& loops) {
+    const TickConverter clock;
+    const long pid = static_cast<long>(getpid());
+    char line[256];
+    bool first = true;
+    auto begin = [&](const char* name, const char* phase, size_t tid, double ts) {
+        out += first ? "\n" : ",\n";
+        first = false;
+        std::snprintf(line, sizeof(line), "{\"name\":\"%s\",\"ph\":\"%s\",\"pid\":%ld,\"tid\":%zu,\"ts\":%.3f",
+                      name, phase, pid, tid, ts);
+        out += line;
+    };
+
+    out += "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    for (size_t tid = 0; tid < loops.size(); ++tid) {
+        const TraceSnapshot& loop = loops[tid];
+        begin("thread_name", "M", tid, 0.0);
+        out += ",\"args\":{\"name\":\"" + loop.thread_name + "\"}}";
+
+        const FlightRecorder::Record* wait = nullptr;
+        const FlightRecorder::Record* enter = nullptr;
+        for (const FlightRecorder::Record& record : loop.records) {
+            switch (record.type) {
+            case TraceEvent::Wait:
+                wait = &record;
+                break;
+            case TraceEvent::Wakeup:
+                if (wait != nullptr) {
+                    double start = clock.micros(wait->ticks);
+                    begin("wait", "X", tid, start);
+                    std::snprintf(line, sizeof(line), ",\"dur\":%.3f,\"cat\":\"poller\",\"args\":{\"events\":%u}}",
+                                  clock.micros(record.ticks) - start, static_cast<unsigned>(record.arg));
+                    out += line;
+                    wait = nullptr;
+                }
+                break;
+            case TraceEvent::HandlerEnter:
+                enter = &record;
+                break;
+            case TraceEvent::HandlerExit:
+                if (enter != nullptr && enter->fd == record.fd) {
+                    double start = clock.micros(enter->ticks);
+                    char name[32];
+                    std::snprintf(name, sizeof(name), "fd %d", static_cast<int>(record.fd));
+                    begin(name, "X", tid, start);
+                    std::snprintf(line, sizeof(line), ",\"dur\":%.3f,\"cat\":\"handler\",\"args\":{\"events\":\"",
+                                  clock.micros(record.ticks) - start);
+                    out += line;
+                    appendMask(out, enter->arg);
+                    out += "\"}}";
+                }
+                enter = nullptr;
+                break;
+            default:
+                begin(instantName(record.type), "i", tid, clock.micros(record.ticks));
+                std::snprintf(line, sizeof(line), ",\"s\":\"t\",\"cat\":\"server\",\"args\":{\"fd\":%d}}",
+                              static_cast<int>(record.fd));
+                out += line;
+                break;
+            }
+        }
+    }
+    out += "\n]}\n";
+}
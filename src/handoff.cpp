@@ -0,0 +1,206 @@
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "handoff.hpp"
+#include "logger.hpp"
+
+namespace {
+
+constexpr uint32_t HANDOFF_MAGIC = 0x48414e44;  // "HAND"
+
+struct HandoffHeader {
+    uint32_t magic;
+    uint32_t kind;
+    uint32_t value;
+};
+
+sockaddr_un unixAddress(const std::string& path) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+        throw std::invalid_argument("Handoff path must be 1 to " + std::to_string(sizeof(addr.sun_path) - 1) +
+                                    " characters: '" + path + "'");
+    }
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    return addr;
+}
+
+[[noreturn]] void handoffFailed(const std::string& what) {
+    throw std::runtime_error("Socket handoff failed: " + what);
+}
+
+} // namespace
+
+bool sendHandoffMessage(int channel, HandoffMessage kind, uint32_t value, const int* fds, size_t count) {
+    HandoffHeader header{HANDOFF_MAGIC, static_cast<uint32_t>(kind), value};
+    iovec iov{&header, sizeof(header)};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * HANDOFF_MAX_FDS)];
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (count > HANDOFF_MAX_FDS) {
+        errno = EINVAL;
+        return false;
+    }
+    if (count > 0) {
+        msg.msg_control = control;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+        cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+        std::memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * count);
+    }
+    while (sendmsg(channel, &msg, MSG_NOSIGNAL) == -1) {
+        if (errno != EINTR) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool inheritSockets(const std::string& path, InheritedSockets& out, int timeout_ms) {
+    sockaddr_un addr = unixAddress(path);
+    Socket channel(socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0));
+    if (channel.getFd() == -1) {
+        handoffFailed(std::string("socket: ") + std::strerror(errno));
+    }
+    if (connect(channel.getFd(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1) {
+        if (errno == ENOENT || errno == ECONNREFUSED) {
+            return false;   // Nobody to take over from
+        }
+        handoffFailed("connect to " + path + ": " + std::strerror(errno));
+    }
+    timeval timeout{timeout_ms / 1000, (timeout_ms % 1000) * 1000};
+    setsockopt(channel.getFd(), SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    bool have_listeners = false;
+    uint32_t loops_pending = 0;
+    while (!have_listeners || loops_pending > 0) {
+        HandoffHeader header{};
+        iovec iov{&header, sizeof(header)};
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * HANDOFF_MAX_FDS)];
+        msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        ssize_t n = recvmsg(channel.getFd(), &msg, MSG_CMSG_CLOEXEC);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == -1) {
+            handoffFailed(std::string("receive: ") + std::strerror(errno));
+        }
+
+        // Take ownership of the fds before anything can throw
+        std::vector<Socket> received;
+        for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+                size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                for (size_t i = 0; i < count; ++i) {
+                    int fd;
+                    std::memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(fd));
+                    received.emplace_back(fd);
+                }
+            }
+        }
+        if (n == 0) {
+            handoffFailed("previous server closed the channel early");
+        }
+        if (static_cast<size_t>(n) != sizeof(header) || header.magic != HANDOFF_MAGIC || (msg.msg_flags & MSG_CTRUNC)) {
+            handoffFailed("malformed message");
+        }
+
+        auto& target = header.kind == static_cast<uint32_t>(HandoffMessage::Listeners) ? out.listeners : out.clients;
+        switch (static_cast<HandoffMessage>(header.kind)) {
+        case HandoffMessage::Listeners:
+            have_listeners = true;
+            loops_pending = header.value;
+            break;
+        case HandoffMessage::Clients:
+            break;
+        case HandoffMessage::LoopDone:
+            if (loops_pending == 0) {
+                handoffFailed("unexpected end of loop");
+            }
+            --loops_pending;
+            break;
+        default:
+            handoffFailed("unknown message kind " + std::to_string(header.kind));
+        }
+        for (Socket& socket : received) {
+            target.push_back(std::move(socket));
+        }
+    }
+    if (out.listeners.empty()) {
+        handoffFailed("no listening sockets received");
+    }
+    return true;
+}
+
+HandoffListener::HandoffListener(Reactor& reactor, const std::string& path, Callback on_successor, uid_t peer_uid)
+    : m_reactor(reactor),
+      m_path(path),
+      m_socket(socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)),
+      m_onSuccessor(std::move(on_successor)),
+      m_peerUid(peer_uid == static_cast<uid_t>(-1) ? geteuid() : peer_uid) {
+    sockaddr_un addr = unixAddress(path);
+    if (m_socket.getFd() == -1) {
+        throw std::runtime_error("Failed to create handoff socket: " + std::string(std::strerror(errno)));
+    }
+    // A predecessor (or a crashed run) may still own the name; take it over
+    unlink(path.c_str());
+    if (bind(m_socket.getFd(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1) {
+        throw std::runtime_error("Failed to bind handoff socket " + path + ": " + std::strerror(errno));
+    }
+    m_socket.listen();
+    m_reactor.registerHandler(m_socket.getFd(), EPOLLIN | EPOLLET, [this](int, uint32_t) {
+        handleAccept();
+    });
+}
+
+HandoffListener::~HandoffListener() {
+    if (!m_handedOff) {
+        m_reactor.unregisterHandler(m_socket.getFd());
+        unlink(m_path.c_str());
+    }
+}
+
+void HandoffListener::handleAccept() {
+    int fd;
+    while (true) {
+        // Blocking on purpose: the handoff sends a few small messages and the
+        // successor is waiting to read them
+        fd = accept4(m_socket.getFd(), nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                LOG_WARN("Handoff listener failed to accept: {}", LogErrno{errno});
+            }
+            return;
+        }
+        // Whoever connects gets every listening socket, so the kernel's word
+        // on who that is decides; the path's permissions alone do not
+        ucred peer{};
+        socklen_t len = sizeof(peer);
+        if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &peer, &len) == -1) {
+            LOG_WARN("Handoff listener could not identify its peer: {}", LogErrno{errno});
+        } else if (peer.uid == m_peerUid) {
+            break;
+        } else {
+            LOG_WARN("Refused handoff to pid {} running as uid {}, expected uid {}", peer.pid, peer.uid, m_peerUid);
+        }
+        close(fd);
+    }
+    // One successor only; it owns the path from now on
+    m_handedOff = true;
+    m_reactor.unregisterHandler(m_socket.getFd());
+    Socket channel(fd);
+    m_onSuccessor(channel);
+    m_socket = Socket(-1);
+}
@@ -0,0 +1,331 @@
+#include <cerrno>
+#include <cstring>
+#include <vector>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "poller.hpp"
+
+// Readiness backend built on io_uring poll. An edge-triggered registration is a
+// single IORING_OP_POLL_ADD with IORING_POLL_ADD_MULTI, so a socket keeps
+// posting completions without being re-armed; level-triggered ones use a
+// one-shot poll that is re-armed after every completion. Control operations are only
+// queued as SQEs and go to the kernel together with the next wait, so one
+// io_uring_enter covers the registration changes of every socket touched in
+// the previous batch of handlers.
+//
+// Only readiness goes through the ring. Multishot accept, multishot recv with
+// provided buffer rings and queued sends complete the I/O itself, which the
+// Poller interface has no way to hand to an (fd, events) handler; reads,
+// writes and accepts stay ordinary syscalls made by the handlers.
+
+namespace {
+
+constexpr unsigned RING_ENTRIES = 4096;
+constexpr uint64_t CONTROL_USER_DATA = 0; // Completions of remove requests
+
+int sysSetup(unsigned entries, struct io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int sysEnter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, void* arg, size_t argsz) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz));
+}
+
+template <typename T>
+T loadAcquire(const T* p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+
+template <typename T>
+void storeRelease(T* p, T v) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+
+class IoUringPoller : public Poller {
+    struct Registration {
+        uint32_t events = 0;
+        uint32_t generation = 0;    // 0 = fd not registered
+        void* tag = nullptr;
+    };
+
+    int m_ringFd = -1;
+    void* m_ringPtr = MAP_FAILED;
+    size_t m_ringSize = 0;
+    struct io_uring_sqe* m_sqes = static_cast<struct io_uring_sqe*>(MAP_FAILED);
+    size_t m_sqesSize = 0;
+
+    // Submission queue
+    unsigned* m_sqHead = nullptr;
+    unsigned* m_sqTail = nullptr;
+    unsigned m_sqMask = 0;
+    unsigned m_sqEntries = 0;
+    unsigned* m_sqArray = nullptr;
+    unsigned m_sqLocalTail = 0;
+    unsigned m_toSubmit = 0;
+
+    // Completion queue
+    unsigned* m_cqHead = nullptr;
+    unsigned* m_cqTail = nullptr;
+    unsigned m_cqMask = 0;
+    struct io_uring_cqe* m_cqes = nullptr;
+
+    std::vector<Registration> m_registrations;  // Indexed by fd
+    uint32_t m_nextGeneration = 1;
+
+public:
+    bool init() {
+        struct io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        m_ringFd = sysSetup(RING_ENTRIES, &params);
+        if (m_ringFd == -1) {
+            return false;
+        }
+        // Single mmap (5.4), wait timeouts through EXT_ARG (5.11) and
+        // resource tags (5.13, the release that added multishot poll)
+        const unsigned required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP |
+                                  IORING_FEAT_EXT_ARG | IORING_FEAT_RSRC_TAGS;
+        if ((params.features & required) != required) {
+            return false;
+        }
+
+        size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+        m_ringSize = sq_size > cq_size ? sq_size : cq_size;
+        m_ringPtr = mmap(nullptr, m_ringSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         m_ringFd, IORING_OFF_SQ_RING);
+        if (m_ringPtr == MAP_FAILED) {
+            return false;
+        }
+        m_sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+        void* sqes = mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          m_ringFd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) {
+            return false;
+        }
+        m_sqes = static_cast<struct io_uring_sqe*>(sqes);
+
+        char* base = static_cast<char*>(m_ringPtr);
+        m_sqHead = reinterpret_cast<unsigned*>(base + params.sq_off.head);
+        m_sqTail = reinterpret_cast<unsigned*>(base + params.sq_off.tail);
+        m_sqMask = *reinterpret_cast<unsigned*>(base + params.sq_off.ring_mask);
+        m_sqEntries = params.sq_entries;
+        m_sqArray = reinterpret_cast<unsigned*>(base + params.sq_off.array);
+        m_sqLocalTail = *m_sqTail;
+
+        m_cqHead = reinterpret_cast<unsigned*>(base + params.cq_off.head);
+        m_cqTail = reinterpret_cast<unsigned*>(base + params.cq_off.tail);
+        m_cqMask = *reinterpret_cast<unsigned*>(base + params.cq_off.ring_mask);
+        m_cqes = reinterpret_cast<struct io_uring_cqe*>(base + params.cq_off.cqes);
+        return true;
+    }
+
+    ~IoUringPoller() override {
+        if (m_sqes != MAP_FAILED) munmap(m_sqes, m_sqesSize);
+        if (m_ringPtr != MAP_FAILED) munmap(m_ringPtr, m_ringSize);
+        if (m_ringFd != -1) close(m_ringFd);
+    }
+
+    int add(int fd, uint32_t events, void* tag) override {
+        if (fd < 0) {
+            errno = EBADF;
+            return -1;
+        }
+        if (static_cast<size_t>(fd) >= m_registrations.size()) {
+            m_registrations.resize(static_cast<size_t>(fd) + 1);
+        }
+        Registration& reg = m_registrations[fd];
+        if (reg.generation != 0) {
+            errno = EEXIST;
+            return -1;
+        }
+        reg = Registration{events, nextGeneration(), tag};
+        return queuePollAdd(fd, reg);
+    }
+
+    int modify(int fd, uint32_t events, void* tag) override {
+        Registration* reg = find(fd);
+        if (reg == nullptr) {
+            errno = ENOENT;
+            return -1;
+        }
+        if (queuePollRemove(reg->generation, fd) == -1) {
+            return -1;
+        }
+        // A fresh generation makes completions of the old poll easy to drop
+        *reg = Registration{events, nextGeneration(), tag};
+        return queuePollAdd(fd, *reg);
+    }
+
+    int remove(int fd) override {
+        Registration* reg = find(fd);
+        if (reg == nullptr) {
+            errno = ENOENT;
+            return -1;
+        }
+        // The poll holds a file reference, so a closed fd is only released once
+        // this remove reaches the kernel with the next wait()
+        int rc = queuePollRemove(reg->generation, fd);
+        *reg = Registration{};
+        return rc;
+    }
+
+    int wait(struct epoll_event* out, int max_events, int timeout_ms) override {
+        if (timeout_ms == 0) {
+            // Non-blocking poll: flush queued SQEs without asking to wait
+            if (m_toSubmit > 0 && submit(0, 0, nullptr) == -1) {
+                return -1;
+            }
+        } else if (!cqReady()) {
+            struct __kernel_timespec ts;
+            struct io_uring_getevents_arg arg;
+            std::memset(&arg, 0, sizeof(arg));
+            if (timeout_ms >= 0) {
+                ts.tv_sec = timeout_ms / 1000;
+                ts.tv_nsec = static_cast<long long>(timeout_ms % 1000) * 1000000;
+                arg.ts = reinterpret_cast<uint64_t>(&ts);
+            }
+            if (submit(1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg) == -1) {
+                if (errno == ETIME) {
+                    return 0; // Timed out, same as epoll_wait returning 0
+                }
+                return -1;
+            }
+        } else if (m_toSubmit > 0 && submit(0, 0, nullptr) == -1) {
+            return -1;
+        }
+        return reap(out, max_events);
+    }
+
+    ReactorBackend backend() const override { return ReactorBackend::IoUring; }
+
+private:
+    static uint64_t encode(int fd, uint32_t generation) {
+        return (static_cast<uint64_t>(generation) << 32) | static_cast<uint32_t>(fd);
+    }
+
+    Registration* find(int fd) {
+        if (fd < 0 || static_cast<size_t>(fd) >= m_registrations.size() ||
+            m_registrations[fd].generation == 0) {
+            return nullptr;
+        }
+        return &m_registrations[fd];
+    }
+
+    uint32_t nextGeneration() {
+        if (m_nextGeneration == 0) m_nextGeneration = 1;
+        return m_nextGeneration++;
+    }
+
+    bool cqReady() const {
+        return loadAcquire(m_cqTail) != *m_cqHead;
+    }
+
+    struct io_uring_sqe* nextSqe() {
+        if (m_sqLocalTail - loadAcquire(m_sqHead) >= m_sqEntries) {
+            // Ring is full, push what we have to the kernel first
+            if (submit(0, 0, nullptr) == -1) {
+                return nullptr;
+            }
+        }
+        unsigned index = m_sqLocalTail & m_sqMask;
+        struct io_uring_sqe* sqe = &m_sqes[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        m_sqArray[index] = index;
+        ++m_sqLocalTail;
+        ++m_toSubmit;
+        return sqe;
+    }
+
+    int queuePollAdd(int fd, const Registration& reg) {
+        struct io_uring_sqe* sqe = nextSqe();
+        if (sqe == nullptr) {
+            return -1;
+        }
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = fd;
+        sqe->len = (reg.events & EPOLLET) ? IORING_POLL_ADD_MULTI : 0;
+        sqe->poll32_events = reg.events;
+        sqe->user_data = encode(fd, reg.generation);
+        return 0;
+    }
+
+    int queuePollRemove(uint32_t generation, int fd) {
+        struct io_uring_sqe* sqe = nextSqe();
+        if (sqe == nullptr) {
+            return -1;
+        }
+        sqe->opcode = IORING_OP_POLL_REMOVE;
+        sqe->fd = -1;
+        sqe->addr = encode(fd, generation);
+        sqe->user_data = CONTROL_USER_DATA;
+        return 0;
+    }
+
+    int submit(unsigned min_complete, unsigned flags, struct io_uring_getevents_arg* arg) {
+        // Publish the SQEs filled since the last submit
+        storeRelease(m_sqTail, m_sqLocalTail);
+        while (true) {
+            int rc = sysEnter(m_ringFd, m_toSubmit, min_complete, flags,
+                              arg, arg ? sizeof(*arg) : 0);
+            if (rc >= 0) {
+                m_toSubmit -= static_cast<unsigned>(rc) < m_toSubmit ? static_cast<unsigned>(rc) : m_toSubmit;
+                return 0;
+            }
+            if (errno == EINTR && min_complete == 0) {
+                continue;
+            }
+            if (errno == EBUSY || errno == EAGAIN) {
+                // CQ overflow backlog: caller must reap before we can submit more
+                return 0;
+            }
+            return -1;
+        }
+    }
+
+    int reap(struct epoll_event* out, int max_events) {
+        unsigned head = *m_cqHead;
+        unsigned tail = loadAcquire(m_cqTail);
+        int count = 0;
+        while (head != tail && count < max_events) {
+            const struct io_uring_cqe& cqe = m_cqes[head & m_cqMask];
+            ++head;
+            if (cqe.user_data == CONTROL_USER_DATA) {
+                continue;
+            }
+            int fd = static_cast<int>(cqe.user_data & 0xffffffffu);
+            uint32_t generation = static_cast<uint32_t>(cqe.user_data >> 32);
+            Registration* reg = find(fd);
+            if (reg == nullptr || reg->generation != generation) {
+                continue; // Completion of a poll that was removed or replaced
+            }
+            uint32_t ready;
+            if (cqe.res < 0) {
+                // Poll itself failed; surface it like epoll would an errored socket
+                ready = EPOLLERR;
+            } else {
+                if (!(cqe.flags & IORING_CQE_F_MORE)) {
+                    // One-shot (level-triggered) poll fired, or the kernel ended a
+                    // multishot poll early (e.g. CQ overflow): arm it again
+                    queuePollAdd(fd, *reg);
+                }
+                if (cqe.res == 0) {
+                    continue;
+                }
+                ready = static_cast<uint32_t>(cqe.res);
+            }
+            out[count].events = ready;
+            out[count].data.ptr = reg->tag;
+            ++count;
+        }
+        storeRelease(m_cqHead, head);
+        return count;
+    }
+};
+
+} // namespace
+
+std::unique_ptr<Poller> makeIoUringPoller() {
+    auto poller = std::make_unique<IoUringPoller>();
+    if (!poller->init()) {
+        return nullptr;
+    }
+    return poller;
+}
@@ -0,0 +1,191 @@
+#include <cstdio>
+#include <ctime>
+#include <chrono>
+#include "logger.hpp"
+
+namespace {
+
+constexpr auto DRAIN_INTERVAL = std::chrono::milliseconds(5);
+
+const char* levelName(LogLevel level) {
+    switch (level) {
+        case LogLevel::Trace: return "TRACE";
+        case LogLevel::Debug: return "DEBUG";
+        case LogLevel::Info:  return "INFO ";
+        case LogLevel::Warn:  return "WARN ";
+        case LogLevel::Error: return "ERROR";
+        default:              return "?    ";
+    }
+}
+
+// Marks the ring retired when its thread exits so the drainer can drop it
+struct RingHandle {
+    std::shared_ptr<void> ring;
+    std::atomic<bool>* retired = nullptr;
+
+    ~RingHandle() {
+        if (retired) {
+            retired->store(true, std::memory_order_release);
+        }
+    }
+};
+
+} // namespace
+
+std::atomic<int> Logger::s_level{static_cast<int>(LogLevel::Info)};
+
+Logger& Logger::instance() {
+    static Logger logger;
+    return logger;
+}
+
+Logger::Logger() {
+    m_thread = std::thread(&Logger::drainLoop, this);
+}
+
+Logger::~Logger() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wakeup.notify_one();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+uint64_t Logger::nowNs() {
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+Logger::Ring& Logger::threadRing() {
+    thread_local RingHandle handle;
+    thread_local Ring* ring = nullptr;
+    if (ring == nullptr) {
+        // First log call on this thread: the only time log() takes the lock
+        auto owned = std::make_shared<Ring>();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_rings.push_back(owned);
+        }
+        ring = owned.get();
+        handle.retired = &owned->retired;
+        handle.ring = std::move(owned);
+    }
+    return *ring;
+}
+
+void Logger::flush() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    uint64_t ticket = ++m_flushRequested;
+    m_wakeup.notify_one();
+    m_flushed.wait(lock, [&] { return m_flushCompleted >= ticket || m_stopping; });
+}
+
+void Logger::drainLoop() {
+    std::vector<std::shared_ptr<Ring>> rings;
+    std::string out;
+    std::string err;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_wakeup.wait_for(lock, DRAIN_INTERVAL, [&] {
+            return m_stopping || m_flushRequested != m_flushCompleted;
+        });
+        uint64_t requested = m_flushRequested;
+        bool stopping = m_stopping;
+        rings = m_rings;
+        lock.unlock();
+
+        for (auto& ring : rings) {
+            drain(*ring, out, err);
+        }
+        if (!out.empty()) {
+            std::fwrite(out.data(), 1, out.size(), stdout);
+            std::fflush(stdout);
+            out.clear();
+        }
+        if (!err.empty()) {
+            std::fwrite(err.data(), 1, err.size(), stderr);
+            err.clear();
+        }
+
+        lock.lock();
+        // Rings whose thread has exited are dropped once fully drained
+        for (auto it = m_rings.begin(); it != m_rings.end();) {
+            Ring& ring = **it;
+            bool empty = ring.m_head.load(std::memory_order_relaxed) ==
+                         ring.m_tail.load(std::memory_order_acquire);
+            if (ring.retired.load(std::memory_order_acquire) && empty) {
+                it = m_rings.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        rings.clear();
+        m_flushCompleted = requested;
+        m_flushed.notify_all();
+        if (stopping) {
+            break;
+        }
+    }
+}
+
+void Logger::drain(Ring& ring, std::string& out, std::string& err) {
+    uint32_t head = ring.m_head.load(std::memory_order_relaxed);
+    uint32_t tail = ring.m_tail.load(std::memory_order_acquire);
+    while (head != tail) {
+        const LogRecord& record = ring.m_records[head & (Ring::CAPACITY - 1)];
+        format(record, record.level >= LogLevel::Warn ? err : out);
+        ring.m_head.store(++head, std::memory_order_release);
+    }
+
+    uint64_t dropped = ring.dropped.exchange(0, std::memory_order_relaxed);
+    if (dropped != 0) {
+        err += "WARN  logger ring full, dropped " + std::to_string(dropped) + " message(s)\n";
+    }
+}
+
+void Logger::format(const LogRecord& record, std::string& line) {
+    time_t seconds = static_cast<time_t>(record.timestamp_ns / 1000000000ull);
+    tm local;
+    localtime_r(&seconds, &local);
+    char prefix[48];
+    int n = std::snprintf(prefix, sizeof(prefix), "%02d:%02d:%02d.%06u %s ",
+                          local.tm_hour, local.tm_min, local.tm_sec,
+                          static_cast<unsigned>((record.timestamp_ns % 1000000000ull) / 1000),
+                          levelName(record.level));
+    line.append(prefix, static_cast<size_t>(n));
+
+    int next_arg = 0;
+    for (const char* p = record.format; *p != '\0'; ++p) {
+        if (p[0] != '{' || p[1] != '}' || next_arg >= record.arg_count) {
+            line += *p;
+            continue;
+        }
+        const LogRecord::Arg& arg = record.args[next_arg++];
+        switch (arg.type) {
+            case LogRecord::ArgType::Int:
+                line += std::to_string(arg.i);
+                break;
+            case LogRecord::ArgType::UInt:
+                line += std::to_string(arg.u);
+                break;
+            case LogRecord::ArgType::Double:
+                line += std::to_string(arg.d);
+                break;
+            case LogRecord::ArgType::Text:
+                line.append(record.text + arg.text.offset, arg.text.length);
+                break;
+            case LogRecord::ArgType::Errno: {
+                char buffer[128];
+                line += strerror_r(arg.err, buffer, sizeof(buffer));
+                break;
+            }
+        }
+        ++p; // Skip the closing brace
+    }
+    line += '\n';
+}
@@ -1,14 +1,16 @@
 #include <iostream>
 #include <stdexcept>
 #include <memory>
+#include <string>
 #include <atomic>
 #include <csignal>
 #include <unistd.h>
 #include <sys/eventfd.h>
 #include "tcp_server.hpp"
 
-// Global shutdown fd for signal handler
+// Global shutdown and trace-dump fds for signal handler
 static int g_shutdown_fd = -1;
+static int g_trace_fd = -1;
 
 void signalHandler(int signal) {
     if((signal == SIGINT || signal == SIGTERM) && g_shutdown_fd != -1) {
@@ -17,23 +19,65 @@ void signalHandler(int signal) {
         write(g_shutdown_fd, &val, sizeof(val));
 
     }
+    if (signal == SIGUSR1 && g_trace_fd != -1) {
+        // Same route for a flight recorder dump
+        uint64_t val = 1;
+        write(g_trace_fd, &val, sizeof(val));
+    }
 }
 
 int main(int argc, char** argv) {
     try {
-        int port = 8080;
-        if (argc > 1) port = std::atoi(argv[1]);
+        // A bare port, 127.0.0.1:8080, [::]:8080, unix:/path or unix:@name
+        Endpoint endpoint = Endpoint::any(8080);
+        if (argc > 1) endpoint = Endpoint::parse(argv[1]);
+
+        ServerConfig config;
+        if (argc > 2) config.num_loops = static_cast<size_t>(std::atoi(argv[2]));
+        if (argc > 3 && std::string(argv[3]) == "io_uring") {
+            config.reactor.backend = ReactorBackend::IoUring;
+        }
+        if (argc > 4) config.admin_port = std::atoi(argv[4]);
+        if (argc > 5) config.worker_threads = static_cast<size_t>(std::atoi(argv[5]));
+        if (argc > 6) config.udp_port = std::atoi(argv[6]);
+        if (argc > 7) {
+            // Starting a second instance with the same path takes over from the first
+            config.handoff_path = argv[7];
+            config.handoff_clients = true;
+        }
+        if (argc > 8) {
+            // PEM certificate chain, and its key unless the same file holds both
+            config.tls.cert_file = argv[8];
+            config.tls.key_file = argc > 9 ? argv[9] : "";
+        }
 
-        TCPServer server(port);
+        TCPServer server(endpoint, config);
         
         // Set global shutdown fd for signal handler
         g_shutdown_fd = server.getShutdownFd();
+        g_trace_fd = server.getTraceFd();
         
         // Install signal handlers after we have the shutdown fd
         std::signal(SIGINT, signalHandler);
         std::signal(SIGTERM, signalHandler);
+        std::signal(SIGUSR1, signalHandler);
         
-        std::cout << "Starting TCP server on port " << server.getPort() << "..." << std::endl;
+        std::cout << "Starting server on " << server.getEndpoint().toString()
+                  << " with " << server.getLoopCount() << " event loop(s) on "
+                  << (server.getBackend() == ReactorBackend::IoUring ? "io_uring" : "epoll")
+                  << "..." << std::endl;
+        if (server.getAdminPort() != -1) {
+            std::cout << "Metrics at http://localhost:" << server.getAdminPort() << "/metrics" << std::endl;
+        }
+        if (!config.tls.cert_file.empty()) {
+            std::cout << "Terminating TLS with " << config.tls.cert_file << std::endl;
+        }
+        if (server.getTraceFd() != -1) {
+            std::cout << "kill -USR1 " << getpid() << " dumps a trace to " << server.getTracePath() << std::endl;
+        }
+        if (server.getUdpPort() != -1) {
+            std::cout << "Answering UDP datagrams on port " << server.getUdpPort() << std::endl;
+        }
         server.start();
         std::cout << "\nShutdown signal received. Stopping server..." << std::endl;
     } catch (const std::exception& e) {
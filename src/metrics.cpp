@@ -0,0 +1,182 @@
+#include <cstdio>
+#include "metrics.hpp"
+
+uint64_t Histogram::bucketUpperBound(size_t index) {
+    if (index < SUB_BUCKETS) {
+        return index;
+    }
+    int shift = static_cast<int>(index / SUB_BUCKETS) - 1;
+    uint64_t lower = (SUB_BUCKETS + index % SUB_BUCKETS) << shift;
+    return lower + ((1ull << shift) - 1);
+}
+
+uint64_t Histogram::quantile(double q) const {
+    uint64_t total = count();
+    if (total == 0) {
+        return 0;
+    }
+    // Rank of the quantile sample, 1-based and clamped to the population
+    uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(total) + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > total) rank = total;
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        seen += m_buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            uint64_t bound = bucketUpperBound(i);
+            uint64_t highest = max();
+            return bound < highest ? bound : highest;
+        }
+    }
+    // Buckets read mid-update can trail the count; fall back to the maximum
+    return max();
+}
+
+void Histogram::merge(const Histogram& other) {
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        bump(m_buckets[i], other.m_buckets[i].load(std::memory_order_relaxed));
+    }
+    bump(m_count, other.count());
+    bump(m_sum, other.sum());
+    if (other.max() > max()) {
+        m_max.store(other.max(), std::memory_order_relaxed);
+    }
+}
+
+namespace {
+
+constexpr double QUANTILES[] = {0.5, 0.9, 0.99, 0.999};
+
+void appendHeader(std::string& out, const char* name, const char* type, const char* help) {
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+void appendSample(std::string& out, const char* name, const char* suffix, size_t loop,
+                  const char* quantile, double value) {
+    char line[160];
+    int n = quantile
+        ? std::snprintf(line, sizeof(line), "%s%s{loop=\"%zu\",quantile=\"%s\"} %.9g\n", name, suffix, loop, quantile, value)
+        : std::snprintf(line, sizeof(line), "%s%s{loop=\"%zu\"} %.9g\n", name, suffix, loop, value);
+    out.append(line, static_cast<size_t>(n));
+}
+
+// Histograms are exposed as summaries; `scale` converts recorded units
+void appendSummary(std::string& out, const char* name, const char* help,
+                   const std::vector<const LoopMetrics*>& loops,
+                   const Histogram ReactorMetrics::*member, double scale) {
+    appendHeader(out, name, "summary", help);
+    for (size_t i = 0; i < loops.size(); ++i) {
+        const Histogram& h = loops[i]->reactor.*member;
+        for (double q : QUANTILES) {
+            char label[16];
+            std::snprintf(label, sizeof(label), "%g", q);
+            appendSample(out, name, "", i, label, static_cast<double>(h.quantile(q)) * scale);
+        }
+        appendSample(out, name, "_sum", i, nullptr, static_cast<double>(h.sum()) * scale);
+        appendSample(out, name, "_count", i, nullptr, static_cast<double>(h.count()));
+    }
+}
+
+void appendCounter(std::string& out, const char* name, const char* help,
+                   const std::vector<const LoopMetrics*>& loops, const Counter LoopMetrics::*member) {
+    appendHeader(out, name, "counter", help);
+    for (size_t i = 0; i < loops.size(); ++i) {
+        appendSample(out, name, "", i, nullptr, static_cast<double>((loops[i]->*member).value()));
+    }
+}
+
+void appendGauge(std::string& out, const char* name, const char* help,
+                 const std::vector<const LoopMetrics*>& loops, const Gauge LoopMetrics::*member) {
+    appendHeader(out, name, "gauge", help);
+    for (size_t i = 0; i < loops.size(); ++i) {
+        appendSample(out, name, "", i, nullptr, static_cast<double>((loops[i]->*member).value()));
+    }
+}
+
+} // namespace
+
+void appendPrometheus(std::string& out, const std::vector<const LoopMetrics*>& loops) {
+    appendSummary(out, "reactor_poll_wait_seconds", "Time spent waiting for readiness events.",
+                  loops, &ReactorMetrics::poll_wait_ns, 1e-9);
+    appendSummary(out, "reactor_events_per_wakeup", "Events returned by each poller wait.",
+                  loops, &ReactorMetrics::events_per_wakeup, 1.0);
+    appendSummary(out, "reactor_handler_seconds", "Run time of each handler invocation.",
+                  loops, &ReactorMetrics::handler_ns, 1e-9);
+
+    appendCounter(out, "tcp_server_received_bytes_total", "Bytes read from clients.",
+                  loops, &LoopMetrics::bytes_in);
+    appendCounter(out, "tcp_server_sent_bytes_total", "Bytes written to clients.",
+                  loops, &LoopMetrics::bytes_out);
+    appendCounter(out, "tcp_server_accepted_connections_total", "Client connections accepted.",
+                  loops, &LoopMetrics::accepts);
+    appendCounter(out, "tcp_server_closed_connections_total", "Client connections closed.",
+                  loops, &LoopMetrics::closes);
+    appendCounter(out, "tcp_server_rejected_connections_total", "Connections shed at the connection limit.",
+                  loops, &LoopMetrics::rejected);
+    appendCounter(out, "tcp_server_read_pauses_total", "Times flow control stopped reading a client.",
+                  loops, &LoopMetrics::read_pauses);
+    appendCounter(out, "tcp_server_read_resumes_total", "Times flow control resumed reading a client.",
+                  loops, &LoopMetrics::read_resumes);
+    appendCounter(out, "tcp_server_zerocopy_sends_total", "Flushes sent with MSG_ZEROCOPY.",
+                  loops, &LoopMetrics::zerocopy_sends);
+    appendCounter(out, "tcp_server_zerocopy_copied_total", "Zero-copy sends the kernel copied anyway.",
+                  loops, &LoopMetrics::zerocopy_copied);
+    appendCounter(out, "tcp_server_frames_total", "Complete frames answered on the event loops.",
+                  loops, &LoopMetrics::frames);
+    appendCounter(out, "tcp_server_worker_requests_total", "Requests handed to the worker pool.",
+                  loops, &LoopMetrics::worker_requests);
+    appendCounter(out, "tcp_server_budget_pauses_total", "Times the global buffer budget stopped reading a client.",
+                  loops, &LoopMetrics::budget_pauses);
+    appendCounter(out, "tcp_server_handed_off_connections_total", "Connections passed to a successor process.",
+                  loops, &LoopMetrics::handed_off);
+    appendCounter(out, "tcp_server_tls_handshakes_total", "TLS handshakes completed.",
+                  loops, &LoopMetrics::tls_handshakes);
+    appendCounter(out, "tcp_server_tls_handshake_failures_total", "TLS handshakes that failed.",
+                  loops, &LoopMetrics::tls_failures);
+    appendCounter(out, "tcp_server_ktls_send_total", "TLS connections whose records the kernel encrypts.",
+                  loops, &LoopMetrics::ktls_send);
+    appendCounter(out, "tcp_server_ktls_recv_total", "TLS connections whose records the kernel decrypts.",
+                  loops, &LoopMetrics::ktls_recv);
+    appendCounter(out, "tcp_server_file_responses_total", "Static files sent in full.",
+                  loops, &LoopMetrics::file_responses);
+    appendCounter(out, "tcp_server_file_bytes_total", "Static file bytes sent with sendfile or from a mapping.",
+                  loops, &LoopMetrics::file_bytes);
+    appendCounter(out, "tcp_server_file_cache_hits_total", "Static file lookups served from the open-file cache.",
+                  loops, &LoopMetrics::file_cache_hits);
+    appendCounter(out, "tcp_server_file_cache_misses_total", "Static files opened.",
+                  loops, &LoopMetrics::file_cache_misses);
+    appendCounter(out, "tcp_server_read_yields_total", "Client reads cut short by the per-wakeup read budget.",
+                  loops, &LoopMetrics::read_yields);
+    appendCounter(out, "tcp_server_read_throttles_total", "Times a client ran out of read tokens.",
+                  loops, &LoopMetrics::read_throttles);
+    appendCounter(out, "tcp_server_write_throttles_total", "Times a client ran out of write tokens.",
+                  loops, &LoopMetrics::write_throttles);
+    appendCounter(out, "tcp_server_accept_throttles_total", "Times a listener ran out of connection tokens.",
+                  loops, &LoopMetrics::accept_throttles);
+    appendCounter(out, "udp_server_received_datagrams_total", "UDP datagrams received.",
+                  loops, &LoopMetrics::datagrams_in);
+    appendCounter(out, "udp_server_sent_datagrams_total", "UDP datagrams answered.",
+                  loops, &LoopMetrics::datagrams_out);
+    appendCounter(out, "udp_server_dropped_datagrams_total", "UDP datagrams dropped as oversized or unsendable.",
+                  loops, &LoopMetrics::datagrams_dropped);
+    appendCounter(out, "udp_server_receive_batches_total", "recvmmsg calls that returned datagrams.",
+                  loops, &LoopMetrics::datagram_batches);
+    appendCounter(out, "udp_server_read_yields_total", "UDP reads cut short by the per-wakeup batch limit.",
+                  loops, &LoopMetrics::datagram_yields);
+
+    appendGauge(out, "tcp_server_buffered_bytes", "Output bytes queued for clients.",
+                loops, &LoopMetrics::buffered_bytes);
+    appendGauge(out, "tcp_server_buffer_chunks", "Write-buffer chunks holding queued output.",
+                loops, &LoopMetrics::buffer_chunks);
+    appendGauge(out, "tcp_server_pooled_chunks", "Free write-buffer chunks cached for reuse.",
+                loops, &LoopMetrics::pooled_chunks);
+}
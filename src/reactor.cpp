@@ -1,123 +1,377 @@
-#include <iostream>
 #include <stdexcept>
 #include <system_error>
 #include <cerrno>
 #include <cstring>
-#include <unordered_map>
 #include <atomic>
-#include <functional>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include <pthread.h>
+#include <sched.h>
 #include <sys/epoll.h>
 #include <sys/eventfd.h>
 #include <unistd.h>
 #include "reactor.hpp"
+#include "logger.hpp"
 
-Reactor::Reactor() : m_epollFd(-1), m_shutdownFd(-1) {
-    m_epollFd = epoll_create1(0);
-    if (m_epollFd == -1) {
-        throw std::runtime_error("Failed to create epoll instance");
+namespace {
+
+uint64_t monotonicMs() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+uint64_t monotonicNs() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+} // namespace
+
+Reactor::Reactor() : Reactor(ReactorOptions{}) {}
+
+Reactor::Reactor(const ReactorOptions& options)
+    : m_options(options), m_shutdownFd(-1), m_wakeFd(-1), m_timers(monotonicMs()), m_nowMs(monotonicMs()) {
+    if (m_options.min_batch < 1 || m_options.max_batch < m_options.min_batch) {
+        throw std::invalid_argument("ReactorOptions batch bounds must satisfy 1 <= min_batch <= max_batch");
+    }
+    m_batchSize = m_options.min_batch;
+
+    if (options.backend == ReactorBackend::IoUring) {
+        m_poller = makeIoUringPoller();
+        if (!m_poller) {
+            LOG_WARN("io_uring unavailable, falling back to epoll");
+        }
+    }
+    if (!m_poller) {
+        m_poller = makeEpollPoller();
     }
 
     // Create eventfd for shutdown signaling
     m_shutdownFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
     if (m_shutdownFd == -1) {
-        close(m_epollFd);
         throw std::runtime_error("Failed to create shutdown eventfd");
     }
 
-    // Register shutdown fd with epoll
-    struct epoll_event ev;
-    ev.events = EPOLLIN;
-    ev.data.fd = m_shutdownFd;
-    if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_shutdownFd, &ev) == -1) {
+    // Register shutdown fd with the poller; a null tag marks it in dispatch
+    if (m_poller->add(m_shutdownFd, EPOLLIN, nullptr) == -1) {
         close(m_shutdownFd);
-        close(m_epollFd);
-        throw std::runtime_error("Failed to register shutdown fd with epoll");
+        throw std::runtime_error("Failed to register shutdown fd with poller");
+    }
+
+    // Posted tasks are drained by an ordinary handler living outside the fd table
+    m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_wakeFd == -1) {
+        close(m_shutdownFd);
+        throw std::runtime_error("Failed to create wakeup eventfd");
+    }
+    m_wakeSlot.handler = [this](int, uint32_t) { runPosted(); };
+    m_wakeSlot.fd = m_wakeFd;
+    m_wakeSlot.active = true;
+    if (m_poller->add(m_wakeFd, EPOLLIN, &m_wakeSlot) == -1) {
+        close(m_wakeFd);
+        close(m_shutdownFd);
+        throw std::runtime_error("Failed to register wakeup fd with poller");
     }
 }
 
 Reactor::~Reactor() {
-    m_handlers.clear();
+    m_slotPages.clear();
+    if (m_wakeFd != -1) {
+        close(m_wakeFd);
+    }
     if (m_shutdownFd != -1) {
         close(m_shutdownFd);
     }
-    if (m_epollFd != -1) {
-        close(m_epollFd);
+}
+
+void Reactor::post(Task task) {
+    m_posted.push(std::move(task));
+    wake();
+}
+
+void Reactor::wake() {
+    // Only the first post after a drain pays for the eventfd write
+    if (!m_wakePending.exchange(true, std::memory_order_acq_rel)) {
+        uint64_t one = 1;
+        write(m_wakeFd, &one, sizeof(one));
+    }
+}
+
+void Reactor::runPosted() {
+    uint64_t val;
+    read(m_wakeFd, &val, sizeof(val));
+    // Re-open the wakeup before draining: a task pushed after this point
+    // either gets popped below or writes the eventfd again. The exchange also
+    // acquires every push made before the producer saw the flag set.
+    m_wakePending.exchange(false, std::memory_order_acq_rel);
+
+    Task task;
+    size_t ran = 0;
+    while (ran < MAX_POSTED_PER_WAKEUP && m_posted.pop(task)) {
+        ++ran;
+        try {
+            task();
+        } catch (const std::exception& e) {
+            LOG_ERROR("Posted task threw: {}", e.what());
+        } catch (...) {
+            LOG_ERROR("Posted task threw an unknown exception");
+        }
+        task.reset();
+    }
+    if (ran == MAX_POSTED_PER_WAKEUP) {
+        wake();  // Possibly more queued; let this batch's other fds run first
+    }
+}
+
+Reactor::HandlerSlot* Reactor::findSlot(int fd) {
+    size_t page = static_cast<size_t>(fd) / SLOTS_PER_PAGE;
+    if (fd < 0 || page >= m_slotPages.size() || !m_slotPages[page]) {
+        return nullptr;
+    }
+    return &m_slotPages[page][static_cast<size_t>(fd) % SLOTS_PER_PAGE];
+}
+
+Reactor::HandlerSlot* Reactor::createSlot(int fd) {
+    if (fd < 0) {
+        throw std::invalid_argument("Cannot register handler for negative fd " + std::to_string(fd));
     }
+    size_t page = static_cast<size_t>(fd) / SLOTS_PER_PAGE;
+    if (page >= m_slotPages.size()) {
+        m_slotPages.resize(page + 1);
+    }
+    if (!m_slotPages[page]) {
+        m_slotPages[page].reset(new HandlerSlot[SLOTS_PER_PAGE]);
+    }
+    return &m_slotPages[page][static_cast<size_t>(fd) % SLOTS_PER_PAGE];
 }
 
 void Reactor::registerHandler(int fd, uint32_t events, EventHandler handler) {
-    if(m_handlers.find(fd) != m_handlers.end()) {
+    HandlerSlot* slot = createSlot(fd);
+    if (slot->active) {
         throw std::runtime_error("Handler already registered for fd " + std::to_string(fd));
     }
-    struct epoll_event ev;
-    ev.events = events;
-    ev.data.fd = fd;
-    if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fd, &ev) == -1) {
-        if(errno == EEXIST) { // Ignore if already registered
-            if(epoll_ctl(m_epollFd, EPOLL_CTL_MOD, fd, &ev) == -1) {
-                std::cerr << "Warning: Failed to modify fd " << fd << " in epoll: " << std::strerror(errno) << std::endl;
-                return;
-            }
+    if (m_poller->add(fd, events, slot) == -1) {
+        if (errno != EEXIST) {
+            LOG_WARN("Failed to register fd {} with poller: {}", fd, LogErrno{errno});
+            return;
+        }
+        // Left in the poller by someone else; take it over
+        if (m_poller->modify(fd, events, slot) == -1) {
+            LOG_WARN("Failed to modify fd {} in poller: {}", fd, LogErrno{errno});
+            return;
         }
-        std::cerr << "Warning: Failed to register fd " << fd << " with epoll: " << std::strerror(errno) << std::endl;
-        return;
     }
-    m_handlers[fd] = std::move(handler);
-
+    slot->handler = std::move(handler);
+    slot->fd = fd;
+    slot->active = true;
 }
 
 void Reactor::unregisterHandler(int fd) {
-    if (epoll_ctl(m_epollFd, EPOLL_CTL_DEL, fd, nullptr) == -1) {
-        std::cerr << "Warning: Failed to unregister fd " << fd << " from epoll: " << std::strerror(errno) << std::endl;
+    if (m_poller->remove(fd) == -1) {
+        LOG_WARN("Failed to unregister fd {} from poller: {}", fd, LogErrno{errno});
         return;
     }
-    m_handlers.erase(fd);
+    HandlerSlot* slot = findSlot(fd);
+    if (slot == nullptr) {
+        return;
+    }
+    slot->active = false;
+    slot->deferred = 0;     // A stale ready-queue entry finds nothing owed
+    // A handler unregistering itself is still running; run() drops it afterwards
+    if (slot != m_dispatching) {
+        slot->handler.reset();
+    }
 }
 
 void Reactor::modifyHandler(int fd, uint32_t events) {
-    struct epoll_event ev;
-    ev.events = events;
-    ev.data.fd = fd;
-    if (epoll_ctl(m_epollFd, EPOLL_CTL_MOD, fd, &ev) == -1) {
-        std::cerr << "Warning: Failed to modify fd " << fd << " in epoll: " << std::strerror(errno) << std::endl;
+    HandlerSlot* slot = findSlot(fd);
+    if (slot == nullptr || !slot->active) {
+        LOG_WARN("Failed to modify fd {} in poller: no handler registered", fd);
+        return;
+    }
+    if (m_poller->modify(fd, events, slot) == -1) {
+        LOG_WARN("Failed to modify fd {} in poller: {}", fd, LogErrno{errno});
+    }
+}
+
+void Reactor::defer(int fd, uint32_t events) {
+    HandlerSlot* slot = findSlot(fd);
+    if (slot == nullptr || !slot->active || events == 0) {
+        return;
+    }
+    slot->deferred |= events;
+    if (!slot->queued) {
+        slot->queued = true;
+        m_ready.push_back(slot);
     }
 }
 
 void Reactor::run() {
-    const int MAX_EVENTS = 10;
-    struct epoll_event events[MAX_EVENTS];
+    // Sized for the largest batch up front so adapting never reallocates
+    std::vector<struct epoll_event> events(static_cast<size_t>(m_options.max_batch));
     bool running = true;
+    pinThread();
 
     while (running) {
-        int nfds = epoll_wait(m_epollFd, events, MAX_EVENTS, -1); // Blocking wait
+        // Expire due timers, then block no longer than the next deadline
+        m_nowMs = monotonicMs();
+        m_timers.advance(m_nowMs);
+        // Deferred handlers are ready now; only collect what else is
+        int timeout = m_ready.empty() ? m_timers.nextTimeout(m_nowMs) : 0;
+
+        uint64_t wait_start = m_metrics ? monotonicNs() : 0;
+        if (m_recorder) {
+            m_recorder->record(TraceEvent::Wait);
+        }
+        int nfds = waitForEvents(events.data(), timeout);
+        m_nowMs = monotonicMs();
         if (nfds == -1) {
             if(errno == EINTR) {
                 continue; // Interrupted by signal, retry
             }
-            throw std::runtime_error("epoll_wait failed: " + std::string(std::strerror(errno)));
+            throw std::runtime_error("Poller wait failed: " + std::string(std::strerror(errno)));
+        }
+        if (m_recorder) {
+            m_recorder->record(TraceEvent::Wakeup, -1, static_cast<uint32_t>(nfds));
+        }
+        if (m_metrics) {
+            m_metrics->poll_wait_ns.record(monotonicNs() - wait_start);
+            m_metrics->events_per_wakeup.record(static_cast<uint64_t>(nfds));
         }
+        adaptBatchSize(nfds);
 
         for (int i = 0; i < nfds; ++i) {
-            int fd = events[i].data.fd;
+            auto* slot = static_cast<HandlerSlot*>(events[i].data.ptr);
             
             // Check if this is the shutdown signal
-            if (fd == m_shutdownFd) {
+            if (slot == nullptr) {
                 uint64_t val;
                 read(m_shutdownFd, &val, sizeof(val)); // Drain the eventfd
                 running = false;
                 break;
             }
             
-            auto it = m_handlers.find(fd);
-            if (it != m_handlers.end()) {
-                try {
-                    it->second(fd, events[i].events);
-                } catch (const std::exception& e) {
-                    std::cerr << "Handler for fd " << fd << " threw: " << e.what() << std::endl;
-                } catch (...) {
-                    std::cerr << "Handler for fd " << fd << " threw an unknown exception" << std::endl;
-                }
+            // Skip fds unregistered by an earlier handler in this batch
+            if (!slot->active) {
+                continue;
             }
+            // Deliver anything it still had queued along with this event
+            uint32_t pending = events[i].events | slot->deferred;
+            slot->deferred = 0;
+            dispatch(slot, pending);
+        }
+        if (running) {
+            runReady();
+        }
+    }
+}
+
+void Reactor::runReady() {
+    // Handlers deferring themselves while this pass runs wait for the next
+    // one, after another look at the poller
+    m_readyRunning.swap(m_ready);
+    for (HandlerSlot* slot : m_readyRunning) {
+        slot->queued = false;
+        uint32_t events = slot->deferred;
+        if (!slot->active || events == 0) {
+            continue;   // Unregistered, or already served by a poller event
         }
+        slot->deferred = 0;
+        dispatch(slot, events);
+    }
+    m_readyRunning.clear();
+}
+
+void Reactor::dispatch(HandlerSlot* slot, uint32_t events) {
+    m_dispatching = slot;
+    uint64_t handler_start = m_metrics ? monotonicNs() : 0;
+    if (m_recorder) {
+        m_recorder->record(TraceEvent::HandlerEnter, slot->fd, events);
     }
+    try {
+        slot->handler(slot->fd, events);
+    } catch (const std::exception& e) {
+        LOG_ERROR("Handler for fd {} threw: {}", slot->fd, e.what());
+    } catch (...) {
+        LOG_ERROR("Handler for fd {} threw an unknown exception", slot->fd);
+    }
+    if (m_metrics) {
+        m_metrics->handler_ns.record(monotonicNs() - handler_start);
+    }
+    if (m_recorder) {
+        m_recorder->record(TraceEvent::HandlerExit, slot->fd);
+    }
+    m_dispatching = nullptr;
+    if (!slot->active) {
+        slot->handler.reset();
+    }
+}
+
+int Reactor::waitForEvents(struct epoll_event* events, int timeout) {
+    if (m_options.spin_us == 0 || timeout == 0) {
+        return m_poller->wait(events, m_batchSize, timeout);
+    }
+
+    // Spin on zero-timeout waits so a wakeup costs no scheduler round trip
+    const auto start = std::chrono::steady_clock::now();
+    const auto deadline = start + std::chrono::microseconds(m_options.spin_us);
+    do {
+        int nfds = m_poller->wait(events, m_batchSize, 0);
+        if (nfds != 0) {
+            return nfds;
+        }
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    } while (std::chrono::steady_clock::now() < deadline);
+
+    if (timeout > 0) {
+        // The spin used up part of the timeout; rounded up, since waking a
+        // little early only costs another wait while waking late delays timers
+        const auto spun = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start + std::chrono::microseconds(999));
+        timeout = std::max(0, timeout - static_cast<int>(spun.count()));
+    }
+    return m_poller->wait(events, m_batchSize, timeout);
+}
+
+void Reactor::adaptBatchSize(int nfds) {
+    if (nfds == m_batchSize) {
+        // A full batch means more events were likely left behind
+        m_batchSize = std::min(m_batchSize * 2, m_options.max_batch);
+        m_underfilledWaits = 0;
+    } else if (nfds < m_batchSize / 4) {
+        if (++m_underfilledWaits >= 64) {
+            m_batchSize = std::max(m_batchSize / 2, m_options.min_batch);
+            m_underfilledWaits = 0;
+        }
+    } else {
+        m_underfilledWaits = 0;
+    }
+}
+
+void Reactor::pinThread() {
+    if (m_options.cpu_affinity < 0) {
+        return;
+    }
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(m_options.cpu_affinity, &cpus);
+    int rc = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    if (rc != 0) {
+        LOG_WARN("Failed to pin reactor thread to CPU {}: {}", m_options.cpu_affinity, LogErrno{rc});
+    }
+}
+
+Reactor::TimerId Reactor::addTimer(uint64_t delay_ms, TimerCallback callback) {
+    return m_timers.add(m_nowMs + delay_ms, std::move(callback));
+}
+
+bool Reactor::cancelTimer(TimerId id) {
+    return m_timers.cancel(id);
+}
+
+bool Reactor::resetTimer(TimerId id, uint64_t delay_ms) {
+    return m_timers.reset(id, m_nowMs + delay_ms);
 }
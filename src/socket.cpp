@@ -2,18 +2,40 @@
 #include <stdexcept>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <system_error>
 #include <cerrno>
 #include <cstring>
+#include <string>
 #include "socket.hpp"
 
 
-Socket::Socket() : m_fd(-1) {
-    m_fd = socket(AF_INET, SOCK_STREAM, 0);
+SocketOptions SocketOptions::lowLatency() {
+    SocketOptions options;
+    options.tcp_nodelay = true;
+    return options;
+}
+
+SocketOptions SocketOptions::highThroughput() {
+    SocketOptions options;
+    options.send_buffer = 1024 * 1024;
+    options.recv_buffer = 1024 * 1024;
+    return options;
+}
+
+Socket::Socket() : Socket(SocketType::Stream) {
+}
+
+Socket::Socket(SocketType type) : Socket(AddressFamily::IPv4, type) {
+}
+
+Socket::Socket(AddressFamily family, SocketType type) : m_fd(-1) {
+    int domain = family == AddressFamily::IPv6 ? AF_INET6 : family == AddressFamily::Unix ? AF_UNIX : AF_INET;
+    m_fd = socket(domain, type == SocketType::Datagram ? SOCK_DGRAM : SOCK_STREAM, 0);
     if (m_fd == -1) {
-        throw std::runtime_error("Failed to create socket");
+        throw std::runtime_error("Failed to create socket: " + std::string(std::strerror(errno)));
     }
 }
 
@@ -58,17 +80,90 @@ void Socket::setReuseAddr() {
     }
 }
 
+void Socket::setReusePort() {
+    int opt = 1;
+    if (setsockopt(m_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) == -1) {
+        throw std::runtime_error("Failed to set SO_REUSEPORT");
+    }
+}
+
+void Socket::setBusyPoll(int usec) {
+    // Raising the value above net.core.busy_read needs CAP_NET_ADMIN
+    if (setsockopt(m_fd, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec)) == -1) {
+        throw std::runtime_error("Failed to set SO_BUSY_POLL: " + std::string(std::strerror(errno)));
+    }
+}
+
+void Socket::setNoDelay() {
+    int opt = 1;
+    if (setsockopt(m_fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt)) == -1) {
+        throw std::runtime_error("Failed to set TCP_NODELAY: " + std::string(std::strerror(errno)));
+    }
+}
+
+void Socket::setDeferAccept(int seconds) {
+    if (setsockopt(m_fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &seconds, sizeof(seconds)) == -1) {
+        throw std::runtime_error("Failed to set TCP_DEFER_ACCEPT: " + std::string(std::strerror(errno)));
+    }
+}
+
+void Socket::setSendBuffer(int bytes) {
+    if (setsockopt(m_fd, SOL_SOCKET, SO_SNDBUF, &bytes, sizeof(bytes)) == -1) {
+        throw std::runtime_error("Failed to set SO_SNDBUF: " + std::string(std::strerror(errno)));
+    }
+}
+
+void Socket::setRecvBuffer(int bytes) {
+    if (setsockopt(m_fd, SOL_SOCKET, SO_RCVBUF, &bytes, sizeof(bytes)) == -1) {
+        throw std::runtime_error("Failed to set SO_RCVBUF: " + std::string(std::strerror(errno)));
+    }
+}
+
+void Socket::setZeroCopy() {
+    int opt = 1;
+    if (setsockopt(m_fd, SOL_SOCKET, SO_ZEROCOPY, &opt, sizeof(opt)) == -1) {
+        throw std::runtime_error("Failed to set SO_ZEROCOPY: " + std::string(std::strerror(errno)));
+    }
+}
+
+void Socket::apply(const SocketOptions& options) {
+    const bool inet = family() != AddressFamily::Unix;
+    if (options.tcp_nodelay && inet) setNoDelay();
+    if (options.defer_accept_s > 0 && inet) setDeferAccept(options.defer_accept_s);
+    if (options.send_buffer > 0) setSendBuffer(options.send_buffer);
+    if (options.recv_buffer > 0) setRecvBuffer(options.recv_buffer);
+    if (options.zerocopy && inet) setZeroCopy();
+}
+
 void Socket::bind(int port) {
-    sockaddr_in addr{};
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = INADDR_ANY;
-    addr.sin_port = htons(port);
+    bind(Endpoint::any(port));
+}
+
+void Socket::bind(const Endpoint& endpoint) {
+    if (endpoint.family() == AddressFamily::IPv6) {
+        int v6only = endpoint.dualStack() ? 0 : 1;
+        if (setsockopt(m_fd, IPPROTO_IPV6, IPV6_V6ONLY, &v6only, sizeof(v6only)) == -1) {
+            throw std::runtime_error("Failed to set IPV6_V6ONLY: " + std::string(std::strerror(errno)));
+        }
+    }
+    if (::bind(m_fd, endpoint.address(), endpoint.length()) == -1) {
+        throw std::runtime_error("Failed to bind socket to " + endpoint.toString() + ": " + std::strerror(errno));
+    }
+}
 
-    if (::bind(m_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1) {
-        throw std::runtime_error("Failed to bind socket");
+void Socket::connect(const Endpoint& endpoint) {
+    if (::connect(m_fd, endpoint.address(), endpoint.length()) == -1 && errno != EINPROGRESS) {
+        throw std::runtime_error("Failed to connect to " + endpoint.toString() + ": " + std::strerror(errno));
     }
 }
 
+AddressFamily Socket::family() const {
+    int domain = AF_INET;
+    socklen_t len = sizeof(domain);
+    getsockopt(m_fd, SOL_SOCKET, SO_DOMAIN, &domain, &len);
+    return domain == AF_INET6 ? AddressFamily::IPv6 : domain == AF_UNIX ? AddressFamily::Unix : AddressFamily::IPv4;
+}
+
 void Socket::listen() {
     if (::listen(m_fd, SOMAXCONN) == -1) {
         throw std::runtime_error("Failed to listen on socket");
@@ -77,11 +172,6 @@ void Socket::listen() {
 
 int Socket::getPort() const {
     if (m_fd == -1) return 0;
-    sockaddr_in addr{};
-    socklen_t len = sizeof(addr);
-    if (getsockname(m_fd, reinterpret_cast<sockaddr*>(&addr), &len) == -1) {
-        throw std::system_error(errno, std::generic_category(), std::string("getsockname failed: ") + std::strerror(errno));
-    }
-    return ntohs(addr.sin_port);
+    return localEndpoint().port();
 }
 
@@ -1,190 +1,1595 @@
-#include <iostream>
 #include <stdexcept>
 #include <memory>
-#include <unordered_map>
 #include <vector>
-#include <algorithm>
+#include <thread>
 #include <atomic>
 #include <cstring>
 #include <csignal>
 #include <cerrno>
+#include <cstdint>
+#include <string_view>
+#include <algorithm>
+#include <cstdio>
+#include <fcntl.h>
 #include <unistd.h>
 #include <sys/socket.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
 #include <netinet/in.h>
 #include "tcp_server.hpp"
+#include "logger.hpp"
 
 
-TCPServer::TCPServer(int port): m_reactor(){
-    m_listen_socket.setReuseAddr();
-    m_listen_socket.setNonBlocking();
-    m_listen_socket.bind(port);
-    m_listen_socket.listen();
+namespace {
 
-    m_reactor.registerHandler(m_listen_socket.getFd(), EPOLLIN|EPOLLET, [this](int fd, uint32_t events) {
-        handleNewConnection(fd);
-        (void)events; // Unused
-    });
+// A socket file left behind by a server that died refuses connections; one
+// that is still being served must not be pulled from under it
+void removeStaleSocketFile(const Endpoint& endpoint) {
+    Socket probe(AddressFamily::Unix);
+    if (::connect(probe.getFd(), endpoint.address(), endpoint.length()) == -1 && errno == ECONNREFUSED) {
+        unlink(endpoint.path().c_str());
+    }
+}
+
+} // namespace
+
+TCPServer::TCPServer(int port, const ServerConfig& config) : TCPServer(Endpoint::any(port), config) {
+}
+
+TCPServer::TCPServer(const Endpoint& endpoint, const ServerConfig& config)
+    : m_config(config),
+      m_endpoint(endpoint),
+      m_transform(config.transform ? config.transform : selectUppercaseKernel()) {
+    if (m_config.num_loops == 0) {
+        throw std::invalid_argument("ServerConfig::num_loops must be at least 1");
+    }
+    if (m_config.accept_budget == 0) {
+        throw std::invalid_argument("ServerConfig::accept_budget must be at least 1");
+    }
+    // A file may hold any byte, so only a length prefix can frame it
+    if (!m_config.static_root.empty() &&
+        (m_config.framing != Framing::LengthPrefix || m_config.worker_threads > 0)) {
+        throw std::invalid_argument("ServerConfig::static_root needs Framing::LengthPrefix and no worker_threads");
+    }
+    const bool unix_domain = endpoint.family() == AddressFamily::Unix;
+    if (unix_domain && m_config.zerocopy_threshold > 0) {
+        // Unix sockets never post MSG_ZEROCOPY completions; buffers would pin forever
+        LOG_WARN("Zero-copy sends are TCP-only, disabled for {}", endpoint.toString());
+        m_config.zerocopy_threshold = 0;
+    }
+    if (!m_config.tls.cert_file.empty()) {
+        m_tls = std::make_unique<TlsContext>(m_config.tls);
+        if (m_config.zerocopy_threshold > 0) {
+            // Records are encrypted into fresh buffers (or by kTLS), never sent from ours
+            LOG_WARN("Zero-copy sends do not apply to TLS connections, disabled");
+            m_config.zerocopy_threshold = 0;
+        }
+    }
+    // A predecessor listening on handoff_path passes its live sockets over
+    InheritedSockets inherited;
+    const bool inheriting = !m_config.handoff_path.empty() && inheritSockets(m_config.handoff_path, inherited);
+    const bool reuse_port = m_config.num_loops > 1 && !unix_domain;
+    bool busy_poll = m_config.socket_options.busy_poll_us > 0;
+
+    for (size_t i = 0; i < m_config.num_loops; ++i) {
+        ReactorOptions options = m_config.reactor;
+        if (!m_config.loop_cpus.empty()) {
+            options.cpu_affinity = m_config.loop_cpus[i % m_config.loop_cpus.size()];
+        }
+        auto loop = std::make_unique<EventLoop>(options, m_config.pooled_chunks);
+        loop->read_tokens = TokenBucket(m_config.listener_read_bytes, loop->reactor.now());
+        loop->write_tokens = TokenBucket(m_config.listener_write_bytes, loop->reactor.now());
+        loop->accept_tokens = TokenBucket(m_config.listener_accepts, loop->reactor.now());
+        if (m_config.trace_events > 0) {
+            loop->recorder = std::make_unique<FlightRecorder>(m_config.trace_events);
+            loop->reactor.setRecorder(loop->recorder.get());
+        }
+        if (inheriting) {
+            // Already bound, listening and configured; with fewer sockets than
+            // loops, the extra loops share one through a duplicate fd
+            if (i < inherited.listeners.size()) {
+                loop->listen_socket = std::move(inherited.listeners[i]);
+            } else {
+                int source = m_loops[i % inherited.listeners.size()]->listen_socket.getFd();
+                loop->listen_socket = Socket(fcntl(source, F_DUPFD_CLOEXEC, 0));
+                if (loop->listen_socket.getFd() == -1) {
+                    throw std::runtime_error("Failed to duplicate inherited listener: " + std::string(std::strerror(errno)));
+                }
+            }
+            loop->listen_socket.setNonBlocking();
+        } else if (i > 0 && !reuse_port) {
+            // One accept queue shared by every loop; accept4 copes with losing the race
+            loop->listen_socket = Socket(fcntl(m_loops.front()->listen_socket.getFd(), F_DUPFD_CLOEXEC, 0));
+            if (loop->listen_socket.getFd() == -1) {
+                throw std::runtime_error("Failed to duplicate listener: " + std::string(std::strerror(errno)));
+            }
+        } else {
+            loop->listen_socket = openListener(reuse_port, busy_poll);
+        }
+        if (i == 0) {
+            m_endpoint = loop->listen_socket.localEndpoint();
+            m_ownsPath = !m_endpoint.path().empty();
+        }
+
+        registerListener(*loop, loop->listen_socket.getFd());
+        m_loops.push_back(std::move(loop));
+    }
+
+    if (inheriting) {
+        // Every inherited SO_REUSEPORT socket has its own accept queue, so
+        // none may be dropped; surplus ones join the loops round-robin
+        for (size_t i = m_loops.size(); i < inherited.listeners.size(); ++i) {
+            EventLoop& loop = *m_loops[i % m_loops.size()];
+            inherited.listeners[i].setNonBlocking();
+            registerListener(loop, inherited.listeners[i].getFd());
+            loop.extra_listeners.push_back(std::move(inherited.listeners[i]));
+        }
+        for (size_t i = 0; i < inherited.clients.size(); ++i) {
+            EventLoop& loop = *m_loops[i % m_loops.size()];
+            int client_fd = inherited.clients[i].release();
+            if (admitConnection(loop, client_fd)) {
+                addClient(loop, client_fd);
+            }
+        }
+        LOG_INFO("Took over {} listening socket(s) and {} connection(s) from {}",
+                 inherited.listeners.size(), inherited.clients.size(), m_config.handoff_path);
+    }
+
+    if (m_config.udp_port >= 0) {
+        UDPServerOptions udp = m_config.udp;
+        udp.reuse_port = udp.reuse_port || reuse_port;
+        udp.transform = m_transform;
+        for (size_t i = 0; i < m_loops.size(); ++i) {
+            EventLoop& loop = *m_loops[i];
+            int udp_port = i == 0 ? m_config.udp_port : m_loops.front()->udp->getPort();
+            loop.udp = std::make_unique<UDPServer>(loop.reactor, udp_port, udp, &loop.metrics);
+        }
+    }
+
+    m_framer = makeFramer(m_config.framing, m_config.max_frame_size);
+    if (!m_config.static_root.empty()) {
+        for (auto& loop : m_loops) {
+            loop->files = std::make_unique<FileCache>(m_config.static_root, m_config.file_cache_entries,
+                                                      m_config.file_revalidate_ms, &loop->metrics.file_cache_hits,
+                                                      &loop->metrics.file_cache_misses);
+        }
+    }
+    if (m_config.worker_threads > 0) {
+        if (!m_config.request_handler) {
+            PayloadTransform transform = m_transform;
+            m_config.request_handler = [transform](std::string& payload) {
+                transform(payload.data(), &payload[0], payload.size());
+            };
+        }
+        m_workers = std::make_unique<WorkerPool>(m_config.worker_threads);
+    }
+
+    if (m_config.admin_port >= 0) {
+        for (auto& loop : m_loops) {
+            loop->reactor.setMetrics(&loop->metrics.reactor);
+        }
+        m_admin = std::make_unique<AdminListener>(m_loops.front()->reactor, m_config.admin_port,
+                                                  [this](std::string& body) { renderMetrics(body); });
+    }
+
+    if (!m_config.handoff_path.empty()) {
+        m_handoff = std::make_unique<HandoffListener>(m_loops.front()->reactor, m_config.handoff_path,
+                                                      [this](Socket& channel) { handOff(channel); },
+                                                      m_config.handoff_uid);
+    }
+
+    if (m_config.trace_events > 0) {
+        if (m_config.trace_path.empty()) {
+            m_config.trace_path = "/tmp/tcp_server_trace_" + std::to_string(getpid()) + ".json";
+        }
+        m_traceFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (m_traceFd == -1) {
+            throw std::runtime_error("Failed to create trace eventfd: " + std::string(std::strerror(errno)));
+        }
+        m_loops.front()->reactor.registerHandler(m_traceFd, EPOLLIN, [this](int, uint32_t) { dumpTrace(); });
+    }
+}
+
+void TCPServer::renderMetrics(std::string& out) const {
+    std::vector<const LoopMetrics*> loops;
+    loops.reserve(m_loops.size());
+    for (const auto& loop : m_loops) {
+        loops.push_back(&loop->metrics);
+    }
+    appendPrometheus(out, loops);
 }
 
 void TCPServer::start() {
-    m_reactor.run();
+    {
+        std::lock_guard<std::mutex> lock(m_traceMutex);
+        for (auto& loop : m_loops) {
+            loop->exited = false;
+        }
+    }
+    std::vector<std::thread> threads;
+    threads.reserve(m_loops.size() - 1);
+    for (size_t i = 1; i < m_loops.size(); ++i) {
+        threads.emplace_back([this, i] {
+            try {
+                m_loops[i]->reactor.run();
+            } catch (const std::exception& e) {
+                LOG_ERROR("Event loop {} failed: {}", i, e.what());
+                // Take the whole server down rather than silently losing a loop
+                uint64_t val = 1;
+                write(getShutdownFd(), &val, sizeof(val));
+            }
+            loopExited(i);
+        });
+    }
+
+    try {
+        m_loops.front()->reactor.run();
+    } catch (...) {
+        loopExited(0);
+        signalLoops(1);
+        for (auto& t : threads) t.join();
+        throw;
+    }
+    loopExited(0);
+
+    // The primary loop owns the shutdown fd the signal handler writes to;
+    // fan that signal out to every other loop before waiting for them. After
+    // a handoff the primary only stops by itself once every loop has
+    // drained, so this reaches loops still draining only on a real shutdown.
+    signalLoops(1);
+    for (auto& t : threads) t.join();
+}
+
+TCPServer::~TCPServer() {
+    if (m_traceWriter.joinable()) {
+        m_traceWriter.join();
+    }
+    if (m_traceFd != -1) {
+        close(m_traceFd);
+    }
+    if (m_ownsPath && !m_handedOff.load(std::memory_order_relaxed)) {
+        unlink(m_endpoint.path().c_str());
+    }
+}
+
+Socket TCPServer::openListener(bool reuse_port, bool& busy_poll) {
+    Socket listener(m_endpoint.family());
+    listener.setReuseAddr();
+    if (reuse_port) {
+        listener.setReusePort();
+    }
+    listener.setNonBlocking();
+    SocketOptions socket_options = m_config.socket_options;
+    socket_options.zerocopy = socket_options.zerocopy || m_config.zerocopy_threshold > 0;
+    listener.apply(socket_options);
+    if (busy_poll) {
+        try {
+            listener.setBusyPoll(m_config.socket_options.busy_poll_us);
+        } catch (const std::exception& e) {
+            // Typically EPERM without CAP_NET_ADMIN; report once and carry on without it
+            LOG_WARN("{}, busy polling disabled", e.what());
+            busy_poll = false;
+        }
+    }
+    if (!m_endpoint.path().empty()) {
+        removeStaleSocketFile(m_endpoint);
+    }
+    // Port 0 lets the kernel choose; by the time later loops get here
+    // m_endpoint holds the port loop 0 was given
+    listener.bind(m_endpoint);
+    listener.listen();
+    return listener;
 }
 
 int TCPServer::getPort() const {
-    return m_listen_socket.getPort();
+    return m_endpoint.port();
+}
+
+void TCPServer::signalLoops(size_t first) {
+    uint64_t val = 1;
+    for (size_t i = first; i < m_loops.size(); ++i) {
+        write(m_loops[i]->reactor.getShutdownFd(), &val, sizeof(val));
+    }
 }
 
-void TCPServer::handleNewConnection(int fd) {
-    sockaddr_in client_addr{};
-    socklen_t client_len = sizeof(client_addr);
-    while(true) {
-        int client_fd = accept(fd, reinterpret_cast<sockaddr*>(&client_addr), &client_len);
+void TCPServer::handleNewConnection(EventLoop& loop, int fd) {
+    // Bounded so a connection storm cannot starve the clients already being served
+    for (size_t accepted = 0; accepted < m_config.accept_budget; ++accepted) {
+        if (loop.accept_tokens.available(loop.reactor.now()) == 0) {
+            throttleAccepts(loop, fd);
+            return;
+        }
+        // Non-blocking and close-on-exec in one syscall; every other socket
+        // option was inherited from the listener
+        int client_fd = accept4(fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
         if (client_fd == -1) {
             if (errno == EAGAIN || errno == EWOULDBLOCK) {
                 // No more incoming connections
-                break;
-            } else {
-                std::cerr << "Failed to accept new connection: " << std::strerror(errno) << std::endl;
-                break;
+                return;
+            }
+            if (errno == ECONNABORTED || errno == EINTR) {
+                continue;
             }
+            LOG_WARN("Failed to accept new connection: {}", LogErrno{errno});
+            return;
+        }
+        loop.accept_tokens.consume(1);
+        loop.trace(TraceEvent::Accept, client_fd);
+
+        if (!admitConnection(loop, client_fd)) {
+            continue;
         }
 
-        std::unique_ptr<Socket> client_socket = std::make_unique<Socket>(client_fd);
-        client_socket->setNonBlocking();
+        loop.metrics.accepts.add();
+        addClient(loop, client_fd);
+        LOG_DEBUG("Accepted new connection, fd: {}", client_fd);
+    }
+
+    // Budget spent with connections possibly still queued. The listener is
+    // edge-triggered, so re-arm it to be reported again after this batch.
+    loop.reactor.modifyHandler(fd, EPOLLIN | EPOLLET);
+}
+
+void TCPServer::registerListener(EventLoop& loop, int fd) {
+    EventLoop* lp = &loop;
+    loop.reactor.registerHandler(fd, EPOLLIN | EPOLLET, [this, lp](int listen_fd, uint32_t) {
+        handleNewConnection(*lp, listen_fd);
+    });
+}
+
+void TCPServer::addClient(EventLoop& loop, int client_fd) {
+    ClientHandle handle = loop.clients.emplace(client_fd, &loop.chunk_pool);
+    ClientState& client = *loop.clients.get(handle);
+    client.handle = handle;
+    if (static_cast<size_t>(client_fd) >= loop.client_fds.size()) {
+        loop.client_fds.resize(std::max(loop.client_fds.size() * 2, static_cast<size_t>(client_fd) + 1));
+    }
+    loop.client_fds[static_cast<size_t>(client_fd)] = handle;
+    if (m_tls) {
+        client.tls = std::make_unique<TlsSession>(*m_tls, client_fd);
+    }
+    client.read_tokens = TokenBucket(m_config.client_read_bytes, loop.reactor.now());
+    client.write_tokens = TokenBucket(m_config.client_write_bytes, loop.reactor.now());
+    armTimeout(loop, client.handle, client.idle_timer, m_config.idle_timeout_ms, "idle timeout");
+    armTimeout(loop, client.handle, client.read_timer, m_config.read_timeout_ms, "read timeout");
+
+    loop.reactor.registerHandler(client_fd, EPOLLIN|EPOLLET, [this, &loop, handle](int cfd, uint32_t events) {
+        ClientState* state = loop.clients.get(handle);
+        if (state == nullptr) return;
+
+        // Zero-copy completions arrive on the error queue and raise EPOLLERR
+        if ((events & EPOLLERR) && m_config.zerocopy_threshold > 0 && reapZeroCopy(loop, cfd, *state)) {
+            events &= ~static_cast<uint32_t>(EPOLLERR);
+        }
+
+        if(events & (EPOLLHUP | EPOLLERR )) {
+            LOG_INFO("Client fd {} closed or error occurred", cfd);
+            cleanupClient(loop, cfd);
+            return;
+        }
+
+        if (state->tls && !state->tls->established()) {
+            continueHandshake(loop, cfd, *state, events);
+            return;
+        }
+
+        // If we have buffered data, try to write it first
+        if (events & EPOLLOUT) {
+            handleClientWrite(loop, cfd);
+        }
+
+        // Then handle any incoming data
+        if (events & EPOLLIN) {
+            handleClientData(loop, cfd);
+        }
         
-        ClientState state;
-        state.socket = std::move(client_socket);
-        m_clients[client_fd] = std::move(state);
+    });
+}
 
-        m_reactor.registerHandler(client_fd, EPOLLIN|EPOLLET, [this](int cfd, uint32_t events) {
-            auto it = m_clients.find(cfd);
-            if (it == m_clients.end()) return;
+ClientState* TCPServer::findClient(EventLoop& loop, int fd) {
+    if (fd < 0 || static_cast<size_t>(fd) >= loop.client_fds.size()) {
+        return nullptr;
+    }
+    return loop.clients.get(loop.client_fds[static_cast<size_t>(fd)]);
+}
 
-            if(events & (EPOLLHUP | EPOLLERR )) {
-                std::cerr << "Client fd " << cfd << " closed or error occurred" << std::endl;
-                cleanupClient(cfd);
-                return;
-            }
+bool TCPServer::admitConnection(EventLoop& loop, int client_fd) {
+    size_t current = m_connectionCount.load(std::memory_order_relaxed);
+    do {
+        if (m_config.max_connections != 0 && current >= m_config.max_connections) {
+            // Shed with an orderly close so the client sees EOF instead of a hang
+            loop.metrics.rejected.add();
+            close(client_fd);
+            LOG_DEBUG("Connection limit {} reached, rejected fd {}", m_config.max_connections, client_fd);
+            return false;
+        }
+    } while (!m_connectionCount.compare_exchange_weak(current, current + 1, std::memory_order_relaxed));
+    return true;
+}
 
-            // If we have buffered data, try to write it first
-            if (events & EPOLLOUT) {
-                handleClientWrite(cfd);
-            }
+void TCPServer::continueHandshake(EventLoop& loop, int fd, ClientState& state, uint32_t events) {
+    switch (state.tls->handshake()) {
+    case TlsStatus::WantRead:
+        if (events & EPOLLOUT) {
+            setInterest(loop, fd, state, EPOLLIN | EPOLLET);
+        }
+        return;
+    case TlsStatus::WantWrite:
+        setInterest(loop, fd, state, EPOLLOUT | EPOLLET);
+        return;
+    case TlsStatus::Failed:
+        loop.metrics.tls_failures.add();
+        LOG_DEBUG("TLS handshake failed on fd {}", fd);
+        cleanupClient(loop, fd);
+        return;
+    case TlsStatus::Done:
+        break;
+    }
+    loop.metrics.tls_handshakes.add();
+    if (state.tls->kernelSend()) {
+        loop.metrics.ktls_send.add();
+    }
+    if (state.tls->kernelRecv()) {
+        loop.metrics.ktls_recv.add();
+    }
+    if (events & EPOLLOUT) {
+        setInterest(loop, fd, state, EPOLLIN | EPOLLET);
+    }
+    // The first request may have arrived right behind the client's Finished
+    handleClientData(loop, fd);
+}
 
-            // Then handle any incoming data
-            if (events & EPOLLIN) {
-                handleClientData(cfd);
-            }
-            
-        });
+ssize_t TCPServer::readClient(ClientState& state, int fd, char* data, size_t len) {
+    if (state.tls && !state.tls->kernelRecv()) {
+        return state.tls->read(data, len);
+    }
+    return read(fd, data, len);
+}
 
-        std::cout << "Accepted new connection, fd: " << client_fd << std::endl;
+ssize_t TCPServer::writeClient(ClientState& state, int fd, bool zerocopy, size_t limit) {
+    WriteBuffer& buffer = state.write_buffer;
+    if (state.tls && !state.tls->kernelSend()) {
+        // SSL_write takes one range; with partial writes on it returns after
+        // every record that made it out
+        std::string_view front = buffer.front();
+        ssize_t written = state.tls->write(front.data(), std::min(front.size(), limit));
+        if (written > 0) {
+            buffer.consume(static_cast<size_t>(written));
+        }
+        return written;
     }
+    return zerocopy ? buffer.writeZeroCopy(fd, limit) : buffer.writeTo(fd, limit);
 }
 
-void TCPServer::handleClientData(int fd) {
-    auto it = m_clients.find(fd);
-    if (it == m_clients.end()) return;
+void TCPServer::handleClientData(EventLoop& loop, int fd) {
+    ClientState* state = findClient(loop, fd);
+    if (state == nullptr) return;
     
     // Check if write buffer is above threshold - stop reading if so
     // for handling any queued(stale) EPOLLIN event in epoll, before EPOLLOUT was set
-    if (it->second.write_buffer.size() >= MAX_WRITE_BUFFER_SIZE) {
-        std::cout << "Write buffer full (" << it->second.write_buffer.size() 
-                  << " bytes), pausing reads for fd " << fd << std::endl;
-        m_reactor.modifyHandler(fd, EPOLLOUT | EPOLLET);
+    if (state->write_buffer.size() >= MAX_WRITE_BUFFER_SIZE) {
+        LOG_DEBUG("Write buffer full ({} bytes), pausing reads for fd {}", state->write_buffer.size(), fd);
+        setReadsPaused(loop, *state, true);
+        setInterest(loop, fd, *state, EPOLLOUT | EPOLLET);
+        return;
+    }
+    if (overBudget()) {
+        parkForBudget(loop, fd, *state);
+        return;
+    }
+    const size_t budget = readAllowance(loop, *state);
+    if (budget == 0) {
+        throttleReads(loop, fd, *state);
+        return;
+    }
+    if (m_workers) {
+        readRequests(loop, fd, *state, budget);
+        return;
+    }
+    if (m_framer) {
+        readFrames(loop, fd, *state, budget);
         return;
     }
     
-    char temp_buf[4096];
+    auto& buffer = state->write_buffer;
     bool read_complete = false;
+    bool received = false;
+    size_t consumed = 0;
     
-    // Drain all available data from socket
+    // Drain all available data from socket, straight into reserved output space
     while (true) {
-        ssize_t bytes_read = read(fd, temp_buf, sizeof(temp_buf));
+        size_t space = READ_CHUNK_SIZE;
+        char* out = buffer.prepare(space);
+        ssize_t bytes_read = readClient(*state, fd, out, space);
         
         if (bytes_read == 0) {
             // Clean client disconnect
-            std::cout << "Client disconnected cleanly, fd: " << fd << std::endl;
-            cleanupClient(fd);
+            LOG_DEBUG("Client disconnected cleanly, fd: {}", fd);
+            cleanupClient(loop, fd);
             return;
         } else if (bytes_read == -1) {
             if (errno == EAGAIN || errno == EWOULDBLOCK) {
                 // All data read, done
                 read_complete = true;
+                if (buffer.empty()) {
+                    // Hand back the chunk reserved for this read so an idle
+                    // connection holds no buffer memory
+                    buffer.clear();
+                }
                 break;
             }
-            std::cerr << "Read error on fd " << fd << ": " << std::strerror(errno) << std::endl;
-            cleanupClient(fd);
+            LOG_WARN("Read error on fd {}: {}", fd, LogErrno{errno});
+            cleanupClient(loop, fd);
             return;
         }
 
-        std::cout << "Received " << bytes_read << " bytes from fd " << fd << std::endl;
+        LOG_DEBUG("Received {} bytes from fd {}", bytes_read, fd);
+
+        if (!received) {
+            // Loop time is fixed for this dispatch, one reset covers every chunk
+            received = true;
+            armTimeout(loop, state->handle, state->read_timer, m_config.read_timeout_ms, "read timeout");
+            armTimeout(loop, state->handle, state->idle_timer, m_config.idle_timeout_ms, "idle timeout");
+        }
  
-        std::transform(temp_buf, temp_buf + bytes_read, std::back_inserter(it->second.write_buffer), [](unsigned char c) {
-            return static_cast<unsigned char>(std::toupper(c)); 
-        });
+        m_transform(out, out, static_cast<size_t>(bytes_read));
+        buffer.commit(static_cast<size_t>(bytes_read));
+        loop.metrics.bytes_in.add(static_cast<uint64_t>(bytes_read));
+        chargeReads(loop, *state, static_cast<size_t>(bytes_read));
+        accountBuffered(loop, bytes_read);
+
+        consumed += static_cast<size_t>(bytes_read);
+        if (consumed >= budget) {
+            yieldReads(loop, fd, *state);
+            return;
+        }
         
         // Check if we've exceeded the buffer threshold after this read
-        if (it->second.write_buffer.size() >= MAX_WRITE_BUFFER_SIZE) {
-            std::cout << "Write buffer reached threshold (" << it->second.write_buffer.size() 
-                      << " bytes), pausing reads for fd " << fd << std::endl;
+        if (state->write_buffer.size() >= MAX_WRITE_BUFFER_SIZE) {
+            LOG_DEBUG("Write buffer reached threshold ({} bytes), pausing reads for fd {}", state->write_buffer.size(), fd);
             // Stop reading, only wait for EPOLLOUT to drain buffer
-            m_reactor.modifyHandler(fd, EPOLLOUT | EPOLLET);
-            handleClientWrite(fd);
+            setReadsPaused(loop, *state, true);
+            setInterest(loop, fd, *state, EPOLLOUT | EPOLLET);
+            handleClientWrite(loop, fd);
+            return;
+        }
+        if (overBudget()) {
+            LOG_DEBUG("Buffer budget exhausted, parking reads for fd {}", fd);
+            parkForBudget(loop, fd, *state);
+            handleClientWrite(loop, fd);
             return;
         }
     }
 
-    if(read_complete && !it->second.write_buffer.empty()) {
-        handleClientWrite(fd);
+    if(read_complete && !state->write_buffer.empty()) {
+        handleClientWrite(loop, fd);
     };
 }
 
-void TCPServer::handleClientWrite(int fd) {
-    auto it = m_clients.find(fd);
-    if (it == m_clients.end() || it->second.write_buffer.empty()) 
-    {
-        m_reactor.modifyHandler(fd, EPOLLIN | EPOLLET);
+void TCPServer::readFrames(EventLoop& loop, int fd, ClientState& state, size_t budget) {
+    ReadBuffer& input = state.read_buffer;
+    bool received = false;
+    bool drained = false;
+    bool yielded = false;
+    size_t consumed = 0;
+    while (!drained) {
+        // Gather a batch straight into the receive buffer, then answer every
+        // complete frame in it with a single pass
+        size_t batch = 0;
+        while (batch < MAX_WRITE_BUFFER_SIZE && consumed + batch < budget) {
+            char* out = input.prepare(READ_CHUNK_SIZE);
+            ssize_t bytes_read = readClient(state, fd, out, READ_CHUNK_SIZE);
+            if (bytes_read == 0) {
+                LOG_DEBUG("Client disconnected cleanly, fd: {}", fd);
+                cleanupClient(loop, fd);
+                return;
+            } else if (bytes_read == -1) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    drained = true;
+                    break;
+                }
+                LOG_WARN("Read error on fd {}: {}", fd, LogErrno{errno});
+                cleanupClient(loop, fd);
+                return;
+            }
+
+            LOG_DEBUG("Received {} bytes from fd {}", bytes_read, fd);
+            if (!received) {
+                received = true;
+                armTimeout(loop, state.handle, state.read_timer, m_config.read_timeout_ms, "read timeout");
+                armTimeout(loop, state.handle, state.idle_timer, m_config.idle_timeout_ms, "idle timeout");
+            }
+            input.commit(static_cast<size_t>(bytes_read));
+            state.last_read_ms = loop.reactor.now();
+            loop.metrics.bytes_in.add(static_cast<uint64_t>(bytes_read));
+            chargeReads(loop, state, static_cast<size_t>(bytes_read));
+            batch += static_cast<size_t>(bytes_read);
+        }
+        consumed += batch;
+
+        if (!processFrames(loop, fd, state)) {
+            return;
+        }
+        if (state.file_response) {
+            // Reads wait for the file; handleClientWrite resumes them
+            setReadsPaused(loop, state, true);
+            break;
+        }
+        if (!drained && consumed >= budget) {
+            yielded = true;
+            break;
+        }
+        if (!drained && state.write_buffer.size() >= MAX_WRITE_BUFFER_SIZE) {
+            LOG_DEBUG("Write buffer reached threshold ({} bytes), pausing reads for fd {}", state.write_buffer.size(), fd);
+            setReadsPaused(loop, state, true);
+            setInterest(loop, fd, state, EPOLLOUT | EPOLLET);
+            break;
+        }
+    }
+
+    if (yielded) {
+        yieldReads(loop, fd, state);
+    } else if (!state.write_buffer.empty() || state.file_response) {
+        handleClientWrite(loop, fd);
+    }
+}
+
+bool TCPServer::processFrames(EventLoop& loop, int fd, ClientState& state) {
+    if (state.file_response) {
+        return true;    // Replies must not overtake the file
+    }
+    ReadBuffer& input = state.read_buffer;
+    WriteBuffer& output = state.write_buffer;
+    const size_t queued_before = output.size();
+    std::string_view pending = input.view();
+    size_t frames = 0;
+
+    while (!pending.empty()) {
+        std::string_view frame;
+        size_t consumed = 0;
+        FrameStatus status = m_framer->decode(pending, frame, consumed);
+        if (status == FrameStatus::Incomplete) {
+            break;
+        }
+        if (status == FrameStatus::Invalid) {
+            LOG_WARN("Malformed or oversized frame from fd {}, closing", fd);
+            cleanupClient(loop, fd);
+            return false;
+        }
+        if (loop.files && frame.substr(0, 4) == "GET ") {
+            pending.remove_prefix(consumed);
+            ++frames;
+            if (queueFile(loop, state, frame.substr(4))) {
+                break;  // The frames behind it wait until the file is out
+            }
+            continue;
+        }
+        // The reply is transformed from the receive buffer straight into the
+        // output chunks; no per-frame copy or allocation
+        char header[Framer::MAX_HEADER];
+        output.append(header, m_framer->encodeHeader(frame.size(), header));
+        while (!frame.empty()) {
+            size_t space = frame.size();
+            char* out = output.prepare(space);
+            m_transform(frame.data(), out, space);
+            output.commit(space);
+            frame.remove_prefix(space);
+        }
+        std::string_view trailer = m_framer->trailer();
+        output.append(trailer.data(), trailer.size());
+        pending.remove_prefix(consumed);
+        ++frames;
+    }
+
+    input.consume(input.size() - pending.size());
+    loop.metrics.frames.add(frames);
+    accountBuffered(loop, static_cast<int64_t>(output.size() - queued_before));
+    keepReadBuffer(loop, state);
+    return true;
+}
+
+void TCPServer::keepReadBuffer(EventLoop& loop, ClientState& state) {
+    if (state.read_buffer.capacity() == 0) {
         return;
     }
-    
-    auto& buffer = it->second.write_buffer;
-    
-    // Try to flush buffered data
-    while (!buffer.empty()) {
-        ssize_t bytes_written = write(fd, buffer.data(), buffer.size());
-        
-        if (bytes_written == -1) {
+    if (overBudget()) {
+        // Memory is short: give it back now, only frees when nothing partial is left
+        state.read_buffer.release();
+        return;
+    }
+    // A busy connection reuses its buffer on every wakeup; the sweep frees
+    // it once the connection has gone quiet
+    if (!state.read_buffer_tracked) {
+        state.read_buffer_tracked = true;
+        loop.read_buffers.push_back(state.handle);
+    }
+    if (loop.read_buffer_timer == TimerWheel::INVALID_TIMER) {
+        loop.read_buffer_timer = loop.reactor.addTimer(READ_BUFFER_IDLE_MS, [this, &loop] {
+            releaseIdleReadBuffers(loop);
+        });
+    }
+}
+
+void TCPServer::releaseIdleReadBuffers(EventLoop& loop) {
+    loop.read_buffer_timer = TimerWheel::INVALID_TIMER;
+    const uint64_t now = loop.reactor.now();
+    size_t kept = 0;
+    for (ClientHandle handle : loop.read_buffers) {
+        ClientState* client = loop.clients.get(handle);
+        if (client == nullptr) {
+            continue;   // Closed; the slot may even hold someone else now
+        }
+        if (now - client->last_read_ms >= READ_BUFFER_IDLE_MS) {
+            client->read_buffer.release();
+        }
+        if (client->read_buffer.capacity() == 0) {
+            client->read_buffer_tracked = false;
+            continue;
+        }
+        loop.read_buffers[kept++] = handle;
+    }
+    loop.read_buffers.resize(kept);
+    if (kept > 0) {
+        loop.read_buffer_timer = loop.reactor.addTimer(READ_BUFFER_IDLE_MS, [this, &loop] {
+            releaseIdleReadBuffers(loop);
+        });
+    }
+}
+
+bool TCPServer::queueFile(EventLoop& loop, ClientState& state, std::string_view path) {
+    WriteBuffer& output = state.write_buffer;
+    char header[Framer::MAX_HEADER];
+    std::string_view trailer = m_framer->trailer();
+    FileCache::FilePtr file = loop.files->open(path, loop.reactor.now());
+    if (file && file->size() > UINT32_MAX) {
+        file.reset();
+        errno = EFBIG;  // Length prefixes are 32-bit
+    }
+    if (!file) {
+        std::string error = "ERR " + std::string(std::strerror(errno));
+        output.append(header, m_framer->encodeHeader(error.size(), header));
+        output.append(error.data(), error.size());
+        output.append(trailer.data(), trailer.size());
+        return false;
+    }
+    output.append(header, m_framer->encodeHeader(file->size(), header));
+    state.file_response = std::make_unique<ClientState::FileResponse>();
+    state.file_response->file = std::move(file);
+    state.file_response->trailer = trailer;
+    return true;
+}
+
+void TCPServer::readRequests(EventLoop& loop, int fd, ClientState& state, size_t budget) {
+    bool received = false;
+    char chunk[READ_CHUNK_SIZE];
+    size_t consumed = 0;
+    while (true) {
+        // Same watermark as the inline path, counting bytes the workers have
+        // not answered yet. A lone partial frame can not be answered, so it
+        // keeps reading until the frame completes (bounded by max_frame_size).
+        if (state.inbox.size() + state.write_buffer.size() >= MAX_WRITE_BUFFER_SIZE &&
+            (state.request_in_flight || completeRequestBytes(state.inbox) > 0)) {
+            break;
+        }
+        ssize_t bytes_read = readClient(state, fd, chunk, sizeof(chunk));
+        if (bytes_read == 0) {
+            LOG_DEBUG("Client disconnected cleanly, fd: {}", fd);
+            cleanupClient(loop, fd);
+            return;
+        } else if (bytes_read == -1) {
             if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                // Check if we should resume reads despite having data left
-                if (buffer.size() < RESUME_WRITE_BUFFER_SIZE) {
-                    m_reactor.modifyHandler(fd, EPOLLIN | EPOLLOUT | EPOLLET);
-                } else {
-                    m_reactor.modifyHandler(fd, EPOLLOUT | EPOLLET);
+                if (!state.request_in_flight) {
+                    dispatchRequest(loop, fd, state);
                 }
                 return;
-            } else if (errno == EPIPE || errno == ECONNRESET) {
-                std::cerr << "Client disconnected during buffered write, fd: " << fd << std::endl;
-                cleanupClient(fd);
+            }
+            LOG_WARN("Read error on fd {}: {}", fd, LogErrno{errno});
+            cleanupClient(loop, fd);
+            return;
+        }
+
+        LOG_DEBUG("Received {} bytes from fd {}", bytes_read, fd);
+        if (!received) {
+            received = true;
+            armTimeout(loop, state.handle, state.read_timer, m_config.read_timeout_ms, "read timeout");
+            armTimeout(loop, state.handle, state.idle_timer, m_config.idle_timeout_ms, "idle timeout");
+        }
+        state.inbox.append(chunk, static_cast<size_t>(bytes_read));
+        loop.metrics.bytes_in.add(static_cast<uint64_t>(bytes_read));
+        chargeReads(loop, state, static_cast<size_t>(bytes_read));
+
+        consumed += static_cast<size_t>(bytes_read);
+        if (consumed >= budget) {
+            if (!state.request_in_flight && !dispatchRequest(loop, fd, state)) {
                 return;
-            } else {
-                std::cerr << "Write error on fd " << fd << ": " << std::strerror(errno) << std::endl;
-                cleanupClient(fd);
+            }
+            yieldReads(loop, fd, state);
+            return;
+        }
+    }
+
+    // The next completion flushes and resumes reading
+    LOG_DEBUG("Request backlog reached threshold ({} bytes), pausing reads for fd {}", state.inbox.size(), fd);
+    setReadsPaused(loop, state, true);
+    uint32_t events = EPOLLET;
+    if (!state.write_buffer.empty()) {
+        events |= EPOLLOUT;
+    }
+    setInterest(loop, fd, state, events);
+    if (!state.request_in_flight) {
+        dispatchRequest(loop, fd, state);
+    }
+}
+
+size_t TCPServer::completeRequestBytes(std::string_view data) const {
+    if (!m_framer) {
+        return data.size();
+    }
+    size_t complete = 0;
+    while (complete < data.size()) {
+        std::string_view frame;
+        size_t consumed = 0;
+        FrameStatus status = m_framer->decode(data.substr(complete), frame, consumed);
+        if (status == FrameStatus::Invalid) {
+            return SIZE_MAX;
+        }
+        if (status == FrameStatus::Incomplete) {
+            break;
+        }
+        complete += consumed;
+    }
+    return complete;
+}
+
+bool TCPServer::dispatchRequest(EventLoop& loop, int fd, ClientState& state) {
+    size_t complete = completeRequestBytes(state.inbox);
+    if (complete == SIZE_MAX) {
+        LOG_WARN("Malformed or oversized frame from fd {}, closing", fd);
+        cleanupClient(loop, fd);
+        return false;
+    }
+    if (complete == 0) {
+        return true;
+    }
+    // Only whole frames travel; a trailing partial one stays for next time
+    std::string request;
+    if (complete == state.inbox.size()) {
+        request = std::move(state.inbox);
+        state.inbox.clear();
+    } else {
+        request.assign(state.inbox, 0, complete);
+        state.inbox.erase(0, complete);
+    }
+
+    state.request_in_flight = true;
+    loop.metrics.worker_requests.add();
+    EventLoop* lp = &loop;
+    m_workers->submit([this, lp, fd, handle = state.handle, request = std::move(request)]() mutable {
+        bool failed = false;
+        try {
+            handleRequest(request);
+        } catch (const std::exception& e) {
+            LOG_WARN("Request handler failed for fd {}: {}", fd, e.what());
+            failed = true;
+        }
+        // Back to the owning loop, the only thread allowed to touch the client
+        lp->reactor.post([this, lp, failed, handle, reply = std::move(request)]() mutable {
+            completeRequest(*lp, handle, reply, failed);
+        });
+    });
+    return true;
+}
+
+void TCPServer::handleRequest(std::string& request) const {
+    if (!m_framer) {
+        m_config.request_handler(request);
+        return;
+    }
+    // The loop only sends complete frames; each gets its own handler call
+    std::string reply;
+    std::string payload;
+    std::string_view input(request);
+    std::string_view frame;
+    size_t consumed = 0;
+    while (!input.empty() && m_framer->decode(input, frame, consumed) == FrameStatus::Complete) {
+        payload.assign(frame.data(), frame.size());
+        m_config.request_handler(payload);
+        char header[Framer::MAX_HEADER];
+        reply.append(header, m_framer->encodeHeader(payload.size(), header));
+        reply += payload;
+        reply += m_framer->trailer();
+        input.remove_prefix(consumed);
+    }
+    request.swap(reply);
+}
+
+void TCPServer::completeRequest(EventLoop& loop, ClientHandle handle, std::string& reply, bool failed) {
+    ClientState* client = loop.clients.get(handle);
+    if (client == nullptr) {
+        return;  // Closed while the worker ran, its fd and slot may already be someone else's
+    }
+    ClientState& state = *client;
+    const int fd = state.socket.getFd();
+    state.request_in_flight = false;
+    if (failed) {
+        cleanupClient(loop, fd);
+        return;
+    }
+    state.write_buffer.append(reply.data(), reply.size());
+    accountBuffered(loop, static_cast<int64_t>(reply.size()));
+    if (!state.inbox.empty() && !dispatchRequest(loop, fd, state)) {
+        return;
+    }
+    handleClientWrite(loop, fd);
+}
+
+void TCPServer::handleClientWrite(EventLoop& loop, int fd) {
+    ClientState* client = findClient(loop, fd);
+    if (client == nullptr || (client->write_buffer.empty() && !client->file_response))
+    {
+        if (client != nullptr) {
+            resumeReads(loop, fd, *client, 0);
+        } else {
+            loop.reactor.modifyHandler(fd, EPOLLIN | EPOLLET);
+        }
+        return;
+    }
+    
+    ClientState& state = *client;
+    auto& buffer = state.write_buffer;
+    const size_t pending_before = buffer.size();
+    
+    while (true) {
+        // Try to flush buffered data; writev advances the chunk cursors in place
+        while (!buffer.empty()) {
+            const size_t allowance = writeAllowance(loop, state);
+            if (allowance == 0) {
+                trackWriteProgress(loop, state, buffer.size() < pending_before);
+                throttleWrites(loop, fd, state);
                 return;
             }
+            const bool zerocopy = m_config.zerocopy_threshold > 0 && buffer.size() >= m_config.zerocopy_threshold;
+            ssize_t bytes_written = writeClient(state, fd, zerocopy, allowance);
+            
+            if (bytes_written == -1) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    trackWriteProgress(loop, state, buffer.size() < pending_before);
+                    // Check if we should resume reads despite having data left
+                    if (buffer.size() < RESUME_WRITE_BUFFER_SIZE && !state.file_response) {
+                        resumeReads(loop, fd, state, EPOLLOUT);
+                    } else {
+                        setReadsPaused(loop, state, true);
+                        setInterest(loop, fd, state, EPOLLOUT | EPOLLET);
+                    }
+                    return;
+                } else if (errno == EPIPE || errno == ECONNRESET) {
+                    LOG_INFO("Client disconnected during buffered write, fd: {}", fd);
+                    cleanupClient(loop, fd);
+                    return;
+                } else {
+                    LOG_WARN("Write error on fd {}: {}", fd, LogErrno{errno});
+                    cleanupClient(loop, fd);
+                    return;
+                }
+            }
+            loop.metrics.bytes_out.add(static_cast<uint64_t>(bytes_written));
+            chargeWrites(loop, state, static_cast<size_t>(bytes_written));
+            if (zerocopy) {
+                loop.metrics.zerocopy_sends.add();
+            }
+            accountBuffered(loop, -bytes_written);
+        }
+
+        // Everything queued ahead of a file reply is out, stream the file;
+        // once it is done, answer the frames that arrived behind it
+        if (!state.file_response) {
+            break;
+        }
+        if (!sendFile(loop, fd, state) || !processFrames(loop, fd, state)) {
+            return;
         }
-        
-        // Remove written data from buffer
-        buffer.erase(buffer.begin(), buffer.begin() + bytes_written);
     }
     
     // Buffer is empty, resume reading
-    std::cout << "Flushed write buffer for fd " << fd << std::endl;
-    m_reactor.modifyHandler(fd, EPOLLIN | EPOLLET);
+    trackWriteProgress(loop, state, true);
+    LOG_DEBUG("Flushed write buffer for fd {}", fd);
+    resumeReads(loop, fd, state, 0);
+}
+
+bool TCPServer::sendFile(EventLoop& loop, int fd, ClientState& state) {
+    ClientState::FileResponse& response = *state.file_response;
+    const size_t size = response.file->size();
+    const size_t started = response.offset;
+    while (response.offset < size) {
+        if (response.offset - started >= FILE_SEND_BUDGET) {
+            // Let other clients run, then continue from the ready queue
+            loop.metrics.file_bytes.add(response.offset - started);
+            loop.metrics.bytes_out.add(response.offset - started);
+            trackWriteProgress(loop, state, true);
+            setReadsPaused(loop, state, true);
+            setInterest(loop, fd, state, EPOLLOUT | EPOLLET);
+            loop.reactor.defer(fd, EPOLLOUT);
+            return false;
+        }
+        const size_t allowance = writeAllowance(loop, state);
+        if (allowance == 0) {
+            loop.metrics.file_bytes.add(response.offset - started);
+            loop.metrics.bytes_out.add(response.offset - started);
+            trackWriteProgress(loop, state, response.offset > started);
+            throttleWrites(loop, fd, state);
+            return false;
+        }
+        const size_t remaining = std::min(size - response.offset, allowance);
+        ssize_t sent;
+        if (state.tls && !state.tls->kernelSend()) {
+            // Userspace TLS has to see the bytes: encrypt straight from the mapping
+            const char* data = response.file->data();
+            if (data == nullptr) {
+                LOG_WARN("Failed to map file for fd {}: {}", fd, LogErrno{errno});
+                cleanupClient(loop, fd);
+                return false;
+            }
+            sent = state.tls->write(data + response.offset, std::min(remaining, TLS_FILE_CHUNK));
+        } else {
+            // Page cache to socket inside the kernel (encrypted there with kTLS)
+            off_t offset = static_cast<off_t>(response.offset);
+            sent = sendfile(fd, response.file->fd(), &offset, remaining);
+        }
+
+        if (sent == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                loop.metrics.file_bytes.add(response.offset - started);
+                loop.metrics.bytes_out.add(response.offset - started);
+                trackWriteProgress(loop, state, response.offset > started);
+                setReadsPaused(loop, state, true);
+                setInterest(loop, fd, state, EPOLLOUT | EPOLLET);
+                return false;
+            }
+            if (errno == EPIPE || errno == ECONNRESET) {
+                LOG_INFO("Client disconnected during file send, fd: {}", fd);
+            } else {
+                LOG_WARN("File send error on fd {}: {}", fd, LogErrno{errno});
+            }
+            cleanupClient(loop, fd);
+            return false;
+        }
+        if (sent == 0) {
+            // Truncated since it was opened; the frame can no longer be completed
+            LOG_WARN("File shrank while being sent to fd {}, closing", fd);
+            cleanupClient(loop, fd);
+            return false;
+        }
+        response.offset += static_cast<size_t>(sent);
+        chargeWrites(loop, state, static_cast<size_t>(sent));
+    }
+
+    loop.metrics.file_bytes.add(size - started);
+    loop.metrics.bytes_out.add(size - started);
+    loop.metrics.file_responses.add();
+    std::string_view trailer = response.trailer;
+    state.file_response.reset();
+    state.write_buffer.append(trailer.data(), trailer.size());
+    accountBuffered(loop, static_cast<int64_t>(trailer.size()));
+    return true;
+}
+
+void TCPServer::handOff(Socket& channel) {
+    std::vector<int> listeners;
+    for (const auto& loop : m_loops) {
+        listeners.push_back(loop->listen_socket.getFd());
+        for (const Socket& extra : loop->extra_listeners) {
+            listeners.push_back(extra.getFd());
+        }
+    }
+    if (!sendHandoffMessage(channel.getFd(), HandoffMessage::Listeners, static_cast<uint32_t>(m_loops.size()),
+                            listeners.data(), listeners.size())) {
+        // The successor gives up when the channel closes; keep serving
+        LOG_ERROR("Failed to hand listening sockets to successor: {}", LogErrno{errno});
+        return;
+    }
+    LOG_INFO("Handed {} listening socket(s) to successor, draining", listeners.size());
+    m_loopsDraining.store(m_loops.size(), std::memory_order_relaxed);
+    m_handedOff.store(true, std::memory_order_relaxed);
+
+    // Each loop stops accepting and passes its own connections from its own
+    // thread; the channel closes once the last of them is done with it
+    auto shared = std::make_shared<Socket>(std::move(channel));
+    for (auto& loop : m_loops) {
+        EventLoop* lp = loop.get();
+        lp->reactor.post([this, lp, shared] { handOffLoop(*lp, shared->getFd()); });
+    }
+}
+
+void TCPServer::handOffLoop(EventLoop& loop, int channel) {
+    // The successor accepts from these sockets now. Our descriptors stay
+    // open (and getPort() valid) until the server is destroyed.
+    loop.reactor.unregisterHandler(loop.listen_socket.getFd());
+    for (const Socket& extra : loop.extra_listeners) {
+        loop.reactor.unregisterHandler(extra.getFd());
+    }
+
+    if (m_config.handoff_clients) {
+        // Only connections with nothing in flight in this process can move,
+        // and never TLS ones, whose session state lives here; the rest are
+        // served here until they finish
+        std::vector<int> idle;
+        loop.clients.forEach([&idle](ClientHandle, const ClientState& client) {
+            if (!client.tls && client.write_buffer.empty() && client.write_buffer.zeroCopyPending() == 0 &&
+                client.read_buffer.empty() && client.inbox.empty() && !client.request_in_flight &&
+                !client.reads_paused && !client.budget_parked) {
+                idle.push_back(client.socket.getFd());
+            }
+        });
+        for (size_t first = 0; first < idle.size(); first += HANDOFF_MAX_FDS) {
+            size_t count = std::min(HANDOFF_MAX_FDS, idle.size() - first);
+            if (!sendHandoffMessage(channel, HandoffMessage::Clients, 0, idle.data() + first, count)) {
+                LOG_WARN("Failed to hand connections to successor: {}", LogErrno{errno});
+                break;
+            }
+            for (size_t i = first; i < first + count; ++i) {
+                loop.metrics.handed_off.add();
+                cleanupClient(loop, idle[i]);
+            }
+        }
+    }
+    if (!sendHandoffMessage(channel, HandoffMessage::LoopDone, 0, nullptr, 0)) {
+        LOG_WARN("Failed to complete handoff: {}", LogErrno{errno});
+    }
+
+    loop.draining = true;
+    if (loop.clients.empty()) {
+        stopLoop(loop);
+        return;
+    }
+    LOG_INFO("Draining {} connection(s), closing them in {} ms at the latest",
+             loop.clients.size(), m_config.drain_timeout_ms);
+    loop.reactor.addTimer(m_config.drain_timeout_ms, [this, &loop] {
+        LOG_INFO("Drain deadline reached, closing {} connection(s)", loop.clients.size());
+        std::vector<int> remaining;
+        loop.clients.forEach([&remaining](ClientHandle, const ClientState& client) {
+            remaining.push_back(client.socket.getFd());
+        });
+        for (int fd : remaining) {
+            cleanupClient(loop, fd);    // The last one stops the loop
+        }
+    });
+}
+
+void TCPServer::stopLoop(EventLoop& loop) {
+    if (loop.drained) {
+        return;
+    }
+    loop.drained = true;
+    // Other loops stop as soon as they are empty. The primary one keeps
+    // running, still answering the shutdown fd, until it is the last.
+    uint64_t val = 1;
+    if (&loop != m_loops.front().get()) {
+        write(loop.reactor.getShutdownFd(), &val, sizeof(val));
+    }
+    if (m_loopsDraining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        write(m_loops.front()->reactor.getShutdownFd(), &val, sizeof(val));
+    }
+}
+
+// One requested dump, filled in a ring at a time
+struct TCPServer::TraceDump {
+    explicit TraceDump(size_t count) : loops(count), taken(count), remaining(count) {}
+
+    std::vector<TraceSnapshot> loops;
+    std::vector<std::atomic<bool>> taken;
+    std::atomic<size_t> remaining;
+};
+
+void TCPServer::dumpTrace() {
+    uint64_t val;
+    read(m_traceFd, &val, sizeof(val));
+    if (m_traceWriting.exchange(true, std::memory_order_acq_rel)) {
+        LOG_WARN("Trace dump already in progress, request ignored");
+        return;
+    }
+    // Each loop copies its own ring on its own thread, so recording never
+    // needs to synchronise. A loop that has already stopped (drained after
+    // a handoff) will never run the task, but its ring no longer changes
+    // either, so it is copied here; one that stops with the task still
+    // queued copies it on its way out (loopExited).
+    auto dump = std::make_shared<TraceDump>(m_loops.size());
+    std::vector<bool> exited(m_loops.size());
+    {
+        std::lock_guard<std::mutex> lock(m_traceMutex);
+        m_traceDump = dump;
+        for (size_t i = 0; i < m_loops.size(); ++i) {
+            exited[i] = m_loops[i]->exited;
+        }
+    }
+    for (size_t i = 0; i < m_loops.size(); ++i) {
+        if (exited[i]) {
+            snapshotTrace(dump, i);
+        } else {
+            m_loops[i]->reactor.post([this, dump, i] { snapshotTrace(dump, i); });
+        }
+    }
+}
+
+void TCPServer::snapshotTrace(const std::shared_ptr<TraceDump>& dump, size_t index) {
+    if (dump->taken[index].exchange(true, std::memory_order_relaxed)) {
+        return;
+    }
+    dump->loops[index].thread_name = "loop " + std::to_string(index);
+    m_loops[index]->recorder->snapshot(dump->loops[index].records);
+    if (dump->remaining.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+        return;
+    }
+    // The last ring is in; format and write the file on a thread of its own
+    std::lock_guard<std::mutex> lock(m_traceMutex);
+    m_traceDump.reset();
+    if (m_traceWriter.joinable()) {
+        m_traceWriter.join();   // The previous dump, already written
+    }
+    m_traceWriter = std::thread([this, dump, path = m_config.trace_path] {
+        writeTrace(path, dump->loops);
+        m_traceWriting.store(false, std::memory_order_release);
+    });
 }
 
-void TCPServer::cleanupClient(int fd) {
-    m_reactor.unregisterHandler(fd);
-    m_clients.erase(fd);
+void TCPServer::loopExited(size_t index) {
+    std::shared_ptr<TraceDump> dump;
+    {
+        std::lock_guard<std::mutex> lock(m_traceMutex);
+        m_loops[index]->exited = true;
+        dump = m_traceDump;
+    }
+    if (dump) {
+        snapshotTrace(dump, index);
+    }
+}
+
+void TCPServer::writeTrace(const std::string& path, const std::vector<TraceSnapshot>& loops) {
+    std::string json;
+    appendChromeTrace(json, loops);
+    size_t events = 0;
+    for (const TraceSnapshot& loop : loops) {
+        events += loop.records.size();
+    }
+
+    // Written aside and renamed, so a reader never sees half a trace
+    const std::string temp = path + ".tmp";
+    int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    bool written = fd != -1;
+    for (size_t offset = 0; written && offset < json.size();) {
+        ssize_t n = write(fd, json.data() + offset, json.size() - offset);
+        written = n > 0;
+        offset += written ? static_cast<size_t>(n) : 0;
+    }
+    int error = errno;
+    if (fd != -1) {
+        close(fd);
+    }
+    if (!written || std::rename(temp.c_str(), path.c_str()) == -1) {
+        LOG_WARN("Failed to write trace to {}: {}", path, LogErrno{written ? errno : error});
+        unlink(temp.c_str());
+        return;
+    }
+    LOG_INFO("Wrote {} trace events to {}", events, path);
+}
+
+void TCPServer::cleanupClient(EventLoop& loop, int fd) {
+    ClientState* state = findClient(loop, fd);
+    if (state != nullptr) {
+        loop.trace(TraceEvent::Close, fd);
+        loop.reactor.cancelTimer(state->idle_timer);
+        loop.reactor.cancelTimer(state->read_timer);
+        loop.reactor.cancelTimer(state->write_stall_timer);
+        loop.reactor.cancelTimer(state->read_throttle_timer);
+        loop.reactor.cancelTimer(state->write_throttle_timer);
+        accountBuffered(loop, -static_cast<int64_t>(state->write_buffer.size()));
+        if (state->tls) {
+            state->tls->shutdown();
+        }
+        loop.metrics.closes.add();
+        m_connectionCount.fetch_sub(1, std::memory_order_relaxed);
+    }
+    loop.reactor.unregisterHandler(fd);
+    if (state != nullptr) {
+        if (m_config.zerocopy_threshold > 0 && state->write_buffer.zeroCopyPending() > 0) {
+            reapZeroCopy(loop, fd, *state);
+            if (state->write_buffer.zeroCopyPending() > 0) {
+                lingerZeroCopy(loop, *state);
+            }
+        }
+        // Closes the fd (unless it lingers); every handle to this slot is stale from here on
+        loop.clients.erase(state->handle);
+        loop.client_fds[static_cast<size_t>(fd)] = ClientHandle{};
+    }
+    if (loop.draining && loop.clients.empty()) {
+        stopLoop(loop);
+    }
+}
+
+bool TCPServer::reapZeroCopy(EventLoop& loop, int fd, ClientState& state) {
+    size_t copied = 0;
+    int completions = state.write_buffer.reapZeroCopy(fd, copied);
+    if (copied > 0) {
+        loop.metrics.zerocopy_copied.add(copied);
+    }
+    // No notifications at all means EPOLLERR came from a real socket error
+    return completions > 0;
+}
+
+void TCPServer::lingerZeroCopy(EventLoop& loop, ClientState& state) {
+    // The kernel may still be sending (or retransmitting) from chunks that
+    // would otherwise go back to the pool and fill up with another client's
+    // bytes. Unsent output is dropped and the peer gets its FIN, but the
+    // socket and the pinned chunks stay until the last completion arrives.
+    const int fd = state.socket.getFd();
+    state.write_buffer.clear();
+    shutdown(fd, SHUT_RDWR);
+    SlabHandle handle = loop.lingering.emplace(std::move(state.socket), std::move(state.write_buffer));
+    LOG_DEBUG("fd {} closed with {} zero-copy chunk(s) unconfirmed, lingering",
+              fd, loop.lingering.get(handle)->chunks.zeroCopyPending());
+    // Registered from a task: cleanupClient may be running inside the
+    // handler that was just unregistered for this very fd
+    loop.reactor.post([this, &loop, handle] {
+        ZeroCopyLinger* linger = loop.lingering.get(handle);
+        if (linger == nullptr) return;
+        // Completions only raise EPOLLERR, which needs no interest bits
+        loop.reactor.registerHandler(linger->socket.getFd(), EPOLLET, [this, &loop, handle](int, uint32_t) {
+            reapLingering(loop, handle);
+        });
+        reapLingering(loop, handle);
+    });
+}
+
+void TCPServer::reapLingering(EventLoop& loop, SlabHandle handle) {
+    ZeroCopyLinger* linger = loop.lingering.get(handle);
+    if (linger == nullptr) return;
+    const int fd = linger->socket.getFd();
+    size_t copied = 0;
+    // -1 is a socket error read off the queue; completions may be behind it
+    while (linger->chunks.zeroCopyPending() > 0 && linger->chunks.reapZeroCopy(fd, copied) != 0) {
+    }
+    if (copied > 0) {
+        loop.metrics.zerocopy_copied.add(copied);
+    }
+    if (linger->chunks.zeroCopyPending() > 0) {
+        return;
+    }
+    loop.reactor.unregisterHandler(fd);
+    loop.lingering.erase(handle);   // Closes the socket, the chunks go back to the pool
+}
+
+void TCPServer::armTimeout(EventLoop& loop, ClientHandle handle, Reactor::TimerId& timer, uint64_t timeout_ms,
+                           const char* reason) {
+    if (timeout_ms == 0) {
+        return;
+    }
+    // Reset is O(1) and allocation-free; only the first arm creates the timer
+    if (!loop.reactor.resetTimer(timer, timeout_ms)) {
+        timer = loop.reactor.addTimer(timeout_ms, [this, &loop, handle, reason] {
+            handleTimeout(loop, handle, reason);
+        });
+    }
+}
+
+void TCPServer::trackWriteProgress(EventLoop& loop, ClientState& state, bool progressed) {
+    if (progressed) {
+        armTimeout(loop, state.handle, state.idle_timer, m_config.idle_timeout_ms, "idle timeout");
+    }
+    if (state.write_buffer.empty() && !state.file_response) {
+        loop.reactor.cancelTimer(state.write_stall_timer);
+        state.write_stall_timer = TimerWheel::INVALID_TIMER;
+    } else if (progressed || state.write_stall_timer == TimerWheel::INVALID_TIMER) {
+        armTimeout(loop, state.handle, state.write_stall_timer, m_config.write_stall_timeout_ms, "write stall timeout");
+    }
+}
+
+void TCPServer::setReadsPaused(EventLoop& loop, ClientState& state, bool paused) {
+    if (state.reads_paused == paused) {
+        return;
+    }
+    state.reads_paused = paused;
+    (paused ? loop.metrics.read_pauses : loop.metrics.read_resumes).add();
+    loop.trace(paused ? TraceEvent::ReadPause : TraceEvent::ReadResume, state.socket.getFd());
+}
+
+void TCPServer::resumeReads(EventLoop& loop, int fd, ClientState& state, uint32_t also) {
+    if (state.budget_parked || state.read_throttle_timer != TimerWheel::INVALID_TIMER) {
+        // Still waiting on the global budget or for read tokens; releaseParked()
+        // or the throttle timer re-enables EPOLLIN
+        setInterest(loop, fd, state, also | EPOLLET);
+        return;
+    }
+    const bool was_paused = state.reads_paused;
+    setReadsPaused(loop, state, false);
+    const bool rearmed = setInterest(loop, fd, state, EPOLLIN | also | EPOLLET);
+    // Without a re-arm the socket will not report bytes that arrived while
+    // reads were paused, nor what TLS decrypted ahead of them
+    if ((was_paused && !rearmed) || (state.tls && state.tls->pending() > 0)) {
+        loop.reactor.defer(fd, EPOLLIN);
+    }
+}
+
+bool TCPServer::setInterest(EventLoop& loop, int fd, ClientState& state, uint32_t events) {
+    // Every flush ends by asking for plain EPOLLIN again; skip the epoll_ctl
+    // when that is what is registered already
+    if (state.interest == events) {
+        return false;
+    }
+    state.interest = events;
+    loop.reactor.modifyHandler(fd, events);
+    return true;
+}
+
+size_t TCPServer::readBudget() const {
+    return m_config.read_budget_bytes == 0 ? SIZE_MAX : m_config.read_budget_bytes;
+}
+
+void TCPServer::yieldReads(EventLoop& loop, int fd, ClientState& state) {
+    // Answer what was read so far, then let the loop's other ready clients
+    // run before reading more; the socket is not re-armed for that
+    loop.metrics.read_yields.add();
+    if (!state.write_buffer.empty() || state.file_response) {
+        handleClientWrite(loop, fd);
+    }
+    ClientState* client = findClient(loop, fd);
+    if (client != nullptr && !client->reads_paused) {
+        loop.reactor.defer(fd, EPOLLIN);
+    }
+}
+
+size_t TCPServer::readAllowance(EventLoop& loop, ClientState& state) {
+    const uint64_t now = loop.reactor.now();
+    const uint64_t tokens = std::min(state.read_tokens.available(now), loop.read_tokens.available(now));
+    return static_cast<size_t>(std::min<uint64_t>(tokens, readBudget()));
+}
+
+size_t TCPServer::writeAllowance(EventLoop& loop, ClientState& state) {
+    const uint64_t now = loop.reactor.now();
+    return static_cast<size_t>(std::min(state.write_tokens.available(now), loop.write_tokens.available(now)));
+}
+
+void TCPServer::chargeReads(EventLoop& loop, ClientState& state, size_t bytes) {
+    state.read_tokens.consume(bytes);
+    loop.read_tokens.consume(bytes);
+}
+
+void TCPServer::chargeWrites(EventLoop& loop, ClientState& state, size_t bytes) {
+    state.write_tokens.consume(bytes);
+    loop.write_tokens.consume(bytes);
+}
+
+void TCPServer::throttleReads(EventLoop& loop, int fd, ClientState& state) {
+    // Out of read tokens: drop EPOLLIN rather than take readiness events we
+    // would only ignore, and come back when the emptier bucket has refilled
+    setReadsPaused(loop, state, true);
+    uint32_t events = EPOLLET;
+    if (!state.write_buffer.empty() && state.write_throttle_timer == TimerWheel::INVALID_TIMER) {
+        events |= EPOLLOUT;
+    }
+    setInterest(loop, fd, state, events);
+    if (state.read_throttle_timer != TimerWheel::INVALID_TIMER) {
+        return;
+    }
+    loop.metrics.read_throttles.add();
+    const uint64_t delay = std::max(state.read_tokens.delayMs(), loop.read_tokens.delayMs());
+    state.read_throttle_timer = loop.reactor.addTimer(delay, [this, &loop, handle = state.handle] {
+        // By handle: the fd may belong to another connection by now
+        ClientState* client = loop.clients.get(handle);
+        if (client == nullptr) return;
+        client->read_throttle_timer = TimerWheel::INVALID_TIMER;
+        const bool flush = !client->write_buffer.empty() && client->write_throttle_timer == TimerWheel::INVALID_TIMER;
+        resumeReads(loop, client->socket.getFd(), *client, flush ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+    });
+}
+
+void TCPServer::throttleWrites(EventLoop& loop, int fd, ClientState& state) {
+    // Out of write tokens: stop asking for EPOLLOUT. Reads go on until the
+    // usual watermark, so a client that keeps sending ends up paused too.
+    if (state.write_buffer.size() < RESUME_WRITE_BUFFER_SIZE && !state.file_response) {
+        resumeReads(loop, fd, state, 0);
+    } else {
+        setReadsPaused(loop, state, true);
+        setInterest(loop, fd, state, EPOLLET);
+    }
+    if (state.write_throttle_timer != TimerWheel::INVALID_TIMER) {
+        return;
+    }
+    loop.metrics.write_throttles.add();
+    const uint64_t delay = std::max(state.write_tokens.delayMs(), loop.write_tokens.delayMs());
+    state.write_throttle_timer = loop.reactor.addTimer(delay, [this, &loop, handle = state.handle] {
+        ClientState* client = loop.clients.get(handle);
+        if (client == nullptr) return;
+        client->write_throttle_timer = TimerWheel::INVALID_TIMER;
+        handleClientWrite(loop, client->socket.getFd());
+    });
+}
+
+void TCPServer::throttleAccepts(EventLoop& loop, int fd) {
+    // New connections wait in the kernel's accept queue. The listener is not
+    // reported again until the timer re-arms it, however many arrive.
+    loop.reactor.modifyHandler(fd, EPOLLET);
+    loop.accept_throttled.push_back(fd);
+    loop.metrics.accept_throttles.add();
+    if (loop.accept_timer != TimerWheel::INVALID_TIMER) {
+        return;
+    }
+    loop.accept_timer = loop.reactor.addTimer(loop.accept_tokens.delayMs(), [this, &loop] {
+        loop.accept_timer = TimerWheel::INVALID_TIMER;
+        if (!m_handedOff.load(std::memory_order_relaxed)) {
+            // Re-arming an edge-triggered listener reports the queued connections
+            for (int listener : loop.accept_throttled) {
+                loop.reactor.modifyHandler(listener, EPOLLIN | EPOLLET);
+            }
+        }
+        loop.accept_throttled.clear();
+    });
+}
+
+void TCPServer::accountBuffered(EventLoop& loop, int64_t delta) {
+    loop.metrics.buffered_bytes.add(delta);
+    if (m_config.max_buffered_bytes != 0) {
+        // The only cross-loop write on the data path, skipped without a budget
+        m_bufferedBytes.fetch_add(delta, std::memory_order_relaxed);
+    }
+}
+
+bool TCPServer::overBudget() const {
+    return m_config.max_buffered_bytes != 0 &&
+           m_bufferedBytes.load(std::memory_order_relaxed) >= static_cast<int64_t>(m_config.max_buffered_bytes);
+}
+
+void TCPServer::parkForBudget(EventLoop& loop, int fd, ClientState& state) {
+    setReadsPaused(loop, state, true);
+    if (!state.budget_parked) {
+        state.budget_parked = true;
+        loop.budget_parked.push_back(state.handle);
+        loop.metrics.budget_pauses.add();
+    }
+    // Keep draining whatever this client already has queued
+    uint32_t events = EPOLLET;
+    if (!state.write_buffer.empty()) {
+        events |= EPOLLOUT;
+    }
+    setInterest(loop, fd, state, events);
+
+    // Other loops free budget without telling us, so poll for it while parked
+    if (loop.budget_timer == TimerWheel::INVALID_TIMER) {
+        loop.budget_timer = loop.reactor.addTimer(BUDGET_RECHECK_MS, [this, &loop] { releaseParked(loop); });
+    }
+}
+
+void TCPServer::releaseParked(EventLoop& loop) {
+    loop.budget_timer = TimerWheel::INVALID_TIMER;
+    // Hysteresis: wait for a quarter of the budget to drain so parked clients
+    // do not flap between reading one chunk and parking again
+    const size_t budget = m_config.max_buffered_bytes;
+    if (m_bufferedBytes.load(std::memory_order_relaxed) >= static_cast<int64_t>(budget - budget / 4)) {
+        loop.budget_timer = loop.reactor.addTimer(BUDGET_RECHECK_MS, [this, &loop] { releaseParked(loop); });
+        return;
+    }
+
+    for (ClientHandle handle : loop.budget_parked) {
+        ClientState* client = loop.clients.get(handle);
+        if (client == nullptr || !client->budget_parked) {
+            continue;  // Closed while parked; the slot may even hold someone else now
+        }
+        ClientState& state = *client;
+        const int fd = state.socket.getFd();
+        state.budget_parked = false;
+        if (state.write_buffer.size() >= RESUME_WRITE_BUFFER_SIZE) {
+            continue;  // Its own watermark still applies, handleClientWrite resumes it
+        }
+        resumeReads(loop, fd, state, state.write_buffer.empty() ? 0u : static_cast<uint32_t>(EPOLLOUT));
+    }
+    loop.budget_parked.clear();
+}
+
+void TCPServer::handleTimeout(EventLoop& loop, ClientHandle handle, const char* reason) {
+    ClientState* client = loop.clients.get(handle);
+    if (client == nullptr) {
+        return;
+    }
+    const int fd = client->socket.getFd();
+    LOG_INFO("Closing fd {}: {}", fd, reason);
+    cleanupClient(loop, fd);
 }
@@ -0,0 +1,228 @@
+#include <climits>
+#include <exception>
+#include "timer_wheel.hpp"
+#include "logger.hpp"
+
+TimerWheel::TimerWheel(uint64_t now_ms)
+    : m_heads(OVERFLOW_LIST + 1, NIL), m_current(now_ms) {
+}
+
+void TimerWheel::reserve(size_t count) {
+    while (m_capacity < count) {
+        std::unique_ptr<Node[]> block(new Node[BLOCK_SIZE]);
+        // Chain the new block into the free list, lowest index first
+        for (uint32_t i = BLOCK_SIZE; i-- > 0;) {
+            block[i].next = m_freeHead;
+            m_freeHead = m_capacity + i;
+        }
+        m_blocks.push_back(std::move(block));
+        m_capacity += BLOCK_SIZE;
+    }
+}
+
+uint32_t TimerWheel::allocateNode() {
+    if (m_freeHead == NIL) {
+        reserve(static_cast<size_t>(m_capacity) + BLOCK_SIZE);
+    }
+    uint32_t index = m_freeHead;
+    m_freeHead = node(index).next;
+    return index;
+}
+
+void TimerWheel::freeNode(uint32_t index) {
+    Node& n = node(index);
+    ++n.generation;
+    if (n.generation == 0) n.generation = 1; // Keep ids non-zero after wraparound
+    n.state = State::Free;
+    n.callback = nullptr;
+    n.list = NIL;
+    n.prev = NIL;
+    n.next = m_freeHead;
+    m_freeHead = index;
+}
+
+TimerWheel::Node* TimerWheel::lookup(TimerId id) {
+    uint32_t index = static_cast<uint32_t>(id & 0xffffffffu);
+    uint32_t generation = static_cast<uint32_t>(id >> 32);
+    if (index >= m_capacity) {
+        return nullptr;
+    }
+    Node& n = node(index);
+    if (n.generation != generation || n.state == State::Free) {
+        return nullptr;
+    }
+    return &n;
+}
+
+void TimerWheel::link(uint32_t index) {
+    Node& n = node(index);
+    uint32_t list = OVERFLOW_LIST;
+    for (int level = 0; level < LEVELS; ++level) {
+        int shift = SLOT_BITS * (level + 1);
+        // Same block one level up: the timer belongs in this level
+        if ((n.expires >> shift) == (m_current >> shift)) {
+            list = level * SLOTS + ((n.expires >> (SLOT_BITS * level)) & SLOT_MASK);
+            m_occupied[level] |= 1ull << (list % SLOTS);
+            break;
+        }
+    }
+
+    n.list = list;
+    n.prev = NIL;
+    n.next = m_heads[list];
+    if (n.next != NIL) {
+        node(n.next).prev = index;
+    }
+    m_heads[list] = index;
+}
+
+void TimerWheel::unlink(uint32_t index) {
+    Node& n = node(index);
+    if (n.prev != NIL) {
+        node(n.prev).next = n.next;
+    } else {
+        m_heads[n.list] = n.next;
+    }
+    if (n.next != NIL) {
+        node(n.next).prev = n.prev;
+    }
+    if (m_heads[n.list] == NIL && n.list != OVERFLOW_LIST) {
+        m_occupied[n.list / SLOTS] &= ~(1ull << (n.list % SLOTS));
+    }
+    n.list = NIL;
+    n.prev = n.next = NIL;
+}
+
+TimerWheel::TimerId TimerWheel::add(uint64_t expires_at_ms, Callback callback) {
+    uint32_t index = allocateNode();
+    Node& n = node(index);
+    // The current tick has already been processed
+    n.expires = expires_at_ms > m_current ? expires_at_ms : m_current + 1;
+    n.state = State::Armed;
+    n.callback = std::move(callback);
+    link(index);
+    ++m_armed;
+    return (static_cast<TimerId>(n.generation) << 32) | index;
+}
+
+bool TimerWheel::cancel(TimerId id) {
+    Node* n = lookup(id);
+    if (n == nullptr) {
+        return false;
+    }
+    uint32_t index = static_cast<uint32_t>(id & 0xffffffffu);
+    if (n->state == State::Firing) {
+        // Cancelled from inside its own callback; fire() frees it afterwards
+        n->state = State::Free;
+        return true;
+    }
+    unlink(index);
+    freeNode(index);
+    --m_armed;
+    return true;
+}
+
+bool TimerWheel::reset(TimerId id, uint64_t expires_at_ms) {
+    Node* n = lookup(id);
+    if (n == nullptr) {
+        return false;
+    }
+    uint32_t index = static_cast<uint32_t>(id & 0xffffffffu);
+    if (n->state == State::Armed) {
+        unlink(index);
+    } else {
+        ++m_armed; // Re-armed from inside its own callback
+    }
+    n->expires = expires_at_ms > m_current ? expires_at_ms : m_current + 1;
+    n->state = State::Armed;
+    link(index);
+    return true;
+}
+
+uint64_t TimerWheel::nextEventTick() const {
+    for (int level = 0; level < LEVELS; ++level) {
+        uint32_t current = (m_current >> (SLOT_BITS * level)) & SLOT_MASK;
+        uint64_t pending = current == SLOT_MASK ? 0 : m_occupied[level] & (~0ull << (current + 1));
+        if (pending != 0) {
+            // Level 0 slots fire at their tick, higher slots cascade at their start
+            uint64_t slot = static_cast<uint64_t>(__builtin_ctzll(pending));
+            int block_shift = SLOT_BITS * (level + 1);
+            return ((m_current >> block_shift) << block_shift) | (slot << (SLOT_BITS * level));
+        }
+    }
+    if (m_heads[OVERFLOW_LIST] != NIL) {
+        int shift = SLOT_BITS * LEVELS;
+        return ((m_current >> shift) + 1) << shift;
+    }
+    return UINT64_MAX;
+}
+
+int TimerWheel::nextTimeout(uint64_t now_ms) const {
+    uint64_t tick = nextEventTick();
+    if (tick == UINT64_MAX) {
+        return -1;
+    }
+    if (tick <= now_ms) {
+        return 0;
+    }
+    uint64_t delay = tick - now_ms;
+    return delay > INT_MAX ? INT_MAX : static_cast<int>(delay);
+}
+
+void TimerWheel::cascade(uint32_t list) {
+    // Detach first: overflow timers that are still too far out go back to the same list
+    uint32_t index = m_heads[list];
+    m_heads[list] = NIL;
+    if (list != OVERFLOW_LIST) {
+        m_occupied[list / SLOTS] &= ~(1ull << (list % SLOTS));
+    }
+    while (index != NIL) {
+        uint32_t next = node(index).next;
+        link(index); // Lands in a lower level, or the level 0 slot of this tick
+        index = next;
+    }
+}
+
+void TimerWheel::fire(uint32_t list) {
+    while (m_heads[list] != NIL) {
+        uint32_t index = m_heads[list];
+        unlink(index);
+        Node& n = node(index);  // Blocks never move, safe across callbacks
+        n.state = State::Firing;
+        --m_armed;
+        try {
+            n.callback();
+        } catch (const std::exception& e) {
+            LOG_ERROR("Timer callback threw: {}", e.what());
+        } catch (...) {
+            LOG_ERROR("Timer callback threw an unknown exception");
+        }
+        // Still Armed means the callback reset its own timer
+        if (n.state != State::Armed) {
+            freeNode(index);
+        }
+    }
+}
+
+void TimerWheel::advance(uint64_t now_ms) {
+    while (m_current < now_ms) {
+        uint64_t tick = nextEventTick();
+        if (tick > now_ms) {
+            // Nothing due before now_ms; occupied slots stay ahead of the cursor
+            m_current = now_ms;
+            return;
+        }
+        m_current = tick;
+
+        // Crossing into a new block of a level pulls its slot down, top first
+        if ((m_current & ((1ull << (SLOT_BITS * LEVELS)) - 1)) == 0) {
+            cascade(OVERFLOW_LIST);
+        }
+        for (int level = LEVELS - 1; level >= 1; --level) {
+            if ((m_current & ((1ull << (SLOT_BITS * level)) - 1)) == 0) {
+                cascade(level * SLOTS + ((m_current >> (SLOT_BITS * level)) & SLOT_MASK));
+            }
+        }
+        fire(m_current & SLOT_MASK);
+    }
+}
@@ -0,0 +1,194 @@
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include "tls.hpp"
+
+#ifdef REACTOR_TLS
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+
+namespace {
+
+std::string sslError() {
+    char buffer[256] = "unknown error";
+    unsigned long code = ERR_peek_last_error();
+    if (code != 0) {
+        ERR_error_string_n(code, buffer, sizeof(buffer));
+    }
+    ERR_clear_error();
+    return buffer;
+}
+
+int clampLength(size_t len) {
+    return len > static_cast<size_t>(INT_MAX) ? INT_MAX : static_cast<int>(len);
+}
+
+} // namespace
+
+TlsContext::TlsContext(const TlsOptions& options) : m_ctx(SSL_CTX_new(TLS_server_method())) {
+    if (m_ctx == nullptr) {
+        throw std::runtime_error("Failed to create TLS context: " + sslError());
+    }
+    auto fail = [this](const std::string& what) {
+        std::string reason = what + ": " + sslError();
+        SSL_CTX_free(m_ctx);
+        throw std::runtime_error(reason);
+    };
+    SSL_CTX_set_min_proto_version(m_ctx, TLS1_2_VERSION);
+    // Nothing but application data may follow the handshake: no
+    // renegotiation and no session tickets, which also keeps the kernel's
+    // record path free of control messages. A peer that closes without
+    // close_notify reads as an ordinary end of stream.
+    uint64_t flags = SSL_OP_NO_RENEGOTIATION | SSL_OP_IGNORE_UNEXPECTED_EOF;
+    if (options.ktls) {
+        flags |= SSL_OP_ENABLE_KTLS;
+    }
+    SSL_CTX_set_options(m_ctx, flags);
+    SSL_CTX_set_num_tickets(m_ctx, 0);
+    // Writes come straight from WriteBuffer chunks, which grow between retries
+    SSL_CTX_set_mode(m_ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER |
+                            SSL_MODE_RELEASE_BUFFERS);
+
+    if (SSL_CTX_use_certificate_chain_file(m_ctx, options.cert_file.c_str()) != 1) {
+        fail("Failed to load TLS certificate " + options.cert_file);
+    }
+    const std::string& key = options.key_file.empty() ? options.cert_file : options.key_file;
+    if (SSL_CTX_use_PrivateKey_file(m_ctx, key.c_str(), SSL_FILETYPE_PEM) != 1) {
+        fail("Failed to load TLS private key " + key);
+    }
+    if (SSL_CTX_check_private_key(m_ctx) != 1) {
+        fail("TLS private key does not match the certificate");
+    }
+}
+
+TlsContext::~TlsContext() {
+    SSL_CTX_free(m_ctx);
+}
+
+bool TlsContext::available() {
+    return true;
+}
+
+TlsSession::TlsSession(TlsContext& context, int fd) : m_ssl(SSL_new(context.m_ctx)) {
+    if (m_ssl == nullptr || SSL_set_fd(m_ssl, fd) != 1) {
+        SSL_free(m_ssl);
+        throw std::runtime_error("Failed to create TLS session: " + sslError());
+    }
+    SSL_set_accept_state(m_ssl);
+}
+
+TlsSession::~TlsSession() {
+    SSL_free(m_ssl);
+}
+
+TlsStatus TlsSession::handshake() {
+    int ret = SSL_do_handshake(m_ssl);
+    if (ret == 1) {
+        m_established = true;
+#ifndef OPENSSL_NO_KTLS
+        // OpenSSL moved the keys into the kernel during the handshake if it could
+        m_kernelSend = BIO_get_ktls_send(SSL_get_wbio(m_ssl)) != 0;
+        m_kernelRecv = BIO_get_ktls_recv(SSL_get_rbio(m_ssl)) != 0;
+#endif
+        return TlsStatus::Done;
+    }
+    switch (SSL_get_error(m_ssl, ret)) {
+    case SSL_ERROR_WANT_READ:
+        return TlsStatus::WantRead;
+    case SSL_ERROR_WANT_WRITE:
+        return TlsStatus::WantWrite;
+    default:
+        ERR_clear_error();
+        return TlsStatus::Failed;
+    }
+}
+
+namespace {
+
+ssize_t ioResult(SSL* ssl, int ret) {
+    switch (SSL_get_error(ssl, ret)) {
+    case SSL_ERROR_ZERO_RETURN:
+        return 0;
+    case SSL_ERROR_WANT_READ:
+    case SSL_ERROR_WANT_WRITE:
+        errno = EAGAIN;
+        return -1;
+    case SSL_ERROR_SYSCALL:
+        // errno is the socket's own (EPIPE, ECONNRESET, ...)
+        ERR_clear_error();
+        if (errno == 0) {
+            errno = EIO;
+        }
+        return -1;
+    default:
+        ERR_clear_error();
+        errno = EIO;
+        return -1;
+    }
+}
+
+} // namespace
+
+ssize_t TlsSession::read(char* data, size_t len) {
+    int ret = SSL_read(m_ssl, data, clampLength(len));
+    return ret > 0 ? ret : ioResult(m_ssl, ret);
+}
+
+ssize_t TlsSession::write(const char* data, size_t len) {
+    int ret = SSL_write(m_ssl, data, clampLength(len));
+    return ret > 0 ? ret : ioResult(m_ssl, ret);
+}
+
+size_t TlsSession::pending() const {
+    return static_cast<size_t>(SSL_pending(m_ssl));
+}
+
+void TlsSession::shutdown() {
+    if (m_established) {
+        SSL_shutdown(m_ssl);
+        ERR_clear_error();
+    }
+}
+
+#else
+
+TlsContext::TlsContext(const TlsOptions&) {
+    throw std::runtime_error("TLS support is not built in; configure with -DENABLE_TLS=ON");
+}
+
+TlsContext::~TlsContext() = default;
+
+bool TlsContext::available() {
+    return false;
+}
+
+TlsSession::TlsSession(TlsContext&, int) {
+    throw std::runtime_error("TLS support is not built in");
+}
+
+TlsSession::~TlsSession() = default;
+
+TlsStatus TlsSession::handshake() {
+    return TlsStatus::Failed;
+}
+
+ssize_t TlsSession::read(char*, size_t) {
+    errno = ENOTSUP;
+    return -1;
+}
+
+ssize_t TlsSession::write(const char*, size_t) {
+    errno = ENOTSUP;
+    return -1;
+}
+
+size_t TlsSession::pending() const {
+    return 0;
+}
+
+void TlsSession::shutdown() {
+}
+
+#endif
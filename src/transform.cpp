@@ -0,0 +1,87 @@
+#include <cstdint>
+#include "transform.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define REACTOR_X86_KERNELS 1
+#endif
+
+void uppercaseScalar(const char* in, char* out, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        unsigned char c = static_cast<unsigned char>(in[i]);
+        // Single unsigned compare covers 'a'..'z' without a locale lookup
+        out[i] = static_cast<char>(static_cast<unsigned char>(c - 'a') < 26 ? c - 0x20 : c);
+    }
+}
+
+#ifdef REACTOR_X86_KERNELS
+
+// Bytes are biased so 'a'..'z' map onto the 26 smallest signed values; one
+// signed compare then yields the lowercase mask, and 0x20 is subtracted there.
+
+void uppercaseSse2(const char* in, char* out, size_t len) {
+    const __m128i bias = _mm_set1_epi8(static_cast<char>(0x80 - 'a'));
+    const __m128i limit = _mm_set1_epi8(static_cast<char>(-128 + 26));
+    const __m128i flip = _mm_set1_epi8(0x20);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i lower = _mm_cmplt_epi8(_mm_add_epi8(bytes, bias), limit);
+        __m128i result = _mm_sub_epi8(bytes, _mm_and_si128(lower, flip));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), result);
+    }
+    uppercaseScalar(in + i, out + i, len - i);
+}
+
+__attribute__((target("avx2")))
+void uppercaseAvx2(const char* in, char* out, size_t len) {
+    const __m256i bias = _mm256_set1_epi8(static_cast<char>(0x80 - 'a'));
+    const __m256i limit = _mm256_set1_epi8(static_cast<char>(-128 + 26));
+    const __m256i flip = _mm256_set1_epi8(0x20);
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+        __m256i lower = _mm256_cmpgt_epi8(limit, _mm256_add_epi8(bytes, bias));
+        __m256i result = _mm256_sub_epi8(bytes, _mm256_and_si256(lower, flip));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), result);
+    }
+    uppercaseSse2(in + i, out + i, len - i);
+}
+
+PayloadTransform selectUppercaseKernel() {
+    static const PayloadTransform kernel = [] {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return &uppercaseAvx2;
+        }
+        if (__builtin_cpu_supports("sse2")) {
+            return &uppercaseSse2;
+        }
+        return &uppercaseScalar;
+    }();
+    return kernel;
+}
+
+#else
+
+// Non-x86 builds: the vector entry points degrade to the scalar kernel
+void uppercaseSse2(const char* in, char* out, size_t len) {
+    uppercaseScalar(in, out, len);
+}
+
+void uppercaseAvx2(const char* in, char* out, size_t len) {
+    uppercaseScalar(in, out, len);
+}
+
+PayloadTransform selectUppercaseKernel() {
+    return &uppercaseScalar;
+}
+
+#endif
+
+const char* uppercaseKernelName(PayloadTransform kernel) {
+    if (kernel == &uppercaseAvx2) return "avx2";
+    if (kernel == &uppercaseSse2) return "sse2";
+    if (kernel == &uppercaseScalar) return "scalar";
+    return "custom";
+}
@@ -0,0 +1,228 @@
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <netinet/udp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include "udp_server.hpp"
+#include "logger.hpp"
+
+namespace {
+
+// Largest buffer GRO can hand over: one maximal UDP payload
+constexpr size_t GRO_SLOT_SIZE = 65535;
+
+// Segment size of a GRO-coalesced buffer, 0 for a plain datagram
+size_t groSegmentSize(const msghdr& hdr) {
+    for (const cmsghdr* cmsg = CMSG_FIRSTHDR(&hdr); cmsg != nullptr;
+         cmsg = CMSG_NXTHDR(const_cast<msghdr*>(&hdr), const_cast<cmsghdr*>(cmsg))) {
+        if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+            int segment;
+            std::memcpy(&segment, CMSG_DATA(cmsg), sizeof(segment));
+            return segment > 0 ? static_cast<size_t>(segment) : 0;
+        }
+    }
+    return 0;
+}
+
+} // namespace
+
+UDPServer::UDPServer(Reactor& reactor, int port, const UDPServerOptions& options, LoopMetrics* metrics)
+    : m_reactor(reactor),
+      m_socket(SocketType::Datagram),
+      m_transform(options.transform ? options.transform : selectUppercaseKernel()),
+      m_metrics(metrics),
+      m_batchesPerWakeup(options.batches_per_wakeup == 0 ? SIZE_MAX : options.batches_per_wakeup) {
+    if (options.batch_size == 0) {
+        throw std::invalid_argument("UDPServerOptions::batch_size must be at least 1");
+    }
+    if (options.max_datagram == 0 || options.max_datagram > GRO_SLOT_SIZE) {
+        throw std::invalid_argument("UDPServerOptions::max_datagram must be between 1 and 65535");
+    }
+
+    m_socket.setReuseAddr();
+    if (options.reuse_port) {
+        m_socket.setReusePort();
+    }
+    m_socket.setNonBlocking();
+    SocketOptions buffers;
+    buffers.send_buffer = options.socket_options.send_buffer;
+    buffers.recv_buffer = options.socket_options.recv_buffer;
+    m_socket.apply(buffers);
+    if (options.socket_options.busy_poll_us > 0) {
+        try {
+            m_socket.setBusyPoll(options.socket_options.busy_poll_us);
+        } catch (const std::exception& e) {
+            LOG_WARN("{}, busy polling disabled", e.what());
+        }
+    }
+    m_socket.bind(port);
+    if (options.gso) {
+        m_gso = true;
+        enableOffloads(options.gro);
+    }
+
+    m_slotSize = m_gro ? GRO_SLOT_SIZE : options.max_datagram;
+    const size_t batch = options.batch_size;
+    m_arena.reset(new char[batch * m_slotSize]);
+    m_slots.resize(batch);
+    m_rx.resize(batch);
+    m_tx.resize(batch);
+    m_txDatagrams.resize(batch);
+    for (size_t i = 0; i < batch; ++i) {
+        Slot& slot = m_slots[i];
+        slot.rx_iov.iov_base = m_arena.get() + i * m_slotSize;
+        slot.rx_iov.iov_len = m_slotSize;
+        msghdr& hdr = m_rx[i].msg_hdr;
+        hdr = msghdr{};
+        hdr.msg_name = &slot.peer;
+        hdr.msg_iov = &slot.rx_iov;
+        hdr.msg_iovlen = 1;
+        hdr.msg_control = slot.rx_control;
+        m_tx[i].msg_hdr = msghdr{};
+    }
+
+    m_reactor.registerHandler(m_socket.getFd(), EPOLLIN | EPOLLET, [this](int, uint32_t) {
+        handleReadable();
+    });
+}
+
+UDPServer::~UDPServer() {
+    m_reactor.unregisterHandler(m_socket.getFd());
+}
+
+void UDPServer::enableOffloads(bool gro) {
+    // A zero default segment size leaves plain sends alone; failing means the
+    // kernel has no UDP GSO at all
+    int segment = 0;
+    if (setsockopt(m_socket.getFd(), SOL_UDP, UDP_SEGMENT, &segment, sizeof(segment)) == -1) {
+        LOG_INFO("UDP_SEGMENT unsupported ({}), sending datagrams one by one", LogErrno{errno});
+        m_gso = false;
+        return;
+    }
+    // GRO'd buffers are answered with a single GSO send, so GRO needs GSO
+    int one = 1;
+    if (gro && setsockopt(m_socket.getFd(), SOL_UDP, UDP_GRO, &one, sizeof(one)) == 0) {
+        m_gro = true;
+    }
+}
+
+void UDPServer::handleReadable() {
+    const int fd = m_socket.getFd();
+    const size_t batch = m_slots.size();
+    for (size_t batches = 0;; ++batches) {
+        if (batches == m_batchesPerWakeup) {
+            // Possibly more queued; the edge will not be reported again, so
+            // come back through the ready queue after the other handlers
+            if (m_metrics != nullptr) {
+                m_metrics->datagram_yields.add();
+            }
+            m_reactor.defer(fd, EPOLLIN);
+            return;
+        }
+        for (size_t i = 0; i < batch; ++i) {
+            msghdr& hdr = m_rx[i].msg_hdr;
+            hdr.msg_namelen = sizeof(sockaddr_storage);
+            hdr.msg_controllen = m_gro ? sizeof(Slot::rx_control) : 0;
+        }
+        int received = recvmmsg(fd, m_rx.data(), static_cast<unsigned int>(batch), 0, nullptr);
+        if (received == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                LOG_WARN("UDP receive failed on fd {}: {}", fd, LogErrno{errno});
+            }
+            return;
+        }
+
+        uint64_t datagrams = 0;
+        uint64_t truncated = 0;
+        size_t replies = 0;
+        for (int i = 0; i < received; ++i) {
+            Slot& slot = m_slots[i];
+            const msghdr& in = m_rx[i].msg_hdr;
+            if (in.msg_flags & MSG_TRUNC) {
+                ++truncated;
+                continue;
+            }
+            size_t len = m_rx[i].msg_len;
+            size_t segment = m_gro ? groSegmentSize(in) : 0;
+            char* data = static_cast<char*>(slot.rx_iov.iov_base);
+            m_transform(data, data, len);
+
+            // The reply goes out from the receive slot itself
+            slot.tx_iov.iov_base = data;
+            slot.tx_iov.iov_len = len;
+            msghdr& out = m_tx[replies].msg_hdr;
+            out.msg_name = &slot.peer;
+            out.msg_namelen = in.msg_namelen;
+            out.msg_iov = &slot.tx_iov;
+            out.msg_iovlen = 1;
+            uint32_t count = 1;
+            if (segment > 0 && segment < len) {
+                // Hand the coalesced buffer back whole; the kernel re-splits it
+                out.msg_control = slot.tx_control;
+                out.msg_controllen = sizeof(slot.tx_control);
+                cmsghdr* cmsg = CMSG_FIRSTHDR(&out);
+                cmsg->cmsg_level = SOL_UDP;
+                cmsg->cmsg_type = UDP_SEGMENT;
+                cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                uint16_t size = static_cast<uint16_t>(segment);
+                std::memcpy(CMSG_DATA(cmsg), &size, sizeof(size));
+                count = static_cast<uint32_t>((len + segment - 1) / segment);
+            } else {
+                out.msg_control = nullptr;
+                out.msg_controllen = 0;
+            }
+            m_txDatagrams[replies++] = count;
+            datagrams += count;
+        }
+
+        if (m_metrics != nullptr) {
+            m_metrics->datagrams_in.add(datagrams);
+            m_metrics->datagram_batches.add();
+            m_metrics->datagrams_dropped.add(truncated);
+        }
+        sendBatch(replies);
+
+        // A short batch drained the queue; anything newer raises a fresh edge
+        if (static_cast<size_t>(received) < batch) {
+            return;
+        }
+    }
+}
+
+void UDPServer::sendBatch(size_t count) {
+    const int fd = m_socket.getFd();
+    uint64_t sent_datagrams = 0;
+    uint64_t dropped = 0;
+    size_t next = 0;
+    while (next < count) {
+        int sent = sendmmsg(fd, m_tx.data() + next, static_cast<unsigned int>(count - next), 0);
+        if (sent == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                // Datagrams are not queued for later: the rest of the batch is
+                // lost, as it would be anywhere else on the path
+                for (; next < count; ++next) {
+                    dropped += m_txDatagrams[next];
+                }
+                break;
+            }
+            // Only this reply failed (e.g. the peer's address is unusable)
+            LOG_DEBUG("UDP send failed on fd {}: {}", fd, LogErrno{errno});
+            dropped += m_txDatagrams[next++];
+            continue;
+        }
+        for (int i = 0; i < sent; ++i) {
+            sent_datagrams += m_txDatagrams[next++];
+        }
+    }
+    if (m_metrics != nullptr) {
+        m_metrics->datagrams_out.add(sent_datagrams);
+        m_metrics->datagrams_dropped.add(dropped);
+    }
+}
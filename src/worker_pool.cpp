@@ -0,0 +1,60 @@
+#include <exception>
+#include <stdexcept>
+#include "worker_pool.hpp"
+#include "logger.hpp"
+
+WorkerPool::WorkerPool(size_t threads) {
+    if (threads == 0) {
+        throw std::invalid_argument("WorkerPool needs at least one thread");
+    }
+    m_threads.reserve(threads);
+    for (size_t i = 0; i < threads; ++i) {
+        m_threads.emplace_back([this, i] { workerLoop(i); });
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_ready.notify_all();
+    for (auto& thread : m_threads) {
+        thread.join();
+    }
+}
+
+void WorkerPool::submit(Job job) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_jobs.push_back(std::move(job));
+    }
+    m_ready.notify_one();
+}
+
+size_t WorkerPool::pending() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_jobs.size();
+}
+
+void WorkerPool::workerLoop(size_t index) {
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_ready.wait(lock, [this] { return m_stopping || !m_jobs.empty(); });
+            if (m_stopping) {
+                return;
+            }
+            job = std::move(m_jobs.front());
+            m_jobs.pop_front();
+        }
+        try {
+            job();
+        } catch (const std::exception& e) {
+            LOG_ERROR("Worker {} job threw: {}", index, e.what());
+        } catch (...) {
+            LOG_ERROR("Worker {} job threw an unknown exception", index);
+        }
+    }
+}
@@ -0,0 +1,284 @@
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include "write_buffer.hpp"
+
+namespace {
+
+// Serial-number comparison, zero-copy sequence numbers wrap at 2^32
+bool seqBefore(uint32_t a, uint32_t b) {
+    return static_cast<int32_t>(a - b) < 0;
+}
+
+} // namespace
+
+WriteBuffer::Pool::Pool(size_t max_cached, Gauge* in_use, Gauge* cached)
+    : m_maxCached(max_cached), m_inUseGauge(in_use), m_cachedGauge(cached) {
+    m_free.reserve(max_cached);
+}
+
+WriteBuffer::Pool::~Pool() {
+    for (Chunk* chunk : m_free) {
+        delete chunk;
+    }
+}
+
+WriteBuffer::Chunk* WriteBuffer::Pool::acquire() {
+    Chunk* chunk;
+    if (m_free.empty()) {
+        // Plain new: the payload does not need to be zeroed
+        chunk = new Chunk;
+    } else {
+        chunk = m_free.back();
+        m_free.pop_back();
+        if (m_cachedGauge) m_cachedGauge->add(-1);
+    }
+    ++m_inUse;
+    if (m_inUseGauge) m_inUseGauge->add(1);
+    return chunk;
+}
+
+void WriteBuffer::Pool::release(Chunk* chunk) {
+    --m_inUse;
+    if (m_inUseGauge) m_inUseGauge->add(-1);
+    if (m_free.size() < m_maxCached) {
+        m_free.push_back(chunk);
+        if (m_cachedGauge) m_cachedGauge->add(1);
+    } else {
+        delete chunk;
+    }
+}
+
+void WriteBuffer::ChunkDeleter::operator()(Chunk* chunk) const {
+    if (pool) {
+        pool->release(chunk);
+    } else {
+        delete chunk;
+    }
+}
+
+WriteBuffer::ChunkPtr WriteBuffer::allocateChunk() {
+    Chunk* chunk = m_pool ? m_pool->acquire() : new Chunk;
+    chunk->begin = chunk->end = 0;
+    chunk->zc_pinned = false;
+    return ChunkPtr(chunk, ChunkDeleter{m_pool});
+}
+
+void WriteBuffer::releaseChunk(ChunkPtr chunk) {
+    if (isPinned(*chunk)) {
+        // The kernel may still be reading it; hold on until it says otherwise
+        m_zcRetired.push_back(std::move(chunk));
+    }
+    // Otherwise the deleter returns it to the pool
+}
+
+void WriteBuffer::append(const char* data, size_t len) {
+    while (len > 0) {
+        if (m_chunks.empty() || m_chunks.back()->end == CHUNK_SIZE) {
+            m_chunks.push_back(allocateChunk());
+        }
+        Chunk& tail = *m_chunks.back();
+        size_t n = std::min(len, CHUNK_SIZE - tail.end);
+        std::memcpy(tail.data + tail.end, data, n);
+        tail.end += n;
+        m_size += n;
+        data += n;
+        len -= n;
+    }
+}
+
+char* WriteBuffer::prepare(size_t& len) {
+    if (m_chunks.empty() || m_chunks.back()->end == CHUNK_SIZE) {
+        m_chunks.push_back(allocateChunk());
+    }
+    Chunk& tail = *m_chunks.back();
+    len = std::min(len, CHUNK_SIZE - tail.end);
+    return tail.data + tail.end;
+}
+
+void WriteBuffer::commit(size_t len) {
+    Chunk& tail = *m_chunks.back();
+    tail.end += len;
+    m_size += len;
+}
+
+void WriteBuffer::consume(size_t len) {
+    len = std::min(len, m_size);
+    m_size -= len;
+    size_t drained = 0;
+    while (len > 0) {
+        Chunk& head = *m_chunks[drained];
+        size_t n = std::min(len, head.end - head.begin);
+        head.begin += n;
+        len -= n;
+        if (head.begin == head.end) {
+            releaseChunk(std::move(m_chunks[drained]));
+            ++drained;
+        }
+    }
+    m_chunks.erase(m_chunks.begin(), m_chunks.begin() + static_cast<std::ptrdiff_t>(drained));
+    if (m_size == 0) {
+        clear(); // Drop a reserved-but-unfilled tail chunk too
+    }
+}
+
+std::string_view WriteBuffer::front() const {
+    if (m_chunks.empty()) {
+        return {};
+    }
+    const Chunk& chunk = *m_chunks.front();
+    return std::string_view(chunk.data + chunk.begin, chunk.end - chunk.begin);
+}
+
+ssize_t WriteBuffer::writeTo(int fd, size_t limit) {
+    struct iovec iov[MAX_IOVECS];
+    int iovcnt = 0;
+    size_t left = limit;
+    for (auto it = m_chunks.begin(); it != m_chunks.end() && iovcnt < MAX_IOVECS && left > 0; ++it) {
+        Chunk& chunk = **it;
+        iov[iovcnt].iov_base = chunk.data + chunk.begin;
+        iov[iovcnt].iov_len = std::min(chunk.end - chunk.begin, left);
+        left -= iov[iovcnt].iov_len;
+        ++iovcnt;
+    }
+    if (iovcnt == 0) {
+        return 0;
+    }
+
+    ssize_t written = writev(fd, iov, iovcnt);
+    if (written > 0) {
+        consume(static_cast<size_t>(written));
+    }
+    return written;
+}
+
+ssize_t WriteBuffer::writeZeroCopy(int fd, size_t limit) {
+    struct iovec iov[MAX_IOVECS];
+    int iovcnt = 0;
+    size_t left = limit;
+    for (auto it = m_chunks.begin(); it != m_chunks.end() && iovcnt < MAX_IOVECS && left > 0; ++it) {
+        Chunk& chunk = **it;
+        iov[iovcnt].iov_base = chunk.data + chunk.begin;
+        iov[iovcnt].iov_len = std::min(chunk.end - chunk.begin, left);
+        left -= iov[iovcnt].iov_len;
+        ++iovcnt;
+    }
+    if (iovcnt == 0) {
+        return 0;
+    }
+
+    msghdr msg{};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = static_cast<size_t>(iovcnt);
+    ssize_t written = sendmsg(fd, &msg, MSG_ZEROCOPY | MSG_NOSIGNAL);
+    if (written == -1 && errno == ENOBUFS) {
+        return writeTo(fd, limit);
+    }
+    if (written > 0) {
+        // Every chunk this send read from stays pinned until its completion
+        uint32_t seq = m_zcNext++;
+        size_t remaining = static_cast<size_t>(written);
+        for (auto it = m_chunks.begin(); it != m_chunks.end() && remaining > 0; ++it) {
+            Chunk& chunk = **it;
+            chunk.zc_seq = seq;
+            chunk.zc_pinned = true;
+            remaining -= std::min(remaining, chunk.end - chunk.begin);
+        }
+        consume(static_cast<size_t>(written));
+    }
+    return written;
+}
+
+int WriteBuffer::reapZeroCopy(int fd, size_t& copied) {
+    int completions = 0;
+    while (true) {
+        char control[128];
+        msghdr msg{};
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(fd, &msg, MSG_ERRQUEUE) == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return completions;
+            }
+            return -1;
+        }
+        for (cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm != nullptr; cm = CMSG_NXTHDR(&msg, cm)) {
+            bool recverr = (cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                           (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR);
+            if (!recverr) {
+                continue;
+            }
+            sock_extended_err err;
+            std::memcpy(&err, CMSG_DATA(cm), sizeof(err));
+            if (err.ee_origin != SO_EE_ORIGIN_ZEROCOPY || err.ee_errno != 0) {
+                return -1;
+            }
+            // ee_info..ee_data is an inclusive range of confirmed sends
+            completeZeroCopy(err.ee_info, err.ee_data);
+            if (err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                copied += err.ee_data - err.ee_info + 1;
+            }
+            ++completions;
+        }
+    }
+}
+
+void WriteBuffer::completeZeroCopy(uint32_t first, uint32_t last) {
+    m_zcEarly.emplace_back(first, last);
+    // Advance the confirmed prefix over every range that now touches it
+    bool advanced = true;
+    while (advanced) {
+        advanced = false;
+        for (size_t i = 0; i < m_zcEarly.size(); ++i) {
+            if (!seqBefore(m_zcDone, m_zcEarly[i].first)) {
+                if (!seqBefore(m_zcEarly[i].second, m_zcDone)) {
+                    m_zcDone = m_zcEarly[i].second + 1;
+                }
+                m_zcEarly[i] = m_zcEarly.back();
+                m_zcEarly.pop_back();
+                advanced = true;
+                break;
+            }
+        }
+    }
+
+    // Retired chunks are in send order, so the confirmed ones form a prefix
+    size_t confirmed = 0;
+    while (confirmed < m_zcRetired.size() && !isPinned(*m_zcRetired[confirmed])) {
+        ++confirmed;
+    }
+    m_zcRetired.erase(m_zcRetired.begin(), m_zcRetired.begin() + static_cast<std::ptrdiff_t>(confirmed));
+}
+
+bool WriteBuffer::isPinned(const Chunk& chunk) const {
+    return chunk.zc_pinned && !seqBefore(chunk.zc_seq, m_zcDone);
+}
+
+size_t WriteBuffer::zeroCopyPending() const {
+    size_t pending = m_zcRetired.size();
+    for (const auto& chunk : m_chunks) {
+        if (isPinned(*chunk)) ++pending;
+    }
+    return pending;
+}
+
+void WriteBuffer::abandonZeroCopy() {
+    clear();    // Pinned chunks among them move to m_zcRetired
+    for (auto& chunk : m_zcRetired) {
+        static_cast<void>(chunk.release());
+    }
+    m_zcRetired.clear();
+    m_zcEarly.clear();
+}
+
+void WriteBuffer::clear() {
+    for (auto& chunk : m_chunks) {
+        releaseChunk(std::move(chunk));
+    }
+    m_chunks.clear();
+    m_size = 0;
+}
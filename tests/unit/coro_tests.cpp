@@ -0,0 +1,184 @@
+// Coroutine layer tests; compiled only when configured with ENABLE_COROUTINES
+#ifdef REACTOR_COROUTINES
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <catch2/catch_test_macros.hpp>
+#include "../../include/coro.hpp"
+
+namespace {
+
+Task<int> square(int x) {
+    co_return x * x;
+}
+
+Task<int> sumOfSquares(int n) {
+    int total = 0;
+    for (int i = 1; i <= n; ++i) {
+        total += co_await square(i);
+    }
+    co_return total;
+}
+
+Task<int> failing() {
+    throw std::runtime_error("boom");
+    co_return 0;
+}
+
+Task<void> expectFailure(bool& caught) {
+    try {
+        co_await failing();
+    } catch (const std::runtime_error&) {
+        caught = true;
+    }
+}
+
+Task<void> store(int& out, int n) {
+    out = co_await sumOfSquares(n);
+}
+
+void stop(Reactor& reactor) {
+    uint64_t one = 1;
+    write(reactor.getShutdownFd(), &one, sizeof(one));
+}
+
+struct EchoServer {
+    Reactor& reactor;
+    int expected;       // Connections to serve before stopping the loop
+    int accepted = 0;
+    int finished = 0;
+};
+
+Task<void> echoConnection(EchoServer& server, int fd) {
+    AsyncSocket connection(server.reactor, Socket(fd));
+    char buffer[256];
+    while (true) {
+        ssize_t n = co_await connection.async_read(buffer, sizeof(buffer));
+        if (n <= 0) {
+            break;
+        }
+        for (ssize_t i = 0; i < n; ++i) {
+            buffer[i] = static_cast<char>(buffer[i] >= 'a' && buffer[i] <= 'z' ? buffer[i] - 32 : buffer[i]);
+        }
+        if (co_await connection.async_write(buffer, static_cast<size_t>(n)) == -1) {
+            break;
+        }
+    }
+    if (++server.finished == server.expected) {
+        stop(server.reactor);
+    }
+}
+
+Task<void> acceptLoop(EchoServer& server, AsyncSocket& listener) {
+    while (server.accepted < server.expected) {
+        ssize_t fd = co_await listener.async_accept();
+        if (fd == -1) {
+            break;
+        }
+        ++server.accepted;
+        spawn(echoConnection(server, static_cast<int>(fd)));
+    }
+}
+
+} // namespace
+
+TEST_CASE("Coroutine tasks", "[coro]") {
+    SECTION("Awaited tasks return values and run to completion synchronously") {
+        int result = 0;
+        spawn(store(result, 10));
+        REQUIRE(result == 385);
+    }
+
+    SECTION("Exceptions propagate to the awaiting coroutine") {
+        bool caught = false;
+        spawn(expectFailure(caught));
+        REQUIRE(caught);
+    }
+
+    SECTION("Frames are recycled by the pool after warm-up") {
+        int result = 0;
+        spawn(store(result, 50));
+        uint64_t warm = FramePool::heapAllocations();
+        REQUIRE(FramePool::cached() > 0);
+        for (int i = 0; i < 100; ++i) {
+            spawn(store(result, 50));
+        }
+        REQUIRE(FramePool::heapAllocations() == warm);
+        REQUIRE(result == 42925);
+    }
+}
+
+TEST_CASE("Coroutine sockets resumed from Reactor dispatch", "[coro][reactor]") {
+    SECTION("async_read and async_write wait for readiness") {
+        Reactor reactor;
+        int sv[2];
+        REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+        AsyncSocket reader(reactor, Socket(sv[0]));
+        Socket peer(sv[1]);
+
+        std::string received;
+        auto readAll = [](AsyncSocket& socket, std::string& out, Reactor& r) -> Task<void> {
+            char buffer[64];
+            ssize_t n;
+            while ((n = co_await socket.async_read(buffer, sizeof(buffer))) > 0) {
+                out.append(buffer, static_cast<size_t>(n));
+            }
+            stop(r);
+        };
+        spawn(readAll(reader, received, reactor));
+        REQUIRE(received.empty());  // Suspended, nothing to read yet
+
+        std::thread writer([&] {
+            write(peer.getFd(), "hello ", 6);
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            write(peer.getFd(), "world", 5);
+            shutdown(peer.getFd(), SHUT_WR);
+        });
+        reactor.run();
+        writer.join();
+        REQUIRE(received == "hello world");
+    }
+
+    SECTION("Echo server built from async_accept") {
+        Reactor reactor;
+        Socket listen_socket;
+        listen_socket.setReuseAddr();
+        listen_socket.bind(0);
+        listen_socket.listen();
+        int port = listen_socket.getPort();
+        AsyncSocket listener(reactor, std::move(listen_socket));
+        EchoServer server{reactor, 2};
+        spawn(acceptLoop(server, listener));
+
+        std::string replies[2];
+        std::thread clients([&] {
+            for (auto& reply : replies) {
+                Socket client(socket(AF_INET, SOCK_STREAM, 0));
+                sockaddr_in addr{};
+                addr.sin_family = AF_INET;
+                addr.sin_port = htons(port);
+                addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+                if (connect(client.getFd(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1) {
+                    break;
+                }
+                std::string msg(100 * 1024, 'c');
+                write(client.getFd(), msg.data(), msg.size());
+                char buffer[4096];
+                while (reply.size() < msg.size()) {
+                    ssize_t n = read(client.getFd(), buffer, sizeof(buffer));
+                    if (n <= 0) break;
+                    reply.append(buffer, static_cast<size_t>(n));
+                }
+            }
+        });
+        reactor.run();
+        clients.join();
+        REQUIRE(replies[0] == std::string(100 * 1024, 'C'));
+        REQUIRE(replies[1] == std::string(100 * 1024, 'C'));
+        REQUIRE(server.finished == 2);
+    }
+}
+#endif
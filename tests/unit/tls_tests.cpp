@@ -0,0 +1,217 @@
+// TLS termination tests; compiled only when configured with ENABLE_TLS
+#ifdef REACTOR_TLS
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+#include <catch2/catch_test_macros.hpp>
+#include "../../include/tcp_server.hpp"
+
+namespace {
+
+// Self-signed P-256 certificate for "localhost", written as PEM files that
+// are removed again when this goes out of scope
+struct SelfSignedCert {
+    std::string cert_file;
+    std::string key_file;
+
+    SelfSignedCert() {
+        const std::string base = "/tmp/reactor_tls_test_" + std::to_string(getpid());
+        cert_file = base + ".crt";
+        key_file = base + ".key";
+
+        EVP_PKEY* key = EVP_EC_gen("P-256");
+        X509* cert = X509_new();
+        X509_set_version(cert, 2);
+        ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+        X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+        X509_gmtime_adj(X509_getm_notAfter(cert), 24 * 60 * 60);
+        X509_NAME* name = X509_get_subject_name(cert);
+        X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>("localhost"), -1, -1, 0);
+        X509_set_issuer_name(cert, name);
+        X509_set_pubkey(cert, key);
+        X509_sign(cert, key, EVP_sha256());
+
+        FILE* out = std::fopen(cert_file.c_str(), "w");
+        PEM_write_X509(out, cert);
+        std::fclose(out);
+        out = std::fopen(key_file.c_str(), "w");
+        PEM_write_PrivateKey(out, key, nullptr, nullptr, 0, nullptr, nullptr);
+        std::fclose(out);
+        X509_free(cert);
+        EVP_PKEY_free(key);
+    }
+
+    ~SelfSignedCert() {
+        unlink(cert_file.c_str());
+        unlink(key_file.c_str());
+    }
+};
+
+// Blocking TLS client that trusts only the test certificate
+class TlsClient {
+public:
+    TlsClient(int port, const std::string& ca_file) : m_socket(AddressFamily::IPv4), m_ctx(SSL_CTX_new(TLS_client_method())) {
+        SSL_CTX_load_verify_locations(m_ctx, ca_file.c_str(), nullptr);
+        SSL_CTX_set_verify(m_ctx, SSL_VERIFY_PEER, nullptr);
+        m_socket.connect(Endpoint::ipv4("127.0.0.1", port));
+        m_ssl = SSL_new(m_ctx);
+        SSL_set_fd(m_ssl, m_socket.getFd());
+        m_connected = SSL_connect(m_ssl) == 1;
+    }
+
+    ~TlsClient() {
+        SSL_free(m_ssl);
+        SSL_CTX_free(m_ctx);
+    }
+
+    bool connected() const { return m_connected; }
+
+    // Reads until reply_size bytes arrived, by default as many as were sent
+    std::string roundTrip(const std::string& msg, size_t reply_size = 0) {
+        if (reply_size == 0) {
+            reply_size = msg.size();
+        }
+        if (SSL_write(m_ssl, msg.data(), static_cast<int>(msg.size())) != static_cast<int>(msg.size())) {
+            return {};
+        }
+        std::string reply;
+        char buffer[16384];
+        while (reply.size() < reply_size) {
+            int n = SSL_read(m_ssl, buffer, sizeof(buffer));
+            if (n <= 0) break;
+            reply.append(buffer, static_cast<size_t>(n));
+        }
+        return reply;
+    }
+
+private:
+    Socket m_socket;
+    SSL_CTX* m_ctx;
+    SSL* m_ssl = nullptr;
+    bool m_connected = false;
+};
+
+void stop(TCPServer& server, std::thread& runner) {
+    uint64_t value = 1;
+    write(server.getShutdownFd(), &value, sizeof(value));
+    runner.join();
+}
+
+} // namespace
+
+TEST_CASE("TCPServer TLS termination", "[server][tls]") {
+    SelfSignedCert cert;
+    ServerConfig config;
+    config.tls.cert_file = cert.cert_file;
+    config.tls.key_file = cert.key_file;
+
+    SECTION("Handshake on the loop, then echo through the record layer") {
+        config.zerocopy_threshold = 4096;   // Disabled for TLS
+        TCPServer server(0, config);
+        std::thread runner([&] { server.start(); });
+
+        std::string small;
+        std::string large;
+        bool connected = false;
+        {
+            TlsClient client(server.getPort(), cert.cert_file);
+            connected = client.connected();
+            small = client.roundTrip("hello tls");
+            // Several 16KB records, enough to hit the 64KB write watermark
+            large = client.roundTrip(std::string(100 * 1024, 'k'));
+        }
+        stop(server, runner);
+
+        REQUIRE(connected);
+        REQUIRE(small == "HELLO TLS");
+        REQUIRE(large == std::string(100 * 1024, 'K'));
+        const LoopMetrics& metrics = server.getMetrics(0);
+        REQUIRE(metrics.tls_handshakes.value() == 1);
+        REQUIRE(metrics.tls_failures.value() == 0);
+        // kTLS is up to the kernel; either way the bytes above were right
+        REQUIRE(metrics.ktls_send.value() <= 1);
+    }
+
+    SECTION("Worker offload and framing see plaintext") {
+        config.worker_threads = 1;
+        config.framing = Framing::Line;
+        TCPServer server(0, config);
+        std::thread runner([&] { server.start(); });
+
+        std::string reply;
+        {
+            TlsClient client(server.getPort(), cert.cert_file);
+            reply = client.roundTrip("one\ntwo\n");
+        }
+        stop(server, runner);
+        REQUIRE(reply == "ONE\nTWO\n");
+    }
+
+    SECTION("Static files are encrypted from the mapped file") {
+        const std::string root = "/tmp/reactor_tls_files_" + std::to_string(getpid());
+        REQUIRE(mkdir(root.c_str(), 0700) == 0);
+        // Several TLS_FILE_CHUNK writes
+        std::string content(200 * 1024 + 7, 'f');
+        std::ofstream(root + "/file.bin", std::ios::binary) << content;
+
+        config.framing = Framing::LengthPrefix;
+        config.static_root = root;
+        TCPServer server(0, config);
+        std::thread runner([&] { server.start(); });
+
+        LengthPrefixFramer framer(config.max_frame_size);
+        auto frame = [&](const std::string& payload) {
+            char header[Framer::MAX_HEADER];
+            return std::string(header, framer.encodeHeader(payload.size(), header)) + payload;
+        };
+        const std::string expected = frame(content) + frame("DONE");
+        std::string reply;
+        {
+            TlsClient client(server.getPort(), cert.cert_file);
+            reply = client.roundTrip(frame("GET file.bin") + frame("done"), expected.size());
+        }
+        stop(server, runner);
+        unlink((root + "/file.bin").c_str());
+        rmdir(root.c_str());
+
+        REQUIRE(reply == expected);
+        REQUIRE(server.getMetrics(0).file_bytes.value() == content.size());
+    }
+
+    SECTION("A cleartext client fails the handshake and is closed") {
+        TCPServer server(0, config);
+        std::thread runner([&] { server.start(); });
+
+        ssize_t result = -1;
+        {
+            Socket client(AddressFamily::IPv4);
+            client.connect(Endpoint::ipv4("127.0.0.1", server.getPort()));
+            const std::string request = "GET / HTTP/1.0\r\n\r\n";
+            write(client.getFd(), request.data(), request.size());
+            char buffer[256];
+            // The server answers with an alert at most, then closes (with a
+            // reset, as the rest of the request is left unread)
+            while ((result = read(client.getFd(), buffer, sizeof(buffer))) > 0) {
+            }
+        }
+        stop(server, runner);
+        REQUIRE(result <= 0);
+        REQUIRE(server.getMetrics(0).tls_failures.value() == 1);
+        REQUIRE(server.getMetrics(0).tls_handshakes.value() == 0);
+    }
+
+    SECTION("A missing certificate is a setup error") {
+        config.tls.cert_file = "/nonexistent/server.crt";
+        REQUIRE_THROWS_AS(TCPServer(0, config), std::runtime_error);
+    }
+}
+#endif
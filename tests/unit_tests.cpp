@@ -1,14 +1,46 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <cctype>
 #include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netinet/udp.h>
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/catch_session.hpp>
 #include "../include/socket.hpp"
 #include "../include/reactor.hpp"
+#include "../include/tcp_server.hpp"
+#include "../include/write_buffer.hpp"
+#include "../include/timer_wheel.hpp"
+#include "../include/transform.hpp"
+#include "../include/delegate.hpp"
+#include "../include/slab.hpp"
+#include "../include/token_bucket.hpp"
+#include "../include/flight_recorder.hpp"
+#include "../include/logger.hpp"
+#include "../include/metrics.hpp"
+#include "../include/worker_pool.hpp"
+#include "../include/codec.hpp"
+#include "../include/udp_server.hpp"
 
 
 // Test Socket RAII wrapper
@@ -68,9 +100,99 @@ TEST_CASE("Socket operations", "[socket]") {
         getsockopt(s.getFd(), SOL_SOCKET, SO_REUSEADDR, &optval, &optlen);
         REQUIRE(optval == 1);
     }
+
+    SECTION("Set busy poll") {
+        Socket s(socket(AF_INET, SOCK_STREAM, 0));
+        // Raising the budget needs CAP_NET_ADMIN, so EPERM is an acceptable outcome
+        try {
+            s.setBusyPoll(50);
+            int optval = 0;
+            socklen_t optlen = sizeof(optval);
+            getsockopt(s.getFd(), SOL_SOCKET, SO_BUSY_POLL, &optval, &optlen);
+            REQUIRE(optval == 50);
+        } catch (const std::runtime_error&) {
+            SUCCEED("SO_BUSY_POLL not permitted here");
+        }
+    }
+
+    SECTION("Set reuse port") {
+        Socket s(socket(AF_INET, SOCK_STREAM, 0));
+        REQUIRE_NOTHROW(s.setReusePort());
+
+        int optval = 0;
+        socklen_t optlen = sizeof(optval);
+        getsockopt(s.getFd(), SOL_SOCKET, SO_REUSEPORT, &optval, &optlen);
+        REQUIRE(optval == 1);
+    }
+
+    SECTION("Listener options are inherited by accepted sockets") {
+        Socket listener;
+        SocketOptions options = SocketOptions::lowLatency();
+        options.recv_buffer = 256 * 1024;
+        options.defer_accept_s = 1;
+        REQUIRE_NOTHROW(listener.apply(options));
+        listener.bind(0);
+        listener.listen();
+
+        Socket client(socket(AF_INET, SOCK_STREAM, 0));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(listener.getPort());
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        REQUIRE(connect(client.getFd(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0);
+        // TCP_DEFER_ACCEPT holds the connection back until data arrives
+        REQUIRE(write(client.getFd(), "x", 1) == 1);
+        Socket accepted(accept4(listener.getFd(), nullptr, nullptr, SOCK_CLOEXEC));
+        REQUIRE(accepted.getFd() >= 0);
+
+        int optval = 0;
+        socklen_t optlen = sizeof(optval);
+        getsockopt(accepted.getFd(), IPPROTO_TCP, TCP_NODELAY, &optval, &optlen);
+        REQUIRE(optval == 1);
+        getsockopt(accepted.getFd(), SOL_SOCKET, SO_RCVBUF, &optval, &optlen);
+        REQUIRE(optval >= 256 * 1024);  // The kernel doubles the requested size
+    }
     
 }
 
+TEST_CASE("Endpoint parsing", "[socket]") {
+    SECTION("Every accepted form round-trips") {
+        REQUIRE(Endpoint::parse("8080").toString() == "0.0.0.0:8080");
+        for (const char* text : {"127.0.0.1:80", "[::1]:9000", "[::]:0", "unix:/tmp/echo.sock", "unix:@echo"}) {
+            REQUIRE(Endpoint::parse(text).toString() == text);
+        }
+        REQUIRE(Endpoint::parse("[::]:8080").family() == AddressFamily::IPv6);
+        REQUIRE(Endpoint::parse("[::]:8080").port() == 8080);
+        REQUIRE(Endpoint::parse("unix:/tmp/echo.sock").path() == "/tmp/echo.sock");
+        REQUIRE(Endpoint::parse("unix:@echo").isAbstract());
+        REQUIRE(Endpoint::parse("unix:@echo").path().empty());
+    }
+
+    SECTION("Malformed endpoints are rejected") {
+        for (const char* text : {"", "http", "1.2.3.4:", "1.2.3.4:70000", "localhost:80", "[::1]", "[::1]:x",
+                                 "unix:", "unix:@"}) {
+            REQUIRE_THROWS_AS(Endpoint::parse(text), std::invalid_argument);
+        }
+        REQUIRE_THROWS_AS(Endpoint::unixPath(std::string(200, 'x')), std::invalid_argument);
+    }
+
+    SECTION("Sockets bind and report endpoints of every family") {
+        Socket v6(AddressFamily::IPv6);
+        v6.bind(Endpoint::ipv6("::1", 0, false));
+        REQUIRE(v6.family() == AddressFamily::IPv6);
+        REQUIRE(v6.getPort() > 0);
+        REQUIRE_FALSE(v6.localEndpoint().dualStack());
+        REQUIRE(v6.localEndpoint().toString() == "[::1]:" + std::to_string(v6.getPort()));
+
+        Socket local(AddressFamily::Unix);
+        REQUIRE_NOTHROW(local.apply(SocketOptions::lowLatency()));  // TCP-only fields skipped
+        const std::string name = "@reactor_endpoint_test_" + std::to_string(getpid());
+        local.bind(Endpoint::unixPath(name));
+        REQUIRE(local.getPort() == 0);
+        REQUIRE(local.localEndpoint().toString() == "unix:" + name);
+    }
+}
+
 TEST_CASE("Reactor basic operations", "[reactor]") {
     
     SECTION("Register and unregister handler") {
@@ -134,6 +256,81 @@ TEST_CASE("Reactor shutdown mechanism", "[reactor]") {
 }
 
 
+TEST_CASE("Reactor cross-thread post", "[reactor]") {
+    SECTION("Tasks from many threads all run on the loop, in order per thread") {
+        Reactor reactor;
+        constexpr int PRODUCERS = 4;
+        constexpr int TASKS = 5000;
+        struct Observed {
+            std::vector<int> last_seen = std::vector<int>(PRODUCERS, -1);
+            bool in_order = true;
+            bool on_loop = true;
+            int ran = 0;
+            std::thread::id loop_thread = std::this_thread::get_id();
+        } observed;
+
+        std::vector<std::thread> producers;
+        for (int p = 0; p < PRODUCERS; ++p) {
+            producers.emplace_back([&reactor, &observed, p] {
+                for (int i = 0; i < TASKS; ++i) {
+                    reactor.post([&reactor, &observed, p, i] {
+                        observed.in_order = observed.in_order && observed.last_seen[p] == i - 1;
+                        observed.last_seen[p] = i;
+                        observed.on_loop = observed.on_loop && std::this_thread::get_id() == observed.loop_thread;
+                        if (++observed.ran == PRODUCERS * TASKS) {
+                            uint64_t one = 1;
+                            write(reactor.getShutdownFd(), &one, sizeof(one));
+                        }
+                    });
+                }
+            });
+        }
+        reactor.run();
+        for (auto& t : producers) t.join();
+
+        REQUIRE(observed.ran == PRODUCERS * TASKS);
+        REQUIRE(observed.in_order);
+        REQUIRE(observed.on_loop);
+    }
+
+    SECTION("Tasks left queued are dropped with the Reactor") {
+        auto token = std::make_shared<int>(0);
+        {
+            Reactor reactor;
+            reactor.post([token] { ++*token; });
+            REQUIRE(token.use_count() == 2);
+        }
+        REQUIRE(token.use_count() == 1);
+        REQUIRE(*token == 0);
+    }
+}
+
+TEST_CASE("WorkerPool hands results back through Reactor::post", "[worker_pool][reactor]") {
+    Reactor reactor;
+    WorkerPool pool(3);
+    REQUIRE(pool.size() == 3);
+    REQUIRE_THROWS(WorkerPool(0));
+
+    constexpr int JOBS = 200;
+    long long sum = 0;
+    int completed = 0;
+    for (int i = 1; i <= JOBS; ++i) {
+        pool.submit([&reactor, &sum, &completed, i] {
+            long long square = static_cast<long long>(i) * i;  // The "expensive" part, off the loop
+            reactor.post([&reactor, &sum, &completed, square] {
+                sum += square;
+                if (++completed == JOBS) {
+                    uint64_t one = 1;
+                    write(reactor.getShutdownFd(), &one, sizeof(one));
+                }
+            });
+        });
+    }
+    reactor.run();
+    REQUIRE(completed == JOBS);
+    REQUIRE(sum == static_cast<long long>(JOBS) * (JOBS + 1) * (2 * JOBS + 1) / 6);
+}
+
 TEST_CASE("Reactor event handling with socket pair", "[reactor]") {
     SECTION("Handler is called when data available") {
         Reactor reactor;
@@ -174,7 +371,1959 @@ TEST_CASE("Reactor event handling with socket pair", "[reactor]") {
         reactor.unregisterHandler(s2.getFd());
     }
 }
+TEST_CASE("Delegate inline callable storage", "[delegate]") {
+    SECTION("Whole delegate fits a cache line") {
+        REQUIRE(sizeof(Delegate<void(int, uint32_t)>) == 64);
+    }
+
+    SECTION("Invokes, moves and destroys the captured state exactly once") {
+        auto tracker = std::make_shared<int>(7);
+        {
+            Delegate<int(int)> d([tracker](int x) { return *tracker + x; });
+            REQUIRE(tracker.use_count() == 2);
+            REQUIRE(d(3) == 10);
+
+            Delegate<int(int)> moved(std::move(d));
+            REQUIRE_FALSE(static_cast<bool>(d));
+            REQUIRE(moved(1) == 8);
+            REQUIRE(tracker.use_count() == 2);
+
+            moved = nullptr;
+            REQUIRE(tracker.use_count() == 1);
+        }
+        REQUIRE(tracker.use_count() == 1);
+    }
+}
+
+TEST_CASE("Slab generation handles", "[slab]") {
+    SECTION("Stale handles resolve to nothing, even after the slot is reused") {
+        Slab<std::string, 4> slab;
+        SlabHandle a = slab.emplace("a");
+        SlabHandle b = slab.emplace("b");
+        REQUIRE(slab.size() == 2);
+        REQUIRE(*slab.get(a) == "a");
+        REQUIRE(*slab.get(b) == "b");
+        REQUIRE(slab.get(SlabHandle{}) == nullptr);
+
+        REQUIRE(slab.erase(a));
+        REQUIRE(slab.get(a) == nullptr);
+        REQUIRE_FALSE(slab.erase(a));
+
+        SlabHandle c = slab.emplace("c");
+        REQUIRE(c.index == a.index);    // Most recently freed slot first
+        REQUIRE(c != a);
+        REQUIRE(slab.get(a) == nullptr);
+        REQUIRE(*slab.get(c) == "c");
+        REQUIRE(slab.size() == 2);
+    }
+
+    SECTION("Elements never move and churn reuses slots") {
+        Slab<std::string, 4> slab;
+        SlabHandle first = slab.emplace("first");
+        const std::string* address = slab.get(first);
+        std::vector<SlabHandle> handles;
+        for (int i = 0; i < 100; ++i) {
+            handles.push_back(slab.emplace(std::to_string(i)));
+        }
+        REQUIRE(slab.get(first) == address);    // 26 pages later
+
+        for (int round = 0; round < 1000; ++round) {
+            SlabHandle h = handles[static_cast<size_t>(round) % handles.size()];
+            REQUIRE(slab.erase(h));
+            handles[static_cast<size_t>(round) % handles.size()] = slab.emplace("again");
+        }
+        REQUIRE(slab.capacity() == 101);
+        REQUIRE(slab.size() == 101);
+
+        size_t visited = 0;
+        slab.forEach([&](SlabHandle h, std::string& value) {
+            REQUIRE(slab.get(h) == &value);
+            ++visited;
+        });
+        REQUIRE(visited == 101);
+    }
+
+    SECTION("Erase and destruction run element destructors") {
+        auto tracker = std::make_shared<int>(0);
+        {
+            Slab<std::shared_ptr<int>> slab;
+            SlabHandle h = slab.emplace(tracker);
+            slab.emplace(tracker);
+            REQUIRE(tracker.use_count() == 3);
+            slab.erase(h);
+            REQUIRE(tracker.use_count() == 2);
+        }
+        REQUIRE(tracker.use_count() == 1);
+    }
+}
+
+TEST_CASE("TokenBucket rate limiting", "[shaping]") {
+    SECTION("Refills at the rate, up to the burst") {
+        TokenBucket bucket(RateLimit{1000, 100}, 0);    // One token per ms
+        REQUIRE(bucket.limited());
+        REQUIRE(bucket.available(0) == 100);
+        bucket.consume(100);
+        REQUIRE(bucket.available(0) == 0);
+        REQUIRE(bucket.delayMs() == 1);
+        REQUIRE(bucket.available(10) == 10);
+        REQUIRE(bucket.available(10) == 10);    // Time has to pass to refill
+        REQUIRE(bucket.available(UINT64_MAX / 2) == 100);
+    }
+
+    SECTION("Overdrafts are paid back before tokens are available again") {
+        TokenBucket bucket(RateLimit{500, 0}, 0);   // Burst defaults to the rate
+        REQUIRE(bucket.available(0) == 500);
+        bucket.consume(600);
+        REQUIRE(bucket.available(0) == 0);
+        REQUIRE(bucket.delayMs() == 202);
+        REQUIRE(bucket.available(201) == 0);
+        REQUIRE(bucket.available(202) == 1);
+    }
+
+    SECTION("Rates below one token per ms accumulate exactly") {
+        TokenBucket bucket(RateLimit{3, 3}, 0);
+        bucket.consume(3);
+        REQUIRE(bucket.delayMs() == 334);
+        REQUIRE(bucket.available(333) == 0);
+        REQUIRE(bucket.available(334) == 1);
+        REQUIRE(bucket.available(1000) == 3);
+    }
+
+    SECTION("A default bucket never runs out") {
+        TokenBucket bucket;
+        REQUIRE_FALSE(bucket.limited());
+        bucket.consume(1ull << 40);
+        REQUIRE(bucket.available(0) == UINT64_MAX);
+        REQUIRE(bucket.delayMs() == 0);
+    }
+}
+
+TEST_CASE("FlightRecorder ring and Chrome trace export", "[trace]") {
+    SECTION("The ring keeps the newest events, oldest first") {
+        REQUIRE(sizeof(FlightRecorder::Record) == 16);
+        REQUIRE_THROWS_AS(FlightRecorder(0), std::invalid_argument);
+        FlightRecorder recorder(5);
+        REQUIRE(recorder.capacity() == 8);
+        for (int fd = 0; fd < 20; ++fd) {
+            recorder.record(TraceEvent::Accept, fd);
+        }
+        std::vector<FlightRecorder::Record> records;
+        recorder.snapshot(records);
+        REQUIRE(recorder.recorded() == 20);
+        REQUIRE(records.size() == 8);
+        for (size_t i = 0; i < records.size(); ++i) {
+            REQUIRE(records[i].fd == static_cast<int>(12 + i));
+            REQUIRE(records[i].type == TraceEvent::Accept);
+            if (i > 0) {
+                REQUIRE(records[i].ticks >= records[i - 1].ticks);
+            }
+        }
+    }
+
+    SECTION("Waits and handler runs become slices, unmatched halves are dropped") {
+        FlightRecorder recorder(64);
+        recorder.record(TraceEvent::HandlerExit, 3);    // Its start was overwritten
+        recorder.record(TraceEvent::Wait);
+        recorder.record(TraceEvent::Wakeup, -1, 2);
+        recorder.record(TraceEvent::HandlerEnter, 7, EPOLLIN | EPOLLOUT);
+        recorder.record(TraceEvent::ReadPause, 7);
+        recorder.record(TraceEvent::HandlerExit, 7);
+        recorder.record(TraceEvent::HandlerEnter, 9, EPOLLIN);   // Still running
+        std::vector<TraceSnapshot> loops(1);
+        loops[0].thread_name = "loop 0";
+        recorder.snapshot(loops[0].records);
+
+        std::string json;
+        appendChromeTrace(json, loops);
+        REQUIRE(json.find("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[") == 0);
+        REQUIRE(json.find("\"args\":{\"name\":\"loop 0\"}") != std::string::npos);
+        REQUIRE(json.find("{\"name\":\"wait\",\"ph\":\"X\"") != std::string::npos);
+        REQUIRE(json.find("\"args\":{\"events\":2}") != std::string::npos);
+        REQUIRE(json.find("{\"name\":\"fd 7\",\"ph\":\"X\"") != std::string::npos);
+        REQUIRE(json.find("\"args\":{\"events\":\"IN|OUT\"}") != std::string::npos);
+        REQUIRE(json.find("{\"name\":\"read pause\",\"ph\":\"i\"") != std::string::npos);
+        REQUIRE(json.find("fd 3") == std::string::npos);
+        REQUIRE(json.find("fd 9") == std::string::npos);
+        size_t events = 0;
+        for (size_t at = json.find("\"ph\":"); at != std::string::npos; at = json.find("\"ph\":", at + 1)) {
+            ++events;
+        }
+        REQUIRE(events == 4);   // Thread name, wait, fd 7, read pause
+    }
+}
+
+TEST_CASE("Reactor flat handler table", "[reactor]") {
+    SECTION("Handlers may unregister themselves during dispatch") {
+        Reactor reactor;
+        int sv[2];
+        REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+        Socket s1(sv[0]);
+        Socket s2(sv[1]);
+
+        auto tracker = std::make_shared<int>(0);
+        reactor.registerHandler(s2.getFd(), EPOLLIN, [&, tracker](int fd, uint32_t) {
+            reactor.unregisterHandler(fd);
+            ++*tracker;  // Captures must still be alive after unregistering
+            uint64_t value = 1;
+            write(reactor.getShutdownFd(), &value, sizeof(value));
+        });
+        write(s1.getFd(), "x", 1);
+        reactor.run();
+        REQUIRE(*tracker == 1);
+        REQUIRE(tracker.use_count() == 1);  // Dropped once the handler returned
+
+        // The slot is free again
+        REQUIRE_NOTHROW(reactor.registerHandler(s2.getFd(), EPOLLIN, [](int, uint32_t) {}));
+        reactor.unregisterHandler(s2.getFd());
+    }
+
+    SECTION("Fds beyond the first page dispatch through their slot") {
+        Reactor reactor;
+        int sv[2];
+        REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+        Socket s1(sv[0]);
+        // Move the read end above 2048 so a second slot page is needed
+        int high_fd = fcntl(sv[1], F_DUPFD_CLOEXEC, 2100);
+        close(sv[1]);
+        if (high_fd == -1) {
+            SUCCEED("fd limit too low for this check");
+            return;
+        }
+        Socket s2(high_fd);
+
+        int seen_fd = -1;
+        reactor.registerHandler(high_fd, EPOLLIN, [&](int fd, uint32_t) {
+            seen_fd = fd;
+            uint64_t value = 1;
+            write(reactor.getShutdownFd(), &value, sizeof(value));
+        });
+        write(s1.getFd(), "x", 1);
+        reactor.run();
+        REQUIRE(seen_fd == high_fd);
+        reactor.unregisterHandler(high_fd);
+    }
+}
+
+TEST_CASE("Reactor ready queue", "[reactor]") {
+    Reactor reactor;
+    int a[2];
+    int b[2];
+    REQUIRE(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, a) == 0);
+    REQUIRE(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, b) == 0);
+    Socket a_peer(a[0]);
+    Socket a_end(a[1]);
+    Socket b_peer(b[0]);
+    Socket b_end(b[1]);
+
+    SECTION("A deferred handler runs after the other ready ones, with no new edge") {
+        std::vector<std::pair<char, uint32_t>> calls;
+        reactor.registerHandler(a_end.getFd(), EPOLLIN | EPOLLET, [&](int fd, uint32_t events) {
+            calls.emplace_back('a', events);
+            if (calls.size() < 3) {
+                // Nothing read: edge-triggered, the poller will not report it again
+                reactor.defer(fd, EPOLLIN);
+                return;
+            }
+            uint64_t value = 1;
+            write(reactor.getShutdownFd(), &value, sizeof(value));
+        });
+        reactor.registerHandler(b_end.getFd(), EPOLLIN | EPOLLET, [&](int, uint32_t events) {
+            calls.emplace_back('b', events);
+        });
+        write(a_peer.getFd(), "x", 1);
+        write(b_peer.getFd(), "y", 1);
+        reactor.run();
+
+        // Both fds were ready together, in either order; then a again
+        REQUIRE(calls.size() == 3);
+        REQUIRE(calls[0].first != calls[1].first);
+        REQUIRE(calls[2].first == 'a');
+        REQUIRE(calls[2].second == EPOLLIN);
+        REQUIRE(reactor.readyCount() == 0);
+    }
+
+    SECTION("Deferring twice merges, unregistering drops the entry") {
+        uint32_t a_events = 0;
+        int a_calls = 0;
+        int b_calls = 0;
+        reactor.registerHandler(a_end.getFd(), EPOLLIN | EPOLLET, [&](int, uint32_t events) {
+            ++a_calls;
+            a_events = events;
+            uint64_t value = 1;
+            write(reactor.getShutdownFd(), &value, sizeof(value));
+        });
+        reactor.registerHandler(b_end.getFd(), EPOLLIN | EPOLLET, [&](int, uint32_t) { ++b_calls; });
+        reactor.defer(a_end.getFd(), EPOLLIN);
+        reactor.defer(a_end.getFd(), EPOLLOUT);
+        reactor.defer(b_end.getFd(), EPOLLIN);
+        REQUIRE(reactor.readyCount() == 2);
+        reactor.unregisterHandler(b_end.getFd());
+        reactor.run();
+
+        REQUIRE(a_calls == 1);
+        REQUIRE(a_events == (EPOLLIN | EPOLLOUT));
+        REQUIRE(b_calls == 0);
+        reactor.unregisterHandler(a_end.getFd());
+    }
+}
+
+TEST_CASE("Reactor io_uring backend", "[reactor]") {
+    ReactorOptions options;
+    options.backend = ReactorBackend::IoUring;
+    Reactor reactor(options);
+    // Falls back to epoll on kernels without io_uring; the contract is the same
+    INFO("backend is io_uring: " << (reactor.backend() == ReactorBackend::IoUring));
+
+    int sv[2];
+    REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    Socket s1(sv[0]);
+    Socket s2(sv[1]);
+    s2.setNonBlocking();
+
+    int calls = 0;
+    reactor.registerHandler(s2.getFd(), EPOLLIN | EPOLLET, [&](int fd, uint32_t events) {
+        REQUIRE((events & EPOLLIN) != 0);
+        char buffer[100];
+        while (read(fd, buffer, sizeof(buffer)) > 0) {}
+        if (++calls == 2) {
+            uint64_t value = 1;
+            write(reactor.getShutdownFd(), &value, sizeof(value));
+        } else {
+            // Re-registering the mask must keep the fd armed
+            reactor.modifyHandler(fd, EPOLLIN | EPOLLOUT | EPOLLET);
+            reactor.modifyHandler(fd, EPOLLIN | EPOLLET);
+            write(s1.getFd(), "again", 5);
+        }
+    });
+
+    write(s1.getFd(), "first", 5);
+    reactor.run();
+    REQUIRE(calls == 2);
+    reactor.unregisterHandler(s2.getFd());
+}
+
+TEST_CASE("Reactor adaptive batching and spin mode", "[reactor]") {
+    SECTION("Batch grows when waits come back full") {
+        ReactorOptions options;
+        options.min_batch = 2;
+        options.max_batch = 64;
+        Reactor reactor(options);
+        REQUIRE(reactor.batchSize() == 2);
+
+        // 40 readable socket pairs, each handled exactly once
+        std::vector<std::pair<Socket, Socket>> pairs;
+        int handled = 0;
+        for (int i = 0; i < 40; ++i) {
+            int sv[2];
+            REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+            pairs.emplace_back(Socket(sv[0]), Socket(sv[1]));
+            reactor.registerHandler(sv[1], EPOLLIN | EPOLLET, [&](int fd, uint32_t) {
+                char buffer[8];
+                read(fd, buffer, sizeof(buffer));
+                if (++handled == 40) {
+                    uint64_t value = 1;
+                    write(reactor.getShutdownFd(), &value, sizeof(value));
+                }
+            });
+            write(sv[0], "x", 1);
+        }
+        reactor.run();
+        REQUIRE(handled == 40);
+        REQUIRE(reactor.batchSize() > 2);
+        for (auto& p : pairs) reactor.unregisterHandler(p.second.getFd());
+    }
+
+    SECTION("Invalid batch bounds are rejected") {
+        ReactorOptions options;
+        options.min_batch = 8;
+        options.max_batch = 4;
+        REQUIRE_THROWS(Reactor(options));
+    }
+
+    SECTION("Spinning loop still dispatches and honours timers") {
+        ReactorOptions options;
+        options.spin_us = 200;
+        options.cpu_affinity = 0;
+        Reactor reactor(options);
+
+        int sv[2];
+        REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+        Socket s1(sv[0]);
+        Socket s2(sv[1]);
+        bool handled = false;
+        reactor.registerHandler(s2.getFd(), EPOLLIN | EPOLLET, [&](int fd, uint32_t) {
+            char buffer[8];
+            read(fd, buffer, sizeof(buffer));
+            handled = true;
+        });
+        reactor.addTimer(5, [&] { write(s1.getFd(), "x", 1); });
+        reactor.addTimer(20, [&] {
+            uint64_t value = 1;
+            write(reactor.getShutdownFd(), &value, sizeof(value));
+        });
+        // Its own thread, so the pinning does not outlive this section
+        std::thread loop([&reactor] { reactor.run(); });
+        loop.join();
+        REQUIRE(handled);
+        reactor.unregisterHandler(s2.getFd());
+    }
+}
+
+TEST_CASE("TimerWheel hierarchical timers", "[timer]") {
+    const uint64_t start = 1000000;
+
+    SECTION("100k timers fire once, never early and never a step late") {
+        TimerWheel wheel(start);
+        wheel.reserve(100000);
+        std::mt19937_64 rng(42);
+        std::vector<uint64_t> expires(100000);
+        std::vector<uint64_t> fired_at(expires.size(), 0);
+        uint64_t now = start;
+        uint64_t previous = start;
+
+        for (size_t i = 0; i < expires.size(); ++i) {
+            expires[i] = start + 1 + rng() % 300000;
+            wheel.add(expires[i], [&, i] { fired_at[i] = now; });
+        }
+        REQUIRE(wheel.size() == expires.size());
+
+        while (wheel.size() > 0) {
+            previous = now;
+            now += 1 + rng() % 5000;
+            wheel.advance(now);
+            for (size_t i = 0; i < expires.size(); ++i) {
+                if (expires[i] > previous && expires[i] <= now) {
+                    REQUIRE(fired_at[i] == now);
+                }
+            }
+        }
+        for (uint64_t t : fired_at) {
+            REQUIRE(t != 0);
+        }
+    }
+
+    SECTION("Cancel and reset use generation-checked ids") {
+        TimerWheel wheel(start);
+        int fired = 0;
+        auto id = wheel.add(start + 10, [&] { ++fired; });
+        REQUIRE(wheel.cancel(id));
+        REQUIRE_FALSE(wheel.cancel(id));
+        REQUIRE_FALSE(wheel.cancel(TimerWheel::INVALID_TIMER));
+
+        id = wheel.add(start + 10, [&] { ++fired; });
+        REQUIRE(wheel.reset(id, start + 100));
+        wheel.advance(start + 50);
+        REQUIRE(fired == 0);
+        wheel.advance(start + 100);
+        REQUIRE(fired == 1);
+        REQUIRE_FALSE(wheel.reset(id, start + 200));  // Already fired
+    }
+
+    SECTION("Callbacks can re-arm themselves") {
+        TimerWheel wheel(start);
+        int fired = 0;
+        TimerWheel::TimerId id = TimerWheel::INVALID_TIMER;
+        id = wheel.add(start + 5, [&] {
+            if (++fired < 3) wheel.reset(id, start + 5 * (fired + 1));
+        });
+        wheel.advance(start + 100);
+        REQUIRE(fired == 3);
+        REQUIRE(wheel.size() == 0);
+    }
+
+    SECTION("Next timeout tracks the earliest deadline") {
+        TimerWheel wheel(start);
+        REQUIRE(wheel.nextTimeout(start) == -1);
+        wheel.add(start + 50, [] {});
+        REQUIRE(wheel.nextTimeout(start) == 50);
+
+        // Timers beyond the top level park on the overflow list
+        TimerWheel far(start);
+        bool fired = false;
+        uint64_t deadline = start + (1ull << 26) + 123;
+        far.add(deadline, [&] { fired = true; });
+        far.advance(deadline - 1);
+        REQUIRE_FALSE(fired);
+        far.advance(deadline);
+        REQUIRE(fired);
+    }
+}
+
+TEST_CASE("Reactor timers drive the wait timeout", "[reactor][timer]") {
+    Reactor reactor;
+    bool cancelled_fired = false;
+    auto cancelled = reactor.addTimer(10, [&] { cancelled_fired = true; });
+    REQUIRE(reactor.cancelTimer(cancelled));
+
+    auto begin = std::chrono::steady_clock::now();
+    reactor.addTimer(30, [&] {
+        uint64_t value = 1;
+        write(reactor.getShutdownFd(), &value, sizeof(value));
+    });
+    reactor.run();  // No fds are ready, only the timer can end this
+    auto elapsed = std::chrono::steady_clock::now() - begin;
+
+    REQUIRE(elapsed >= std::chrono::milliseconds(29));
+    REQUIRE_FALSE(cancelled_fired);
+    REQUIRE(reactor.timerCount() == 0);
+}
+
+TEST_CASE("WriteBuffer chunked output queue", "[write_buffer]") {
+    SECTION("Appends span chunks and consume preserves order") {
+        WriteBuffer buffer;
+        std::string payload(WriteBuffer::CHUNK_SIZE * 2 + 100, '\0');
+        for (size_t i = 0; i < payload.size(); ++i) {
+            payload[i] = static_cast<char>('a' + i % 26);
+        }
+        buffer.append(payload.data(), payload.size());
+        REQUIRE(buffer.size() == payload.size());
+        REQUIRE(buffer.chunkCount() == 3);
+
+        buffer.consume(WriteBuffer::CHUNK_SIZE + 10);
+        REQUIRE(buffer.size() == payload.size() - WriteBuffer::CHUNK_SIZE - 10);
+        REQUIRE(buffer.chunkCount() == 2);
+
+        buffer.clear();
+        REQUIRE(buffer.empty());
+        REQUIRE(buffer.chunkCount() == 0);
+    }
+
+    SECTION("Partial writev only advances the cursor") {
+        int sv[2];
+        REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+        Socket writer(sv[0]);
+        Socket reader(sv[1]);
+        writer.setNonBlocking();
+
+        std::string payload(256 * 1024, '\0');
+        for (size_t i = 0; i < payload.size(); ++i) {
+            payload[i] = static_cast<char>(i * 7);
+        }
+        WriteBuffer buffer;
+        buffer.append(payload.data(), payload.size());
+
+        // Alternate writer and reader until everything crossed the socket
+        std::string received;
+        char temp[8192];
+        while (received.size() < payload.size()) {
+            ssize_t written = buffer.writeTo(writer.getFd());
+            if (written == -1) {
+                REQUIRE((errno == EAGAIN || errno == EWOULDBLOCK));
+            }
+            ssize_t n = read(reader.getFd(), temp, sizeof(temp));
+            REQUIRE(n > 0);
+            received.append(temp, n);
+        }
+        REQUIRE(buffer.empty());
+        REQUIRE(received == payload);
+    }
+}
+
+TEST_CASE("Message framers", "[codec]") {
+    std::string_view frame;
+    size_t consumed = 0;
+
+    SECTION("Line framer finds pipelined lines in place") {
+        LineFramer framer(16);
+        std::string_view input = "one\r\ntwo\nthr";
+        REQUIRE(framer.decode(input, frame, consumed) == FrameStatus::Complete);
+        REQUIRE(frame == "one");
+        REQUIRE(frame.data() == input.data());  // A view, not a copy
+        input.remove_prefix(consumed);
+        REQUIRE(framer.decode(input, frame, consumed) == FrameStatus::Complete);
+        REQUIRE(frame == "two");
+        input.remove_prefix(consumed);
+        REQUIRE(framer.decode(input, frame, consumed) == FrameStatus::Incomplete);
+
+        REQUIRE(framer.decode(std::string(17, 'x') + "\n", frame, consumed) == FrameStatus::Invalid);
+        REQUIRE(framer.decode(std::string(18, 'x'), frame, consumed) == FrameStatus::Invalid);
+        REQUIRE(framer.decode(std::string(16, 'x') + "\r", frame, consumed) == FrameStatus::Incomplete);
+        REQUIRE(framer.trailer() == "\n");
+    }
+
+    SECTION("Length prefix framer round-trips its own header") {
+        LengthPrefixFramer framer(1024);
+        char header[Framer::MAX_HEADER];
+        size_t header_size = framer.encodeHeader(300, header);
+        REQUIRE(header_size == LengthPrefixFramer::HEADER_SIZE);
+        std::string input(header, header_size);
+        input += std::string(300, 'p');
+        REQUIRE(framer.decode(std::string_view(input).substr(0, 200), frame, consumed) == FrameStatus::Incomplete);
+        REQUIRE(framer.decode(input, frame, consumed) == FrameStatus::Complete);
+        REQUIRE(frame.size() == 300);
+        REQUIRE(consumed == input.size());
+
+        header_size = framer.encodeHeader(4096, header);
+        REQUIRE(framer.decode(std::string_view(header, header_size), frame, consumed) == FrameStatus::Invalid);
+    }
+
+    SECTION("Read buffer keeps the partial tail and frees itself when empty") {
+        ReadBuffer buffer;
+        char* out = buffer.prepare(10);
+        std::memcpy(out, "abc\ndef", 7);
+        buffer.commit(7);
+        buffer.consume(4);
+        REQUIRE(buffer.view() == "def");
+
+        // Asking for more than the tail has left slides or grows, keeping the bytes
+        out = buffer.prepare(buffer.capacity());
+        REQUIRE(buffer.view() == "def");
+        std::memcpy(out, "g", 1);
+        buffer.commit(1);
+        REQUIRE(buffer.view() == "defg");
+
+        buffer.release();
+        REQUIRE(buffer.capacity() > 0);  // Not empty yet
+        buffer.consume(4);
+        buffer.release();
+        REQUIRE(buffer.capacity() == 0);
+    }
+}
+
+TEST_CASE("Uppercase transform kernels", "[transform]") {
+    // Every byte value at every length/alignment around the vector widths
+    std::string input;
+    for (int i = 0; i < 1024; ++i) {
+        input.push_back(static_cast<char>(i % 256));
+    }
+    std::string expected(input.size(), '\0');
+    for (size_t i = 0; i < input.size(); ++i) {
+        expected[i] = static_cast<char>(std::toupper(static_cast<unsigned char>(input[i])));
+    }
+
+    for (PayloadTransform kernel : {&uppercaseScalar, &uppercaseSse2, &uppercaseAvx2, selectUppercaseKernel()}) {
+        INFO("kernel: " << uppercaseKernelName(kernel));
+        if (kernel == &uppercaseAvx2 && !__builtin_cpu_supports("avx2")) {
+            continue;
+        }
+        for (size_t offset : {0, 1, 7, 31}) {
+            for (size_t len : {0, 1, 15, 16, 17, 33, 64, 100, 513}) {
+                std::string out(len, '\0');
+                kernel(input.data() + offset, &out[0], len);
+                REQUIRE(out == expected.substr(offset, len));
+
+                // In place, as the server runs it inside the write buffer
+                std::string inplace = input.substr(offset, len);
+                kernel(inplace.data(), &inplace[0], len);
+                REQUIRE(inplace == expected.substr(offset, len));
+            }
+        }
+    }
+}
+
+TEST_CASE("WriteBuffer reserved tail space", "[write_buffer]") {
+    WriteBuffer buffer;
+    size_t len = 100;
+    char* space = buffer.prepare(len);
+    REQUIRE(len == 100);
+    std::memcpy(space, "hello", 5);
+    buffer.commit(5);
+    REQUIRE(buffer.size() == 5);
+
+    // The tail chunk clamps the reservation instead of spilling over
+    std::string filler(WriteBuffer::CHUNK_SIZE - 5 - 10, 'f');
+    buffer.append(filler.data(), filler.size());
+    len = 4096;
+    buffer.prepare(len);
+    REQUIRE(len == 10);
+    buffer.commit(0);
+    REQUIRE(buffer.size() == WriteBuffer::CHUNK_SIZE - 10);
+}
+
+TEST_CASE("WriteBuffer chunk pool", "[write_buffer]") {
+    Gauge in_use;
+    Gauge cached;
+    WriteBuffer::Pool pool(2, &in_use, &cached);
+    std::string payload(WriteBuffer::CHUNK_SIZE * 3, 'p');
+    {
+        WriteBuffer a(&pool);
+        WriteBuffer b(&pool);
+        REQUIRE(pool.inUse() == 0);  // Nothing is allocated before bytes are queued
+
+        a.append(payload.data(), payload.size());
+        b.append(payload.data(), 10);
+        REQUIRE(pool.inUse() == 4);
+        REQUIRE(in_use.value() == 4);
+
+        // Draining returns chunks; only two are cached, the rest are freed
+        a.consume(a.size());
+        REQUIRE(a.chunkCount() == 0);
+        REQUIRE(pool.inUse() == 1);
+        REQUIRE(pool.cached() == 2);
+        REQUIRE(cached.value() == 2);
+
+        // Cached chunks are handed out again before anything new is allocated
+        a.append(payload.data(), 10);
+        REQUIRE(pool.cached() == 1);
+        REQUIRE(pool.inUse() == 2);
+
+        // A reservation that is never filled is given back by clear()
+        WriteBuffer c(&pool);
+        size_t len = 4096;
+        c.prepare(len);
+        REQUIRE(pool.inUse() == 3);
+        c.clear();
+        REQUIRE(pool.inUse() == 2);
+    }
+    REQUIRE(pool.inUse() == 0);
+    REQUIRE(in_use.value() == 0);
+    REQUIRE(pool.cached() == 2);
+}
+
+TEST_CASE("WriteBuffer zero-copy sends", "[write_buffer]") {
+    Socket listener;
+    listener.setZeroCopy();
+    listener.bind(0);
+    listener.listen();
+    Socket sender(socket(AF_INET, SOCK_STREAM, 0));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(listener.getPort());
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    REQUIRE(connect(sender.getFd(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0);
+    sender.setZeroCopy();
+    sender.setNonBlocking();
+    Socket receiver(accept(listener.getFd(), nullptr, nullptr));
+    REQUIRE(receiver.getFd() >= 0);
+
+    std::string payload(256 * 1024, '\0');
+    for (size_t i = 0; i < payload.size(); ++i) {
+        payload[i] = static_cast<char>('a' + i % 26);
+    }
+    WriteBuffer buffer;
+    buffer.append(payload.data(), payload.size());
+
+    // Sent chunks stay parked until the kernel confirms them
+    std::string received;
+    char chunk[65536];
+    size_t copied = 0;
+    while (!buffer.empty() || received.size() < payload.size()) {
+        if (!buffer.empty()) {
+            ssize_t n = buffer.writeZeroCopy(sender.getFd());
+            REQUIRE((n > 0 || errno == EAGAIN));
+        }
+        ssize_t n = recv(receiver.getFd(), chunk, sizeof(chunk), MSG_DONTWAIT);
+        if (n > 0) received.append(chunk, static_cast<size_t>(n));
+        REQUIRE(buffer.reapZeroCopy(sender.getFd(), copied) >= 0);
+    }
+    REQUIRE(received == payload);
+
+    // Every send is eventually confirmed and its chunks released
+    for (int i = 0; i < 100 && buffer.zeroCopyPending() > 0; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        REQUIRE(buffer.reapZeroCopy(sender.getFd(), copied) >= 0);
+    }
+    REQUIRE(buffer.zeroCopyPending() == 0);
+    REQUIRE(copied > 0);  // Loopback always falls back to copying
+
+    // Chunks a closing socket never confirmed are leaked, not pooled where
+    // another connection would fill them while the kernel still sends them
+    WriteBuffer::Pool pool;
+    WriteBuffer pinned(&pool);
+    pinned.append(payload.data(), 4096);
+    REQUIRE(pinned.writeZeroCopy(sender.getFd()) == 4096);
+    REQUIRE(pinned.zeroCopyPending() == 1);
+    pinned.abandonZeroCopy();
+    REQUIRE(pinned.zeroCopyPending() == 0);
+    REQUIRE(pool.cached() == 0);
+    REQUIRE(pool.inUse() == 1);
+}
+
+TEST_CASE("Logger asynchronous output", "[logger]") {
+    // Point stdout at a temp file so the drained output can be inspected
+    std::fflush(stdout);
+    FILE* capture = std::tmpfile();
+    REQUIRE(capture != nullptr);
+    int saved_stdout = dup(STDOUT_FILENO);
+    dup2(fileno(capture), STDOUT_FILENO);
+
+    std::string long_text(200, 'x');
+    LOG_INFO("int {} uint {} text {} errno {}", -42, 7u, std::string("abc"), LogErrno{EAGAIN});
+    LOG_INFO("truncated {}|", long_text);
+    LOG_INFO("missing {} {}", 1);
+    Logger::setLevel(LogLevel::Warn);
+    LOG_INFO("filtered at runtime");
+    Logger::setLevel(LogLevel::Info);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([t] {
+            for (int i = 0; i < 100; ++i) {
+                LOG_INFO("thread {} message {}", t, i);
+            }
+        });
+    }
+    for (auto& t : threads) t.join();
+    Logger::instance().flush();
+
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+
+    std::string output;
+    std::rewind(capture);
+    char chunk[4096];
+    size_t n;
+    while ((n = std::fread(chunk, 1, sizeof(chunk), capture)) > 0) {
+        output.append(chunk, n);
+    }
+    std::fclose(capture);
+
+    REQUIRE(output.find("INFO  int -42 uint 7 text abc errno " + std::string(std::strerror(EAGAIN))) != std::string::npos);
+    REQUIRE(output.find("truncated " + std::string(LogRecord::TEXT_SIZE, 'x') + "|") != std::string::npos);
+    REQUIRE(output.find("missing 1 {}") != std::string::npos);
+    REQUIRE(output.find("filtered at runtime") == std::string::npos);
+    for (int t = 0; t < 4; ++t) {
+        std::string last = "thread " + std::to_string(t) + " message 99\n";
+        REQUIRE(output.find(last) != std::string::npos);
+    }
+}
+
+// Blocking loopback client: sends msg and reads until reply_size bytes
+// (default: as many as were sent) have come back or the server closes
+static std::string echoRoundTrip(const Endpoint& server, const std::string& msg, size_t reply_size = SIZE_MAX) {
+    Socket client(server.family());
+    if (connect(client.getFd(), server.address(), server.length()) == -1) {
+        return {};
+    }
+    write(client.getFd(), msg.data(), msg.size());
+
+    if (reply_size == SIZE_MAX) {
+        reply_size = msg.size();
+    }
+    std::string reply;
+    char buffer[4096];
+    while (reply.size() < reply_size) {
+        ssize_t n = read(client.getFd(), buffer, sizeof(buffer));
+        if (n <= 0) break;
+        reply.append(buffer, n);
+    }
+    return reply;
+}
 
+static std::string echoRoundTrip(int port, const std::string& msg, size_t reply_size = SIZE_MAX) {
+    return echoRoundTrip(Endpoint::ipv4("127.0.0.1", port), msg, reply_size);
+}
+
+TEST_CASE("TCPServer multi-reactor mode", "[server]") {
+    SECTION("Default config runs a single loop") {
+        TCPServer server(0);
+        REQUIRE(server.getLoopCount() == 1);
+    }
+
+    SECTION("Zero loops is rejected") {
+        ServerConfig config;
+        config.num_loops = 0;
+        REQUIRE_THROWS(TCPServer(0, config));
+    }
+
+    SECTION("All loops share one port and shut down together") {
+        ServerConfig config;
+        config.num_loops = 4;
+        TCPServer server(0, config);
+        REQUIRE(server.getLoopCount() == 4);
+        int port = server.getPort();
+        REQUIRE(port > 0);
+
+        std::thread runner([&] { server.start(); });
+
+        // SO_REUSEPORT hashes connections across loops; every one must be served
+        for (int i = 0; i < 32; ++i) {
+            std::string msg = "client" + std::to_string(i);
+            std::string expected = "CLIENT" + std::to_string(i);
+            REQUIRE(echoRoundTrip(port, msg) == expected);
+        }
+
+        uint64_t value = 1;
+        write(server.getShutdownFd(), &value, sizeof(value));
+        runner.join();
+    }
+}
+
+TEST_CASE("TCPServer idle timeouts", "[server][timeout]") {
+    SECTION("Idle clients are closed after the idle timeout") {
+        ServerConfig config;
+        config.idle_timeout_ms = 50;
+        TCPServer server(0, config);
+        std::thread runner([&] { server.start(); });
+
+        // Traffic keeps the connection open, silence gets it closed
+        Socket client(socket(AF_INET, SOCK_STREAM, 0));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(server.getPort());
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        REQUIRE(connect(client.getFd(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0);
+        char buffer[16];
+        for (int i = 0; i < 3; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(30));
+            REQUIRE(write(client.getFd(), "ping", 4) == 4);
+            REQUIRE(read(client.getFd(), buffer, sizeof(buffer)) == 4);
+        }
+        REQUIRE(read(client.getFd(), buffer, sizeof(buffer)) == 0);
+
+        uint64_t value = 1;
+        write(server.getShutdownFd(), &value, sizeof(value));
+        runner.join();
+    }
+}
+
+TEST_CASE("TCPServer admission control", "[server][accept]") {
+    SECTION("Connections beyond max_connections are shed") {
+        ServerConfig config;
+        config.max_connections = 2;
+        config.accept_budget = 1;
+        TCPServer server(0, config);
+        std::thread runner([&] { server.start(); });
+
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(server.getPort());
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        char buffer[16];
+        std::vector<std::unique_ptr<Socket>> clients;
+        for (int i = 0; i < 2; ++i) {
+            clients.push_back(std::make_unique<Socket>(socket(AF_INET, SOCK_STREAM, 0)));
+            REQUIRE(connect(clients.back()->getFd(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0);
+            REQUIRE(write(clients.back()->getFd(), "ab", 2) == 2);
+            REQUIRE(read(clients.back()->getFd(), buffer, sizeof(buffer)) == 2);
+        }
+
+        // Over the cap: accepted and closed straight away
+        Socket extra(socket(AF_INET, SOCK_STREAM, 0));
+        REQUIRE(connect(extra.getFd(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0);
+        REQUIRE(read(extra.getFd(), buffer, sizeof(buffer)) == 0);
+        REQUIRE(server.getMetrics(0).rejected.value() == 1);
+
+        // Closing a client frees a slot again
+        clients.pop_back();
+        while (server.getConnectionCount() > 1) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        REQUIRE(echoRoundTrip(server.getPort(), "again") == "AGAIN");
+
+        uint64_t value = 1;
+        write(server.getShutdownFd(), &value, sizeof(value));
+        runner.join();
+    }
+
+    SECTION("A one-connection accept budget still drains a burst") {
+        ServerConfig config;
+        config.accept_budget = 1;
+        TCPServer server(0, config);
+        std::thread runner([&] { server.start(); });
+
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(server.getPort());
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        std::vector<std::unique_ptr<Socket>> clients;
+        for (int i = 0; i < 16; ++i) {
+            clients.push_back(std::make_unique<Socket>(socket(AF_INET, SOCK_STREAM, 0)));
+            REQUIRE(connect(clients.back()->getFd(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0);
+        }
+        for (auto& client : clients) {
+            char buffer[16];
+            REQUIRE(write(client->getFd(), "hi", 2) == 2);
+            REQUIRE(read(client->getFd(), buffer, sizeof(buffer)) == 2);
+        }
+        REQUIRE(server.getConnectionCount() == 16);
+
+        uint64_t value = 1;
+        write(server.getShutdownFd(), &value, sizeof(value));
+        runner.join();
+    }
+}
+
+TEST_CASE("TCPServer read budget", "[server][read_budget]") {
+    SECTION("A read budget answers pings between a bulk sender's reads") {
+        ServerConfig config;
+        config.framing = Framing::Line;
+        TCPServer server(0, config);
+        std::thread runner([&] { server.start(); });
+
+        // The bulk client keeps its socket full of 1KB lines until told to stop
+        const std::string bulk_line = std::string(1023, 'b') + "\n";
+        std::atomic<bool> stop{false};
+        std::atomic<bool> written{false};
+        std::atomic<size_t> bulk_sent{0};
+        std::atomic<size_t> bulk_received{0};
+        std::string bulk_reply;
+        Socket bulk_client(AddressFamily::IPv4);
+        bulk_client.connect(Endpoint::ipv4("127.0.0.1", server.getPort()));
+        fcntl(bulk_client.getFd(), F_SETFL, fcntl(bulk_client.getFd(), F_GETFL) & ~O_NONBLOCK);
+        std::thread writer([&] {
+            while (!stop && write(bulk_client.getFd(), bulk_line.data(), bulk_line.size()) > 0) {
+                bulk_sent += bulk_line.size();
+            }
+            written = true;
+        });
+        std::thread reader([&] {
+            char buffer[65536];
+            pollfd pfd{bulk_client.getFd(), POLLIN, 0};
+            // Until the writer has stopped and everything it sent is back
+            while (!written || bulk_reply.size() < bulk_sent) {
+                if (poll(&pfd, 1, 10) <= 0) {
+                    continue;
+                }
+                ssize_t n = read(bulk_client.getFd(), buffer, sizeof(buffer));
+                if (n <= 0) break;
+                bulk_reply.append(buffer, static_cast<size_t>(n));
+                bulk_received += static_cast<size_t>(n);
+            }
+        });
+        while (bulk_received == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        // Every ping is answered while the bulk stream is still going, and
+        // the loop cuts its bulk reads short to get to them
+        Socket pinger(AddressFamily::IPv4);
+        pinger.connect(Endpoint::ipv4("127.0.0.1", server.getPort()));
+        fcntl(pinger.getFd(), F_SETFL, fcntl(pinger.getFd(), F_GETFL) & ~O_NONBLOCK);
+        const size_t received_before = bulk_received;
+        const uint64_t yields_before = server.getMetrics(0).read_yields.value();
+        std::vector<std::string> ping_replies;
+        for (int i = 0; i < 100; ++i) {
+            REQUIRE(write(pinger.getFd(), "ping\n", 5) == 5);
+            std::string reply;
+            char buffer[16];
+            while (reply.size() < 5) {
+                ssize_t n = read(pinger.getFd(), buffer, sizeof(buffer));
+                if (n <= 0) break;
+                reply.append(buffer, static_cast<size_t>(n));
+            }
+            ping_replies.push_back(reply);
+        }
+        const size_t received_during = bulk_received - received_before;
+        const uint64_t yields_during = server.getMetrics(0).read_yields.value() - yields_before;
+        const bool bulk_still_running = !written;
+        stop = true;
+        writer.join();
+        reader.join();
+
+        uint64_t value = 1;
+        write(server.getShutdownFd(), &value, sizeof(value));
+        runner.join();
+        for (const std::string& reply : ping_replies) {
+            REQUIRE(reply == "PING\n");
+        }
+        REQUIRE(bulk_still_running);
+        REQUIRE(received_during > 0);
+        REQUIRE(yields_during > 0);
+        REQUIRE(bulk_reply.size() == bulk_sent);
+        REQUIRE(bulk_reply.find('b') == std::string::npos);
+    }
+}
+
+TEST_CASE("TCPServer zero-copy sends", "[server][zerocopy]") {
+    SECTION("Large flushes go out with MSG_ZEROCOPY") {
+        ServerConfig config;
+        config.zerocopy_threshold = 16 * 1024;
+        TCPServer server(0, config);
+        std::thread runner([&] { server.start(); });
+
+        std::string msg(300 * 1024, 'z');
+        REQUIRE(echoRoundTrip(server.getPort(), msg) == std::string(msg.size(), 'Z'));
+        REQUIRE(echoRoundTrip(server.getPort(), "small") == "SMALL");
+
+        // Clients that vanish mid-reply leave nothing pinned behind for the
+        // next connection's bytes to overwrite
+        for (int i = 0; i < 4; ++i) {
+            Socket quitter(socket(AF_INET, SOCK_STREAM, 0));
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(server.getPort());
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            REQUIRE(connect(quitter.getFd(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0);
+            write(quitter.getFd(), msg.data(), msg.size());
+            linger reset{1, 0};
+            setsockopt(quitter.getFd(), SOL_SOCKET, SO_LINGER, &reset, sizeof(reset));
+        }
+        std::string other(300 * 1024, 'q');
+        REQUIRE(echoRoundTrip(server.getPort(), other) == std::string(other.size(), 'Q'));
+
+        uint64_t value = 1;
+        write(server.getShutdownFd(), &value, sizeof(value));
+        runner.join();
+        REQUIRE(server.getMetrics(0).zerocopy_sends.value() > 0);
+    }
+}
+
+TEST_CASE("TCPServer global buffer budget", "[server][budget]") {
+    SECTION("Global buffer budget parks reads and idle clients hold no chunks") {
+        ServerConfig config;
+        config.num_loops = 2;
+        config.max_buffered_bytes = 8 * 1024;   // Below the read budget and the per-connection watermark
+        TCPServer server(0, config);
+        std::thread runner([&] { server.start(); });
+
+        std::string msg(256 * 1024, 'b');
+        std::vector<std::string> replies(4);
+        std::vector<std::thread> clients;
+        for (size_t i = 0; i < replies.size(); ++i) {
+            clients.emplace_back([&, i] { replies[i] = echoRoundTrip(server.getPort(), msg); });
+        }
+        for (auto& t : clients) t.join();
+        for (const auto& reply : replies) {
+            REQUIRE(reply == std::string(msg.size(), 'B'));
+        }
+
+        // Keep one connection open and idle after its echo
+        Socket idle(socket(AF_INET, SOCK_STREAM, 0));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(server.getPort());
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        REQUIRE(connect(idle.getFd(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0);
+        write(idle.getFd(), "ping", 4);
+        char reply[4];
+        REQUIRE(read(idle.getFd(), reply, sizeof(reply)) == 4);
+
+        uint64_t value = 1;
+        write(server.getShutdownFd(), &value, sizeof(value));
+        runner.join();
+
+        uint64_t budget_pauses = 0;
+        for (size_t i = 0; i < server.getLoopCount(); ++i) {
+            budget_pauses += server.getMetrics(i).budget_pauses.value();
+            REQUIRE(server.getMetrics(i).buffer_chunks.value() == 0);
+        }
+        REQUIRE(budget_pauses > 0);
+        REQUIRE(server.getBufferedBytes() == 0);
+    }
+}
+
+TEST_CASE("TCPServer worker offload", "[server][workers]") {
+    SECTION("Worker offload keeps replies ordered and slow requests isolated") {
+        // The slow request holds its worker until the test lets it go
+        std::atomic<bool> slow_started{false};
+        std::atomic<bool> slow_released{false};
+        std::atomic<bool> slow_done{false};
+        ServerConfig config;
+        config.worker_threads = 2;
+        config.request_handler = [&](std::string& payload) {
+            if (payload.compare(0, 4, "slow") == 0) {
+                slow_started = true;
+                while (!slow_released) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+            }
+            for (char& c : payload) {
+                c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+            }
+        };
+        TCPServer server(0, config);
+        std::thread runner([&] { server.start(); });
+
+        std::string slow_reply;
+        std::thread slow([&] {
+            slow_reply = echoRoundTrip(server.getPort(), "slow request");
+            slow_done = true;
+        });
+        while (!slow_started) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        // Served by the other worker while the slow request is still running
+        std::string fast_reply = echoRoundTrip(server.getPort(), "fast");
+        const bool overtook = !slow_done;
+        slow_released = true;
+        REQUIRE(fast_reply == "FAST");
+        REQUIRE(overtook);
+
+        // Larger than the watermark: split across several in-order requests
+        std::string msg(300 * 1024, '\0');
+        for (size_t i = 0; i < msg.size(); ++i) {
+            msg[i] = static_cast<char>('a' + i % 26);
+        }
+        std::string expected = msg;
+        for (char& c : expected) c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+        REQUIRE(echoRoundTrip(server.getPort(), msg) == expected);
+
+        slow.join();
+        REQUIRE(slow_reply == "SLOW REQUEST");
+
+        uint64_t value = 1;
+        write(server.getShutdownFd(), &value, sizeof(value));
+        runner.join();
+        REQUIRE(server.getMetrics(0).worker_requests.value() >= 3);
+    }
+}
+
+TEST_CASE("TCPServer message framing", "[server][framing]") {
+    SECTION("Line framing answers every pipelined frame of a batch") {
+        ServerConfig config;
+        config.framing = Framing::Line;
+        config.max_frame_size = 1024;
+        TCPServer server(0, config);
+        std::thread runner([&] { server.start(); });
+
+        std::string batch;
+        std::string expected;
+        for (int i = 0; i < 500; ++i) {
+            batch += "frame " + std::to_string(i) + "\r\n";
+            expected += "FRAME " + std::to_string(i) + "\n";
+        }
+        REQUIRE(echoRoundTrip(server.getPort(), batch, expected.size()) == expected);
+
+        // A line longer than max_frame_size closes the connection
+        REQUIRE(echoRoundTrip(server.getPort(), std::string(4096, 'x')).empty());
+
+        uint64_t value = 1;
+        write(server.getShutdownFd(), &value, sizeof(value));
+        runner.join();
+        REQUIRE(server.getMetrics(0).frames.value() == 500);
+    }
+
+    SECTION("Length-prefixed frames, inline and through workers") {
+        for (size_t workers : {0, 2}) {
+            ServerConfig config;
+            config.framing = Framing::LengthPrefix;
+            config.max_frame_size = 256 * 1024;
+            config.worker_threads = workers;
+            TCPServer server(0, config);
+            std::thread runner([&] { server.start(); });
+
+            LengthPrefixFramer framer(config.max_frame_size);
+            std::string batch;
+            std::string expected;
+            for (size_t size : {0, 5, 100 * 1024, 200 * 1024, 7}) {
+                char header[Framer::MAX_HEADER];
+                size_t header_size = framer.encodeHeader(size, header);
+                batch.append(header, header_size);
+                batch += std::string(size, 'l');
+                expected.append(header, header_size);
+                expected += std::string(size, 'L');
+            }
+            INFO("worker_threads = " << workers);
+            REQUIRE(echoRoundTrip(server.getPort(), batch) == expected);
+
+            uint64_t value = 1;
+            write(server.getShutdownFd(), &value, sizeof(value));
+            runner.join();
+        }
+    }
+}
+
+TEST_CASE("TCPServer io_uring backend", "[server][io_uring]") {
+    SECTION("io_uring backend serves flow-controlled payloads") {
+        ServerConfig config;
+        config.reactor.backend = ReactorBackend::IoUring;
+        TCPServer server(0, config);
+        std::thread runner([&] { server.start(); });
+
+        // Larger than the 64KB watermark so reads get paused and resumed
+        std::string msg(200 * 1024, 'q');
+        REQUIRE(echoRoundTrip(server.getPort(), msg) == std::string(msg.size(), 'Q'));
+
+        uint64_t value = 1;
+        write(server.getShutdownFd(), &value, sizeof(value));
+        runner.join();
+    }
+}
+
+TEST_CASE("TCPServer IPv6 and Unix-domain listeners", "[server][socket]") {
+    auto serve = [](TCPServer& server, const std::vector<Endpoint>& clients) {
+        std::thread runner([&] { server.start(); });
+        std::vector<std::string> replies;
+        for (const Endpoint& client : clients) {
+            replies.push_back(echoRoundTrip(client, "hello"));
+        }
+        uint64_t value = 1;
+        write(server.getShutdownFd(), &value, sizeof(value));
+        runner.join();
+        REQUIRE(replies == std::vector<std::string>(clients.size(), "HELLO"));
+    };
+
+    SECTION("A dual-stack IPv6 listener also serves IPv4 clients") {
+        ServerConfig config;
+        config.num_loops = 2;
+        TCPServer server(Endpoint::parse("[::]:0"), config);
+        const int port = server.getPort();
+        REQUIRE(port > 0);
+        REQUIRE(server.getEndpoint().dualStack());
+        serve(server, {Endpoint::ipv6("::1", port), Endpoint::ipv4("127.0.0.1", port)});
+    }
+
+    SECTION("Unix path listeners share one socket and remove their file") {
+        const std::string path = "/tmp/reactor_uds_test_" + std::to_string(getpid());
+        ServerConfig config;
+        config.num_loops = 2;
+        config.zerocopy_threshold = 4096;   // Disabled for Unix sockets
+        {
+            // A file left by a dead server is replaced
+            Socket stale(AddressFamily::Unix);
+            stale.bind(Endpoint::unixPath(path));
+        }
+        REQUIRE(access(path.c_str(), F_OK) == 0);
+        {
+            TCPServer server(Endpoint::unixPath(path), config);
+            REQUIRE(server.getPort() == 0);
+            REQUIRE(server.getEndpoint().path() == path);
+            // A live server's path is not taken over
+            REQUIRE_THROWS_AS(TCPServer(Endpoint::unixPath(path)), std::runtime_error);
+            serve(server, {server.getEndpoint(), server.getEndpoint(), server.getEndpoint()});
+        }
+        REQUIRE(access(path.c_str(), F_OK) == -1);
+    }
+
+    SECTION("Abstract names need no file") {
+        const Endpoint endpoint = Endpoint::unixPath("@reactor_uds_test_" + std::to_string(getpid()));
+        TCPServer server(endpoint);
+        REQUIRE(server.getEndpoint().toString() == endpoint.toString());
+        serve(server, {endpoint});
+    }
+}
+
+TEST_CASE("TCPServer static file responses", "[server][files]") {
+    char dir_template[] = "/tmp/reactor_files_XXXXXX";
+    const std::string root = mkdtemp(dir_template);
+    auto writeFile = [&](const std::string& name, const std::string& content) {
+        // Replaced by rename, the way FileCache expects files to change
+        const std::string temp = root + "/.tmp";
+        std::ofstream(temp, std::ios::binary) << content;
+        REQUIRE(std::rename(temp.c_str(), (root + "/" + name).c_str()) == 0);
+    };
+    std::string big(8 * 1024 * 1024, '\0');
+    for (size_t i = 0; i < big.size(); ++i) {
+        big[i] = static_cast<char>('a' + i % 26);
+    }
+    writeFile("big.bin", big);
+    writeFile("small.txt", "v1");
+
+    LengthPrefixFramer framer(1024);
+    auto frame = [&](const std::string& payload) {
+        char header[Framer::MAX_HEADER];
+        return std::string(header, framer.encodeHeader(payload.size(), header)) + payload;
+    };
+
+    ServerConfig config;
+    config.framing = Framing::LengthPrefix;
+    config.max_frame_size = 1024;
+    config.static_root = root;
+
+    SECTION("Files are streamed in order with the frames around them") {
+        TCPServer server(0, config);
+        std::thread runner([&] { server.start(); });
+
+        // Twice FILE_SEND_BUDGET, so the send yields to the loop in between
+        std::string request = frame("before") + frame("GET big.bin") + frame("after");
+        std::string expected = frame("BEFORE") + frame(big) + frame("AFTER");
+        std::string reply = echoRoundTrip(server.getPort(), request, expected.size());
+
+        uint64_t value = 1;
+        write(server.getShutdownFd(), &value, sizeof(value));
+        runner.join();
+        REQUIRE(reply.size() == expected.size());
+        REQUIRE(reply == expected);
+        const LoopMetrics& metrics = server.getMetrics(0);
+        REQUIRE(metrics.file_responses.value() == 1);
+        REQUIRE(metrics.file_bytes.value() == big.size());
+        REQUIRE(metrics.buffered_bytes.value() == 0);
+    }
+
+    SECTION("Missing files and paths outside the root get an error frame") {
+        TCPServer server(0, config);
+        std::thread runner([&] { server.start(); });
+        const std::string not_found = frame("ERR No such file or directory");
+        const std::string invalid = frame("ERR Invalid argument");
+        std::string missing = echoRoundTrip(server.getPort(), frame("GET nope.txt"), not_found.size());
+        std::string escape = echoRoundTrip(server.getPort(), frame("GET ../etc/passwd"), invalid.size());
+        std::string directory = echoRoundTrip(server.getPort(), frame("GET /"), invalid.size());
+        // Opening a FIFO with no writer must not block the loop
+        REQUIRE(mkfifo((root + "/fifo").c_str(), 0600) == 0);
+        std::string fifo = echoRoundTrip(server.getPort(), frame("GET fifo"), invalid.size());
+        unlink((root + "/fifo").c_str());
+
+        uint64_t value = 1;
+        write(server.getShutdownFd(), &value, sizeof(value));
+        runner.join();
+        REQUIRE(missing == not_found);
+        REQUIRE(escape == invalid);
+        REQUIRE(directory == invalid);
+        REQUIRE(fifo == invalid);
+    }
+
+    SECTION("Hot files stay open until they are replaced") {
+        config.file_revalidate_ms = 0;
+        TCPServer server(0, config);
+        std::thread runner([&] { server.start(); });
+        const std::string request = frame("GET small.txt");
+        std::string first = echoRoundTrip(server.getPort(), request + request, 2 * frame("v1").size());
+        writeFile("small.txt", "v22");
+        std::string second = echoRoundTrip(server.getPort(), request, frame("v22").size());
+
+        uint64_t value = 1;
+        write(server.getShutdownFd(), &value, sizeof(value));
+        runner.join();
+        REQUIRE(first == frame("v1") + frame("v1"));
+        REQUIRE(second == frame("v22"));
+        REQUIRE(server.getMetrics(0).file_cache_hits.value() == 1);
+        REQUIRE(server.getMetrics(0).file_cache_misses.value() == 2);
+    }
+
+    SECTION("Symlinks out of the root are refused") {
+        char outside_template[] = "/tmp/reactor_outside_XXXXXX";
+        const std::string outside = mkdtemp(outside_template);
+        std::ofstream(outside + "/secret.txt") << "secret";
+        REQUIRE(symlink(outside.c_str(), (root + "/escape").c_str()) == 0);
+
+        TCPServer server(0, config);
+        std::thread runner([&] { server.start(); });
+        // RESOLVE_BENEATH reports an escape as EXDEV
+        const std::string refused = frame("ERR Invalid cross-device link");
+        std::string reply = echoRoundTrip(server.getPort(), frame("GET escape/secret.txt"), refused.size());
+
+        uint64_t value = 1;
+        write(server.getShutdownFd(), &value, sizeof(value));
+        runner.join();
+        unlink((root + "/escape").c_str());
+        unlink((outside + "/secret.txt").c_str());
+        rmdir(outside.c_str());
+        REQUIRE(reply == refused);
+    }
+
+    SECTION("Static files need length-prefix framing") {
+        // A '\n' in the file would end a Line frame early
+        config.framing = Framing::Line;
+        REQUIRE_THROWS_AS(TCPServer(0, config), std::invalid_argument);
+        config.framing = Framing::None;
+        REQUIRE_THROWS_AS(TCPServer(0, config), std::invalid_argument);
+    }
+
+    unlink((root + "/big.bin").c_str());
+    unlink((root + "/small.txt").c_str());
+    rmdir(root.c_str());
+}
+
+TEST_CASE("TCPServer traffic shaping", "[server][shaping]") {
+    using Clock = std::chrono::steady_clock;
+    auto elapsedMs = [](Clock::time_point start) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count();
+    };
+    ServerConfig config;
+
+    SECTION("A client is read no faster than its inbound rate") {
+        config.client_read_bytes = RateLimit{256 * 1024, 32 * 1024};
+        TCPServer server(0, config);
+        std::thread runner([&] { server.start(); });
+
+        // 32KB of burst, then 128KB at 256KB/s
+        const std::string msg(160 * 1024, 'r');
+        auto start = Clock::now();
+        std::string reply = echoRoundTrip(server.getPort(), msg);
+        auto took = elapsedMs(start);
+
+        uint64_t value = 1;
+        write(server.getShutdownFd(), &value, sizeof(value));
+        runner.join();
+        REQUIRE(reply == std::string(msg.size(), 'R'));
+        REQUIRE(took >= 400);
+        REQUIRE(server.getMetrics(0).read_throttles.value() > 0);
+        REQUIRE(server.getMetrics(0).write_throttles.value() == 0);
+    }
+
+    SECTION("A client's outbound rate does not hold up other clients") {
+        config.client_write_bytes = RateLimit{256 * 1024, 32 * 1024};
+        TCPServer server(0, config);
+        std::thread runner([&] { server.start(); });
+
+        const std::string msg(160 * 1024, 'w');
+        std::string bulk_reply;
+        long long bulk_ms = 0;
+        std::thread bulk([&] {
+            auto start = Clock::now();
+            bulk_reply = echoRoundTrip(server.getPort(), msg);
+            bulk_ms = elapsedMs(start);
+        });
+        std::vector<std::string> pings;
+        long long slowest_ping = 0;
+        for (int i = 0; i < 5; ++i) {
+            auto start = Clock::now();
+            pings.push_back(echoRoundTrip(server.getPort(), "ping"));
+            slowest_ping = std::max(slowest_ping, static_cast<long long>(elapsedMs(start)));
+        }
+        bulk.join();
+
+        uint64_t value = 1;
+        write(server.getShutdownFd(), &value, sizeof(value));
+        runner.join();
+        REQUIRE(bulk_reply == std::string(msg.size(), 'W'));
+        REQUIRE(bulk_ms >= 400);
+        for (const std::string& reply : pings) {
+            REQUIRE(reply == "PING");
+        }
+        REQUIRE(slowest_ping < 100);
+        REQUIRE(server.getMetrics(0).write_throttles.value() > 0);
+        REQUIRE(server.getMetrics(0).buffered_bytes.value() == 0);
+    }
+
+    SECTION("Listener buckets are shared by its connections and pace accepts") {
+        config.listener_read_bytes = RateLimit{256 * 1024, 32 * 1024};
+        config.listener_accepts = RateLimit{20, 2};
+        TCPServer server(0, config);
+        std::thread runner([&] { server.start(); });
+
+        // Two connections of 64KB share one 256KB/s budget. By then the
+        // accept bucket is full again: two more connections get in at once,
+        // the four after them wait 50ms each for their turn.
+        const std::string msg(64 * 1024, 'l');
+        auto start = Clock::now();
+        std::vector<std::string> replies;
+        replies.push_back(echoRoundTrip(server.getPort(), msg));
+        replies.push_back(echoRoundTrip(server.getPort(), msg));
+        auto bytes_ms = elapsedMs(start);
+        for (int i = 0; i < 6; ++i) {
+            replies.push_back(echoRoundTrip(server.getPort(), "x"));
+        }
+        auto total_ms = elapsedMs(start);
+
+        uint64_t value = 1;
+        write(server.getShutdownFd(), &value, sizeof(value));
+        runner.join();
+        REQUIRE(replies[0] == std::string(msg.size(), 'L'));
+        REQUIRE(replies[1] == std::string(msg.size(), 'L'));
+        for (size_t i = 2; i < replies.size(); ++i) {
+            REQUIRE(replies[i] == "X");
+        }
+        REQUIRE(bytes_ms >= 300);
+        REQUIRE(total_ms >= bytes_ms + 150);
+        REQUIRE(server.getMetrics(0).accept_throttles.value() > 0);
+        REQUIRE(server.getMetrics(0).accepts.value() == 8);
+    }
+}
+
+TEST_CASE("TCPServer hot restart", "[server][handoff]") {
+    const std::string path = "/tmp/reactor_handoff_test_" + std::to_string(getpid());
+    auto connectTo = [](int port) {
+        Socket client(socket(AF_INET, SOCK_STREAM, 0));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        REQUIRE(connect(client.getFd(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0);
+        return client;
+    };
+    auto roundTrip = [](Socket& client, const std::string& msg) {
+        REQUIRE(write(client.getFd(), msg.data(), msg.size()) == static_cast<ssize_t>(msg.size()));
+        std::string reply(msg.size(), '\0');
+        size_t received = 0;
+        while (received < reply.size()) {
+            ssize_t n = read(client.getFd(), &reply[received], reply.size() - received);
+            if (n <= 0) break;
+            received += static_cast<size_t>(n);
+        }
+        reply.resize(received);
+        return reply;
+    };
+
+    SECTION("Successor takes the listeners and idle connections") {
+        ServerConfig config;
+        config.num_loops = 2;
+        config.handoff_path = path;
+        config.handoff_clients = true;
+        auto previous = std::make_unique<TCPServer>(0, config);  // Nobody to inherit from: a cold start
+        const int port = previous->getPort();
+        std::thread previous_runner([&] { previous->start(); });
+
+        Socket client = connectTo(port);
+        REQUIRE(roundTrip(client, "before") == "BEFORE");
+
+        // A different loop count still keeps every inherited socket
+        config.num_loops = 3;
+        TCPServer successor(0, config);
+        REQUIRE(successor.getPort() == port);
+        REQUIRE(successor.getConnectionCount() == 1);
+
+        // Nothing was left to drain, so the old server returns by itself
+        previous_runner.join();
+        REQUIRE(previous->handedOff());
+        REQUIRE(previous->getMetrics(0).handed_off.value() + previous->getMetrics(1).handed_off.value() == 1);
+
+        std::thread runner([&] { successor.start(); });
+        REQUIRE(roundTrip(client, "after") == "AFTER");
+        REQUIRE(echoRoundTrip(port, "fresh") == "FRESH");
+        previous.reset();
+
+        uint64_t value = 1;
+        write(successor.getShutdownFd(), &value, sizeof(value));
+        runner.join();
+    }
+
+    SECTION("Connections that stay are drained up to the deadline") {
+        ServerConfig config;
+        config.handoff_path = path;
+        config.drain_timeout_ms = 500;
+        TCPServer previous(0, config);
+        std::thread previous_runner([&] { previous.start(); });
+        Socket client = connectTo(previous.getPort());
+        REQUIRE(roundTrip(client, "stay") == "STAY");
+
+        TCPServer successor(0, config);
+        REQUIRE(successor.getConnectionCount() == 0);
+        std::thread runner([&] { successor.start(); });
+
+        // The old server still answers its connection while new ones go to
+        // the successor, then closes it at the deadline
+        REQUIRE(roundTrip(client, "still here") == "STILL HERE");
+        REQUIRE(echoRoundTrip(successor.getPort(), "new") == "NEW");
+        REQUIRE(successor.getMetrics(0).accepts.value() == 1);
+        previous_runner.join();
+        char buffer[16];
+        REQUIRE(read(client.getFd(), buffer, sizeof(buffer)) == 0);
+
+        uint64_t value = 1;
+        write(successor.getShutdownFd(), &value, sizeof(value));
+        runner.join();
+    }
+
+    SECTION("Shutdown during a drain stops every loop") {
+        ServerConfig config;
+        config.num_loops = 2;
+        config.handoff_path = path;
+        config.drain_timeout_ms = 60000;
+        TCPServer previous(0, config);
+        std::thread previous_runner([&] { previous.start(); });
+        // Until the second loop has a connection of its own to drain
+        std::vector<Socket> clients;
+        while (previous.getMetrics(1).accepts.value() == 0 && clients.size() < 64) {
+            clients.push_back(connectTo(previous.getPort()));
+            REQUIRE(roundTrip(clients.back(), "stay") == "STAY");
+        }
+        REQUIRE(previous.getMetrics(1).accepts.value() > 0);
+
+        TCPServer successor(0, config);
+        std::thread runner([&] { successor.start(); });
+        REQUIRE(roundTrip(clients.back(), "draining") == "DRAINING");
+
+        // Far short of the drain deadline
+        auto begin = std::chrono::steady_clock::now();
+        uint64_t value = 1;
+        write(previous.getShutdownFd(), &value, sizeof(value));
+        previous_runner.join();
+        REQUIRE(std::chrono::steady_clock::now() - begin < std::chrono::seconds(30));
+
+        write(successor.getShutdownFd(), &value, sizeof(value));
+        runner.join();
+    }
+
+    SECTION("A trace dump after a loop has drained still covers every loop") {
+        const std::string trace_path = path + ".json";
+        ServerConfig config;
+        config.num_loops = 2;
+        config.handoff_path = path;
+        config.drain_timeout_ms = 60000;
+        config.trace_path = trace_path;
+        TCPServer previous(0, config);
+        std::thread previous_runner([&] { previous.start(); });
+        // One connection on the primary loop keeps the server up; the
+        // second loop is left empty, so it stops as soon as the drain starts
+        std::vector<Socket> clients;
+        while (previous.getMetrics(0).accepts.value() == 0 && clients.size() < 64) {
+            clients.push_back(connectTo(previous.getPort()));
+            REQUIRE(roundTrip(clients.back(), "stay") == "STAY");
+        }
+        REQUIRE(previous.getMetrics(0).accepts.value() == 1);
+        Socket client = std::move(clients.back());
+        clients.clear();
+        while (previous.getConnectionCount() > 1) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        TCPServer successor(0, config);
+        std::thread runner([&] { successor.start(); });
+        REQUIRE(roundTrip(client, "draining") == "DRAINING");
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));  // For the empty loop to stop
+
+        // Twice: a dump left waiting on the stopped loop would block every
+        // later one. Requests are repeated, since one that arrives before
+        // the previous writer has finished is ignored.
+        uint64_t value = 1;
+        for (int dump = 0; dump < 2; ++dump) {
+            unlink(trace_path.c_str());
+            std::string json;
+            for (int i = 0; i < 200 && json.empty(); ++i) {
+                if (i % 20 == 0) {
+                    write(previous.getTraceFd(), &value, sizeof(value));
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                std::ifstream in(trace_path);
+                json.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+            }
+            REQUIRE(json.find("\"name\":\"loop 0\"") != std::string::npos);
+            REQUIRE(json.find("\"name\":\"loop 1\"") != std::string::npos);
+        }
+        unlink(trace_path.c_str());
+
+        write(previous.getShutdownFd(), &value, sizeof(value));
+        previous_runner.join();
+        write(successor.getShutdownFd(), &value, sizeof(value));
+        runner.join();
+    }
+
+    SECTION("Only a successor running as handoff_uid is served") {
+        ServerConfig config;
+        config.handoff_path = path;
+        config.handoff_uid = geteuid() + 1;
+        TCPServer previous(0, config);
+        std::thread previous_runner([&] { previous.start(); });
+
+        // Disconnected before any fd is sent; the old server carries on
+        REQUIRE_THROWS_AS(TCPServer(0, config), std::runtime_error);
+        REQUIRE_FALSE(previous.handedOff());
+        REQUIRE(echoRoundTrip(previous.getPort(), "still mine") == "STILL MINE");
+
+        uint64_t value = 1;
+        write(previous.getShutdownFd(), &value, sizeof(value));
+        previous_runner.join();
+    }
+}
+
+TEST_CASE("TCPServer flight recorder", "[server][trace]") {
+    const std::string path = "/tmp/reactor_trace_test_" + std::to_string(getpid()) + ".json";
+    ServerConfig config;
+    config.num_loops = 2;
+    config.trace_path = path;
+
+    SECTION("Writing the trace fd dumps every loop as Chrome trace JSON") {
+        TCPServer server(0, config);
+        std::thread runner([&] { server.start(); });
+        std::string reply = echoRoundTrip(server.getPort(), "trace me");
+        for (int i = 0; i < 200 && server.getConnectionCount() > 0; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+
+        uint64_t value = 1;
+        write(server.getTraceFd(), &value, sizeof(value));
+        std::string json;
+        for (int i = 0; i < 200 && json.empty(); ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            std::ifstream in(path);
+            json.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        }
+        write(server.getShutdownFd(), &value, sizeof(value));
+        runner.join();
+        unlink(path.c_str());
+
+        REQUIRE(reply == "TRACE ME");
+        REQUIRE(json.size() > 2);
+        REQUIRE(json.compare(json.size() - 3, 3, "]}\n") == 0);
+        REQUIRE(json.find("\"name\":\"loop 0\"") != std::string::npos);
+        REQUIRE(json.find("\"name\":\"loop 1\"") != std::string::npos);
+        REQUIRE(json.find("\"name\":\"wait\"") != std::string::npos);
+        REQUIRE(json.find("\"cat\":\"handler\"") != std::string::npos);
+        REQUIRE(json.find("\"name\":\"accept\"") != std::string::npos);
+        REQUIRE(json.find("\"name\":\"close\"") != std::string::npos);
+    }
+
+    SECTION("No trace_events, no recorder") {
+        config.trace_events = 0;
+        TCPServer server(0, config);
+        REQUIRE(server.getTraceFd() == -1);
+    }
+}
+
+// Datagram socket connected to a loopback port; reads give up after 2s
+static Socket udpClient(int port) {
+    Socket client(SocketType::Datagram);
+    timeval timeout{2, 0};
+    setsockopt(client.getFd(), SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    connect(client.getFd(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    return client;
+}
+
+TEST_CASE("UDPServer batched datagram echo", "[udp]") {
+    SECTION("Every datagram of a burst is answered; oversized ones are dropped") {
+        Reactor reactor;
+        LoopMetrics metrics;
+        UDPServerOptions options;
+        options.batch_size = 8;
+        options.max_datagram = 512;
+        options.gro = false;
+        UDPServer server(reactor, 0, options, &metrics);
+        REQUIRE(server.getPort() > 0);
+        std::thread runner([&] { reactor.run(); });
+
+        Socket client = udpClient(server.getPort());
+        std::string oversized(1000, 'o');
+        REQUIRE(send(client.getFd(), oversized.data(), oversized.size(), 0) == 1000);
+        for (int i = 0; i < 50; ++i) {
+            std::string msg = "datagram " + std::to_string(i);
+            REQUIRE(send(client.getFd(), msg.data(), msg.size(), 0) == static_cast<ssize_t>(msg.size()));
+        }
+        for (int i = 0; i < 50; ++i) {
+            char buffer[1024];
+            ssize_t n = recv(client.getFd(), buffer, sizeof(buffer), 0);
+            REQUIRE(std::string(buffer, n > 0 ? static_cast<size_t>(n) : 0) == "DATAGRAM " + std::to_string(i));
+        }
+
+        uint64_t value = 1;
+        write(reactor.getShutdownFd(), &value, sizeof(value));
+        runner.join();
+        REQUIRE(metrics.datagrams_in.value() == 50);
+        REQUIRE(metrics.datagrams_out.value() == 50);
+        REQUIRE(metrics.datagrams_dropped.value() == 1);
+        REQUIRE(metrics.datagram_batches.value() >= 1);
+    }
+
+    SECTION("A flood yields to the loop's other handlers") {
+        Reactor reactor;
+        LoopMetrics metrics;
+        UDPServerOptions options;
+        options.batch_size = 4;
+        options.batches_per_wakeup = 1;
+        options.gro = false;
+        UDPServer server(reactor, 0, options, &metrics);
+
+        // Queued before the loop runs, so the first wakeup could drain it all
+        Socket client = udpClient(server.getPort());
+        for (int i = 0; i < 40; ++i) {
+            std::string msg = "flood " + std::to_string(i);
+            REQUIRE(send(client.getFd(), msg.data(), msg.size(), 0) == static_cast<ssize_t>(msg.size()));
+        }
+        int other = eventfd(1, EFD_NONBLOCK | EFD_CLOEXEC);
+        uint64_t answered_before_other = UINT64_MAX;
+        reactor.registerHandler(other, EPOLLIN | EPOLLET, [&](int, uint32_t) {
+            answered_before_other = metrics.datagrams_out.value();
+        });
+        std::thread runner([&] { reactor.run(); });
+
+        for (int i = 0; i < 40; ++i) {
+            char buffer[64];
+            ssize_t n = recv(client.getFd(), buffer, sizeof(buffer), 0);
+            REQUIRE(std::string(buffer, n > 0 ? static_cast<size_t>(n) : 0) == "FLOOD " + std::to_string(i));
+        }
+        uint64_t value = 1;
+        write(reactor.getShutdownFd(), &value, sizeof(value));
+        runner.join();
+        reactor.unregisterHandler(other);
+        close(other);
+        REQUIRE(answered_before_other < 40);
+        REQUIRE(metrics.datagram_yields.value() > 0);
+    }
+
+    SECTION("A GSO burst comes back as the same datagrams") {
+        Reactor reactor;
+        UDPServer server(reactor, 0);
+        if (!server.gsoEnabled()) {
+            SUCCEED("Kernel has no UDP_SEGMENT");
+            return;
+        }
+        std::thread runner([&] { reactor.run(); });
+
+        // Whether or not GRO keeps the burst together, ten replies arrive
+        Socket client = udpClient(server.getPort());
+        int segment = 1000;
+        REQUIRE(setsockopt(client.getFd(), SOL_UDP, UDP_SEGMENT, &segment, sizeof(segment)) == 0);
+        std::string burst;
+        for (int i = 0; i < 10; ++i) {
+            burst += std::string(1000, static_cast<char>('a' + i));
+        }
+        REQUIRE(send(client.getFd(), burst.data(), burst.size(), 0) == 10000);
+        for (int i = 0; i < 10; ++i) {
+            char buffer[2048];
+            ssize_t n = recv(client.getFd(), buffer, sizeof(buffer), 0);
+            REQUIRE(std::string(buffer, n > 0 ? static_cast<size_t>(n) : 0) == std::string(1000, static_cast<char>('A' + i)));
+        }
+
+        uint64_t value = 1;
+        write(reactor.getShutdownFd(), &value, sizeof(value));
+        runner.join();
+    }
+
+    SECTION("TCPServer answers UDP on every loop next to TCP") {
+        ServerConfig config;
+        config.num_loops = 2;
+        config.udp_port = 0;
+        TCPServer server(0, config);
+        REQUIRE(server.getUdpPort() > 0);
+        std::thread runner([&] { server.start(); });
+
+        REQUIRE(echoRoundTrip(server.getPort(), "tcp") == "TCP");
+        // Separate source ports hash across both loops' sockets
+        for (int i = 0; i < 8; ++i) {
+            Socket client = udpClient(server.getUdpPort());
+            REQUIRE(send(client.getFd(), "udp", 3, 0) == 3);
+            char buffer[16];
+            ssize_t n = recv(client.getFd(), buffer, sizeof(buffer), 0);
+            REQUIRE(std::string(buffer, n > 0 ? static_cast<size_t>(n) : 0) == "UDP");
+        }
+
+        uint64_t value = 1;
+        write(server.getShutdownFd(), &value, sizeof(value));
+        runner.join();
+        REQUIRE(server.getMetrics(0).datagrams_out.value() + server.getMetrics(1).datagrams_out.value() == 8);
+    }
+}
+
+TEST_CASE("Metrics histograms and scrape endpoint", "[metrics][server]") {
+    SECTION("Histogram buckets are log-linear and quantiles bound the samples") {
+        for (uint64_t v : std::vector<uint64_t>{0, 1, 7, 8, 9, 15, 16, 17, 1000, 123456789, UINT64_MAX}) {
+            size_t index = Histogram::bucketIndex(v);
+            REQUIRE(index < Histogram::BUCKETS);
+            uint64_t upper = Histogram::bucketUpperBound(index);
+            REQUIRE(upper >= v);
+            REQUIRE(upper - v <= v / 8);  // Within one sub-bucket
+        }
+
+        Histogram h;
+        REQUIRE(h.quantile(0.5) == 0);
+        for (uint64_t v = 1; v <= 1000; ++v) {
+            h.record(v);
+        }
+        REQUIRE(h.count() == 1000);
+        REQUIRE(h.sum() == 500500);
+        REQUIRE(h.max() == 1000);
+        REQUIRE(h.quantile(0.5) >= 500);
+        REQUIRE(h.quantile(0.5) <= 500 + 500 / 8);
+        REQUIRE(h.quantile(1.0) == 1000);
+    }
+
+    SECTION("Admin listener serves Prometheus text from the primary loop") {
+        ServerConfig config;
+        config.admin_port = 0;
+        config.read_budget_bytes = 0;   // Read to the 64KB watermark, so flow control pauses
+        TCPServer server(0, config);
+        REQUIRE(server.getAdminPort() > 0);
+        std::thread runner([&] { server.start(); });
+
+        std::string msg(100 * 1024, 'm');
+        REQUIRE(echoRoundTrip(server.getPort(), msg) == std::string(msg.size(), 'M'));
+
+        Socket client(socket(AF_INET, SOCK_STREAM, 0));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(server.getAdminPort());
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        REQUIRE(connect(client.getFd(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0);
+        std::string request = "GET /metrics HTTP/1.0\r\n\r\n";
+        REQUIRE(write(client.getFd(), request.data(), request.size()) == static_cast<ssize_t>(request.size()));
+        std::string response;
+        char buffer[4096];
+        ssize_t n;
+        while ((n = read(client.getFd(), buffer, sizeof(buffer))) > 0) {
+            response.append(buffer, static_cast<size_t>(n));
+        }
+
+        REQUIRE(response.compare(0, 15, "HTTP/1.0 200 OK") == 0);
+        REQUIRE(response.find("# TYPE reactor_poll_wait_seconds summary") != std::string::npos);
+        REQUIRE(response.find("reactor_handler_seconds_count{loop=\"0\"}") != std::string::npos);
+        REQUIRE(response.find("tcp_server_accepted_connections_total{loop=\"0\"} 1\n") != std::string::npos);
+        REQUIRE(response.find("tcp_server_received_bytes_total{loop=\"0\"} 102400\n") != std::string::npos);
+        REQUIRE(response.find("tcp_server_sent_bytes_total{loop=\"0\"} 102400\n") != std::string::npos);
+        REQUIRE(server.getMetrics(0).read_pauses.value() >= 1);
+        REQUIRE(server.getMetrics(0).read_resumes.value() == server.getMetrics(0).read_pauses.value());
+
+        uint64_t value = 1;
+        write(server.getShutdownFd(), &value, sizeof(value));
+        runner.join();
+        REQUIRE(server.getMetrics(0).buffered_bytes.value() == 0);
+    }
+}
 
 int main(int argc, char* argv[]) {
     return Catch::Session().run(argc, argv);